@@ -0,0 +1,164 @@
+#include "AudioCapturePipeline.h"
+#include "WavHeader.h"
+
+// Frame counts are kept modulo 2^31, next to the pending bit of _utteranceEnd
+#define FRAME_COUNT_MASK 0x7FFFFFFF
+
+AudioCapturePipeline::AudioCapturePipeline(SpeechInterface * speechInterface, uint32_t sampleRate, uint32_t maxUtteranceMs, bool debug)
+    : _framesCaptured(0), _overruns(0), _framesCommitted(0), _utteranceEnd(0)
+{
+    _speechInterface = speechInterface;
+    _conditioner = NULL;
+    _sampleRate = sampleRate;
+    _uploadCapacity = WAV_HEADER_LENGTH + (uint32_t)((uint64_t)sampleRate * maxUtteranceMs / 1000) * sizeof(int16_t);
+    _upload = (char *)malloc(_uploadCapacity);
+    _uploadLength = WAV_HEADER_LENGTH;
+    _framesDrained = 0;
+    _debug = debug;
+    resetStats();
+
+    if (_debug && _upload == NULL) printf("Cannot allocate %u bytes for the upload buffer.\r\n", (unsigned)_uploadCapacity);
+}
+
+AudioCapturePipeline::~AudioCapturePipeline(void)
+{
+    free(_upload);
+}
+
+int16_t* AudioCapturePipeline::captureBuffer()
+{
+    AudioFrame* frame = _ring.writeSlot();
+    if (frame == NULL)
+    {
+        // The network thread fell behind; drop the frame rather than wait
+        _overruns.store(_overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return NULL;
+    }
+    return frame->samples;
+}
+
+void AudioCapturePipeline::commitCapture()
+{
+    AudioFrame* frame = _ring.writeSlot();
+    if (frame == NULL) return;
+    frame->captureTimeUs = us_ticker_read();
+    _ring.commitWrite();
+    // Released so that a consumer that sees this frame also sees an end
+    // signalled before it
+    _framesCommitted.store(_framesCommitted.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    _framesCaptured.store(_framesCaptured.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+bool AudioCapturePipeline::captureFrame(const int16_t * samples)
+{
+    int16_t* buffer = captureBuffer();
+    if (buffer == NULL) return false;
+    memcpy(buffer, samples, AUDIO_FRAME_SAMPLES * sizeof(int16_t));
+    commitCapture();
+    return true;
+}
+
+void AudioCapturePipeline::endUtterance()
+{
+    // Where the utterance ends and that it did go in one word, so the
+    // consumer takes both at once
+    uint32_t frames = _framesCommitted.load(std::memory_order_relaxed) & FRAME_COUNT_MASK;
+    _utteranceEnd.store((frames << 1) | 1, std::memory_order_release);
+}
+
+int AudioCapturePipeline::drain()
+{
+    // Frames after a pending end belong to the next utterance
+    uint32_t committed = _framesCommitted.load(std::memory_order_acquire);
+    uint32_t end = _utteranceEnd.load(std::memory_order_acquire);
+    return drainTo((end & 1) ? (end >> 1) : committed);
+}
+
+int AudioCapturePipeline::drainTo(uint32_t frames)
+{
+    int drained = 0;
+    AudioFrame* frame;
+
+    while (((frames - _framesDrained) & FRAME_COUNT_MASK) != 0 && (frame = _ring.readSlot()) != NULL)
+    {
+        uint32_t latencyUs = us_ticker_read() - frame->captureTimeUs;
+        if (latencyUs < _minLatencyUs) _minLatencyUs = latencyUs;
+        if (latencyUs > _maxLatencyUs) _maxLatencyUs = latencyUs;
+        _totalLatencyUs += latencyUs;
+
+        if (_upload != NULL && _uploadLength + sizeof(frame->samples) <= _uploadCapacity)
+        {
+            // The slot is ours until commitRead(), so it is conditioned in
+            // place while it is still in cache
+            if (_conditioner != NULL) _conditioner->process(frame->samples, AUDIO_FRAME_SAMPLES);
+            memcpy(_upload + _uploadLength, frame->samples, sizeof(frame->samples));
+            _uploadLength += sizeof(frame->samples);
+            _framesUploaded++;
+        }
+        else
+        {
+            _truncated++;
+        }
+        _ring.commitRead();
+        _framesDrained++;
+        drained++;
+    }
+    return drained;
+}
+
+bool AudioCapturePipeline::utteranceComplete()
+{
+    return (_utteranceEnd.load(std::memory_order_acquire) & 1) != 0;
+}
+
+SpeechResponse* AudioCapturePipeline::recognize(SpeechResultCallback callback, void * context)
+{
+    // The end is taken before draining, so one signalled meanwhile stays
+    // pending for the next call. Every frame committed before it is in the
+    // ring by now.
+    uint32_t committed = _framesCommitted.load(std::memory_order_acquire);
+    uint32_t end = _utteranceEnd.exchange(0, std::memory_order_acq_rel);
+    drainTo((end & 1) ? (end >> 1) : committed);
+
+    if (_upload == NULL || _uploadLength == WAV_HEADER_LENGTH)
+    {
+        _uploadLength = WAV_HEADER_LENGTH;
+        return NULL;
+    }
+    writeWavHeader(_upload, _sampleRate, 16, 1, _uploadLength - WAV_HEADER_LENGTH);
+    if (_debug) printf("Uploading %u bytes of captured audio.\r\n", (unsigned)_uploadLength);
+
+    SpeechResponse* speechResponse = _speechInterface->recognizeSpeech(_upload, _uploadLength, callback, context);
+    _uploadLength = WAV_HEADER_LENGTH;
+    return speechResponse;
+}
+
+void AudioCapturePipeline::setConditioner(AudioConditioner * conditioner)
+{
+    _conditioner = conditioner;
+}
+
+void AudioCapturePipeline::getStats(AudioPipelineStats * stats)
+{
+    uint32_t latencySamples = _framesUploaded + _truncated;
+
+    stats->framesCaptured = _framesCaptured.load(std::memory_order_relaxed) - _framesCapturedBase;
+    stats->framesUploaded = _framesUploaded;
+    stats->overruns = _overruns.load(std::memory_order_relaxed) - _overrunsBase;
+    stats->truncated = _truncated;
+    stats->minLatencyUs = latencySamples ? _minLatencyUs : 0;
+    stats->maxLatencyUs = _maxLatencyUs;
+    stats->avgLatencyUs = latencySamples ? (uint32_t)(_totalLatencyUs / latencySamples) : 0;
+}
+
+void AudioCapturePipeline::resetStats()
+{
+    // Storing 0 would race with the producer's increments
+    _framesCapturedBase = _framesCaptured.load(std::memory_order_relaxed);
+    _overrunsBase = _overruns.load(std::memory_order_relaxed);
+    _framesUploaded = 0;
+    _truncated = 0;
+    _minLatencyUs = 0xFFFFFFFF;
+    _maxLatencyUs = 0;
+    _totalLatencyUs = 0;
+}
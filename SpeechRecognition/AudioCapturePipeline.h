@@ -0,0 +1,92 @@
+#ifndef __AUDIO_CAPTURE_PIPELINE_H__
+#define __AUDIO_CAPTURE_PIPELINE_H__
+
+#include "mbed.h"
+#include "SpeechInterface.h"
+#include "AudioRingBuffer.h"
+#include "AudioConditioner.h"
+
+#define AUDIO_FRAME_SAMPLES     256     // 32 ms at 8 kHz
+#define AUDIO_PIPELINE_FRAMES   16      // must be a power of two
+
+typedef struct
+{
+    int16_t samples[AUDIO_FRAME_SAMPLES];
+    uint32_t captureTimeUs;
+}AudioFrame;
+
+typedef struct
+{
+    uint32_t framesCaptured;
+    uint32_t framesUploaded;
+    uint32_t overruns;          // frames dropped because the ring was full
+    uint32_t truncated;         // frames dropped because the utterance buffer was full
+    uint32_t minLatencyUs;      // from capture to the upload buffer
+    uint32_t maxLatencyUs;
+    uint32_t avgLatencyUs;
+}AudioPipelineStats;
+
+// Hands 16 bit mono frames from the capture interrupt to the network thread.
+//
+// The producer side (captureBuffer/commitCapture, captureFrame, endUtterance)
+// never blocks and may run in an ISR or DMA completion callback. The consumer
+// side (drain, utteranceComplete, recognize) runs on the network thread and
+// builds the WAVE upload body while the capture is still going on, so the
+// request can be sent as soon as the utterance ends. Frames captured after
+// endUtterance() are left in the ring for the next utterance; one that ends
+// before the previous one was recognized is sent together with it.
+class AudioCapturePipeline
+{
+    public:
+        AudioCapturePipeline(SpeechInterface * speechInterface, uint32_t sampleRate, uint32_t maxUtteranceMs, bool debug = false);
+        virtual ~AudioCapturePipeline(void);
+
+        // Producer side
+        int16_t* captureBuffer();
+        void commitCapture();
+        bool captureFrame(const int16_t * samples);
+        void endUtterance();
+
+        // Consumer side
+        int drain();
+        bool utteranceComplete();
+        SpeechResponse* recognize(SpeechResultCallback callback = NULL, void * context = NULL);
+
+        // Consumer side too: the producer's counters are never written here,
+        // the reset keeps where they stood and reports what came since
+        void getStats(AudioPipelineStats * stats);
+        void resetStats();
+
+        // Condition every frame in place as it is drained; NULL turns it off
+        void setConditioner(AudioConditioner * conditioner);
+
+    private:
+        int drainTo(uint32_t frames);
+
+        SpeechInterface* _speechInterface;
+        AudioConditioner* _conditioner;
+        AudioRingBuffer<AudioFrame, AUDIO_PIPELINE_FRAMES> _ring;
+
+        // Written by the producer only
+        std::atomic<uint32_t> _framesCaptured;
+        std::atomic<uint32_t> _overruns;
+        std::atomic<uint32_t> _framesCommitted;
+        std::atomic<uint32_t> _utteranceEnd;   // _framesCommitted at endUtterance() << 1 | pending
+
+        // Owned by the consumer
+        char* _upload;
+        uint32_t _uploadCapacity;
+        uint32_t _uploadLength;
+        uint32_t _framesDrained;
+        uint32_t _sampleRate;
+        uint32_t _framesCapturedBase;   // _framesCaptured at resetStats()
+        uint32_t _overrunsBase;
+        uint32_t _framesUploaded;
+        uint32_t _truncated;
+        uint32_t _minLatencyUs;
+        uint32_t _maxLatencyUs;
+        uint64_t _totalLatencyUs;
+        bool _debug;
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include "AudioCodec.h"
+#include "WavHeader.h"
+#include <string.h>
+
+// RIFF + fmt (18 or 20 bytes) + fact + data chunk headers
+#define MULAW_HEADER_LENGTH         (12 + 8 + 18 + 12 + 8)
+#define IMA_ADPCM_HEADER_LENGTH     (12 + 8 + 20 + 12 + 8)
+
+static const int16_t imaStepTable[89] =
+{
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767
+};
+
+static const int8_t imaIndexTable[16] =
+{
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static void writeLe16(unsigned char * p, uint16_t value)
+{
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+}
+
+static void writeLe32(unsigned char * p, uint32_t value)
+{
+    writeLe16(p, (uint16_t)value);
+    writeLe16(p + 2, (uint16_t)(value >> 16));
+}
+
+static int16_t readSample(const char * samples, uint32_t index, int decimation)
+{
+    const unsigned char * p = (const unsigned char *)samples + index * decimation * 2;
+    if (decimation == 1)
+        return (int16_t)(p[0] | (p[1] << 8));
+
+    // Average the samples being dropped as a cheap anti-aliasing filter
+    int32_t sum = 0;
+    for (int i = 0; i < decimation; i++, p += 2)
+        sum += (int16_t)(p[0] | (p[1] << 8));
+    return (int16_t)(sum / decimation);
+}
+
+static uint8_t encodeMuLawSample(int16_t pcm)
+{
+    const int bias = 0x84;
+    const int clip = 32635;
+    int sign = (pcm < 0) ? 0x80 : 0;
+    int magnitude = sign ? -(int)pcm : pcm;
+
+    if (magnitude > clip) magnitude = clip;
+    magnitude += bias;
+
+    int exponent = 7;
+    for (int mask = 0x4000; (magnitude & mask) == 0 && exponent > 0; mask >>= 1)
+        exponent--;
+    int mantissa = (magnitude >> (exponent + 3)) & 0x0F;
+    return (uint8_t)~(sign | (exponent << 4) | mantissa);
+}
+
+static uint8_t encodeImaSample(int16_t sample, int32_t * predictor, int * index)
+{
+    int32_t diff = sample - *predictor;
+    int step = imaStepTable[*index];
+    int delta = step >> 3;
+    uint8_t code = 0;
+
+    if (diff < 0)
+    {
+        code = 8;
+        diff = -diff;
+    }
+    if (diff >= step) { code |= 4; diff -= step; delta += step; }
+    step >>= 1;
+    if (diff >= step) { code |= 2; diff -= step; delta += step; }
+    step >>= 1;
+    if (diff >= step) { code |= 1; delta += step; }
+
+    *predictor += (code & 8) ? -delta : delta;
+    if (*predictor > 32767) *predictor = 32767;
+    else if (*predictor < -32768) *predictor = -32768;
+
+    *index += imaIndexTable[code];
+    if (*index < 0) *index = 0;
+    else if (*index > 88) *index = 88;
+    return code;
+}
+
+static uint32_t writeCompressedHeader(unsigned char * p, uint16_t formatTag, uint32_t sampleRate,
+                                      uint16_t blockAlign, uint16_t bitsPerSample, uint32_t byteRate,
+                                      uint32_t sampleCount, uint32_t dataLength)
+{
+    uint32_t fmtLength = (formatTag == WAV_FORMAT_IMA_ADPCM) ? 20 : 18;
+    uint32_t headerLength = 12 + 8 + fmtLength + 12 + 8;
+
+    memcpy(p, "RIFF", 4);
+    writeLe32(p + 4, headerLength - 8 + dataLength);
+    memcpy(p + 8, "WAVEfmt ", 8);
+    writeLe32(p + 16, fmtLength);
+    writeLe16(p + 20, formatTag);
+    writeLe16(p + 22, 1);
+    writeLe32(p + 24, sampleRate);
+    writeLe32(p + 28, byteRate);
+    writeLe16(p + 32, blockAlign);
+    writeLe16(p + 34, bitsPerSample);
+    if (formatTag == WAV_FORMAT_IMA_ADPCM)
+    {
+        writeLe16(p + 36, 2);
+        writeLe16(p + 38, IMA_ADPCM_SAMPLES_PER_BLOCK);
+    }
+    else
+    {
+        writeLe16(p + 36, 0);
+    }
+    p += 20 + fmtLength;
+    memcpy(p, "fact", 4);
+    writeLe32(p + 4, 4);
+    writeLe32(p + 8, sampleCount);
+    memcpy(p + 12, "data", 4);
+    writeLe32(p + 16, dataLength);
+    return headerLength;
+}
+
+const char* audioCodecName(AudioCodec codec)
+{
+    switch (codec)
+    {
+        case AUDIO_CODEC_PCM16: return "pcm16";
+        case AUDIO_CODEC_MULAW: return "mulaw";
+        case AUDIO_CODEC_IMA_ADPCM: return "ima-adpcm";
+    }
+    return "unknown";
+}
+
+uint32_t encodedWavLength(AudioCodec codec, uint32_t sampleCount)
+{
+    switch (codec)
+    {
+        case AUDIO_CODEC_PCM16:
+            return WAV_HEADER_LENGTH + sampleCount * 2;
+        case AUDIO_CODEC_MULAW:
+            return MULAW_HEADER_LENGTH + sampleCount;
+        case AUDIO_CODEC_IMA_ADPCM:
+            return IMA_ADPCM_HEADER_LENGTH +
+                   (sampleCount + IMA_ADPCM_SAMPLES_PER_BLOCK - 1) / IMA_ADPCM_SAMPLES_PER_BLOCK * IMA_ADPCM_BLOCK_ALIGN;
+    }
+    return 0;
+}
+
+uint32_t encodeWav(AudioCodec codec, const char * samples, uint32_t sampleCount, uint32_t sampleRate, int decimation, char * dest)
+{
+    unsigned char * out = (unsigned char *)dest;
+    uint32_t outCount = sampleCount / decimation;
+    uint32_t outRate = sampleRate / decimation;
+    uint32_t length = encodedWavLength(codec, outCount);
+
+    switch (codec)
+    {
+        case AUDIO_CODEC_PCM16:
+        {
+            out += writeWavHeader(dest, outRate, 16, 1, outCount * 2);
+            for (uint32_t i = 0; i < outCount; i++, out += 2)
+                writeLe16(out, (uint16_t)readSample(samples, i, decimation));
+            break;
+        }
+        case AUDIO_CODEC_MULAW:
+        {
+            out += writeCompressedHeader(out, WAV_FORMAT_MULAW, outRate, 1, 8, outRate,
+                                         outCount, outCount);
+            for (uint32_t i = 0; i < outCount; i++)
+                *out++ = encodeMuLawSample(readSample(samples, i, decimation));
+            break;
+        }
+        case AUDIO_CODEC_IMA_ADPCM:
+        {
+            uint32_t blocks = (outCount + IMA_ADPCM_SAMPLES_PER_BLOCK - 1) / IMA_ADPCM_SAMPLES_PER_BLOCK;
+            out += writeCompressedHeader(out, WAV_FORMAT_IMA_ADPCM, outRate, IMA_ADPCM_BLOCK_ALIGN, 4,
+                                         outRate * IMA_ADPCM_BLOCK_ALIGN / IMA_ADPCM_SAMPLES_PER_BLOCK,
+                                         outCount, blocks * IMA_ADPCM_BLOCK_ALIGN);
+            int index = 0;
+            for (uint32_t block = 0; block < blocks; block++)
+            {
+                uint32_t first = block * IMA_ADPCM_SAMPLES_PER_BLOCK;
+                int32_t predictor = readSample(samples, first, decimation);
+
+                // Block header: the first sample verbatim and the step index
+                writeLe16(out, (uint16_t)predictor);
+                out[2] = (unsigned char)index;
+                out[3] = 0;
+                out += 4;
+
+                // Two samples per byte, low nibble first; the last block is
+                // padded with silence
+                for (uint32_t i = 1; i < IMA_ADPCM_SAMPLES_PER_BLOCK; i += 2)
+                {
+                    int16_t a = (first + i < outCount) ? readSample(samples, first + i, decimation) : 0;
+                    int16_t b = (first + i + 1 < outCount) ? readSample(samples, first + i + 1, decimation) : 0;
+                    uint8_t lo = encodeImaSample(a, &predictor, &index);
+                    uint8_t hi = encodeImaSample(b, &predictor, &index);
+                    *out++ = (uint8_t)(lo | (hi << 4));
+                }
+            }
+            break;
+        }
+    }
+    return length;
+}
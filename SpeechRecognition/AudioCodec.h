@@ -0,0 +1,27 @@
+#ifndef __AUDIO_CODEC_H__
+#define __AUDIO_CODEC_H__
+
+#include <stdint.h>
+
+typedef enum
+{
+    AUDIO_CODEC_PCM16,      // 16 bit linear PCM, 2 bytes per sample
+    AUDIO_CODEC_MULAW,      // G.711 mu-law, 1 byte per sample
+    AUDIO_CODEC_IMA_ADPCM   // IMA ADPCM, 4 bits per sample plus block headers
+}AudioCodec;
+
+#define IMA_ADPCM_BLOCK_ALIGN           256
+#define IMA_ADPCM_SAMPLES_PER_BLOCK     ((IMA_ADPCM_BLOCK_ALIGN - 4) * 2 + 1)
+
+const char* audioCodecName(AudioCodec codec);
+
+// Size of the WAVE file encodeWav() produces for sampleCount mono samples
+uint32_t encodedWavLength(AudioCodec codec, uint32_t sampleCount);
+
+// Encode little endian 16 bit mono samples into a complete WAVE file at dest,
+// keeping every decimation'th sample (averaged with the ones dropped).
+// dest must hold encodedWavLength(codec, sampleCount / decimation) bytes.
+// Returns the number of bytes written.
+uint32_t encodeWav(AudioCodec codec, const char * samples, uint32_t sampleCount, uint32_t sampleRate, int decimation, char * dest);
+
+#endif
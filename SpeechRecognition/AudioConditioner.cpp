@@ -0,0 +1,248 @@
+#include "AudioConditioner.h"
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CONDITIONER_NEON
+#endif
+
+// Leave some headroom below full scale when limiting the gain
+#define PEAK_LIMIT  29491
+
+typedef struct
+{
+    int32_t sum;            // of the input, for the DC estimate
+    uint32_t sumSquares;    // of the DC free input >> 4, for the RMS
+    int32_t peak;           // of the DC free input
+    uint32_t clipped;
+}BlockStats;
+
+static inline int16_t saturate16(int32_t value)
+{
+    return value > 32767 ? 32767 : (value < -32768 ? -32768 : (int16_t)value);
+}
+
+// y = saturate((saturate(x - dc) * gain + round) >> CONDITIONER_GAIN_BITS),
+// the exact result of the vector paths below
+static void conditionScalar(int16_t * samples, uint32_t count, int16_t dc, int16_t gain, BlockStats * stats)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        int32_t x = samples[i];
+        int16_t d = saturate16(x - dc);
+        int32_t magnitude = d < 0 ? (d == -32768 ? 32767 : -d) : d;
+        int32_t q = d >> 4;
+        int16_t y = saturate16(((int32_t)d * gain + (1 << (CONDITIONER_GAIN_BITS - 1))) >> CONDITIONER_GAIN_BITS);
+
+        stats->sum += x;
+        stats->sumSquares += q * q;
+        if (magnitude > stats->peak) stats->peak = magnitude;
+        if (y == 32767 || y == -32768) stats->clipped++;
+        samples[i] = y;
+    }
+}
+
+static void conditionBlock(int16_t * samples, uint32_t count, int16_t dc, int16_t gain, BlockStats * stats)
+{
+    uint32_t i = 0;
+    stats->sum = 0;
+    stats->sumSquares = 0;
+    stats->peak = 0;
+    stats->clipped = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i high = _mm_set1_epi16(32767);
+    const __m128i low = _mm_set1_epi16(-32768);
+    const __m128i offset = _mm_set1_epi16(dc);
+    const __m128i factor = _mm_set1_epi16(gain);
+    const __m128i round = _mm_set1_epi32(1 << (CONDITIONER_GAIN_BITS - 1));
+    __m128i sum = zero, squares = zero, peak = zero, clipped = zero;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(samples + i));
+        __m128i d = _mm_subs_epi16(x, offset);
+        __m128i q = _mm_srai_epi16(d, 4);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(x, ones));
+        squares = _mm_add_epi32(squares, _mm_madd_epi16(q, q));
+        peak = _mm_max_epi16(peak, _mm_max_epi16(d, _mm_subs_epi16(zero, d)));
+
+        // 16 x 16 -> 32 bit products, rounded, shifted and packed back with
+        // signed saturation
+        __m128i lo = _mm_mullo_epi16(d, factor);
+        __m128i hi = _mm_mulhi_epi16(d, factor);
+        __m128i p0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round), CONDITIONER_GAIN_BITS);
+        __m128i p1 = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round), CONDITIONER_GAIN_BITS);
+        __m128i y = _mm_packs_epi32(p0, p1);
+        clipped = _mm_sub_epi16(clipped, _mm_or_si128(_mm_cmpeq_epi16(y, high), _mm_cmpeq_epi16(y, low)));
+        _mm_storeu_si128((__m128i *)(samples + i), y);
+    }
+
+    int32_t sums[4], squareSums[4];
+    int16_t peaks[8], clips[8];
+    _mm_storeu_si128((__m128i *)sums, sum);
+    _mm_storeu_si128((__m128i *)squareSums, squares);
+    _mm_storeu_si128((__m128i *)peaks, peak);
+    _mm_storeu_si128((__m128i *)clips, clipped);
+    for (int lane = 0; lane < 4; lane++)
+    {
+        stats->sum += sums[lane];
+        stats->sumSquares += (uint32_t)squareSums[lane];
+    }
+    for (int lane = 0; lane < 8; lane++)
+    {
+        if (peaks[lane] > stats->peak) stats->peak = peaks[lane];
+        stats->clipped += clips[lane];
+    }
+#elif defined(CONDITIONER_NEON)
+    const int16x8_t high = vdupq_n_s16(32767);
+    const int16x8_t low = vdupq_n_s16(-32768);
+    const int16x8_t offset = vdupq_n_s16(dc);
+    const int16x4_t factor = vdup_n_s16(gain);
+    int32x4_t sum = vdupq_n_s32(0);
+    int32x4_t squares = vdupq_n_s32(0);
+    int16x8_t peak = vdupq_n_s16(0);
+    int16x8_t clipped = vdupq_n_s16(0);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        int16x8_t x = vld1q_s16(samples + i);
+        int16x8_t d = vqsubq_s16(x, offset);
+        int16x8_t q = vshrq_n_s16(d, 4);
+        sum = vpadalq_s16(sum, x);
+        squares = vmlal_s16(squares, vget_low_s16(q), vget_low_s16(q));
+        squares = vmlal_s16(squares, vget_high_s16(q), vget_high_s16(q));
+        peak = vmaxq_s16(peak, vqabsq_s16(d));
+
+        // Rounding, saturating narrow matches the SSE2 and scalar paths
+        int32x4_t p0 = vmull_s16(vget_low_s16(d), factor);
+        int32x4_t p1 = vmull_s16(vget_high_s16(d), factor);
+        int16x8_t y = vcombine_s16(vqrshrn_n_s32(p0, CONDITIONER_GAIN_BITS), vqrshrn_n_s32(p1, CONDITIONER_GAIN_BITS));
+        clipped = vsubq_s16(clipped, vreinterpretq_s16_u16(vorrq_u16(vceqq_s16(y, high), vceqq_s16(y, low))));
+        vst1q_s16(samples + i, y);
+    }
+
+    int32_t sums[4], squareSums[4];
+    int16_t peaks[8], clips[8];
+    vst1q_s32(sums, sum);
+    vst1q_s32(squareSums, squares);
+    vst1q_s16(peaks, peak);
+    vst1q_s16(clips, clipped);
+    for (int lane = 0; lane < 4; lane++)
+    {
+        stats->sum += sums[lane];
+        stats->sumSquares += (uint32_t)squareSums[lane];
+    }
+    for (int lane = 0; lane < 8; lane++)
+    {
+        if (peaks[lane] > stats->peak) stats->peak = peaks[lane];
+        stats->clipped += clips[lane];
+    }
+#endif
+
+    conditionScalar(samples + i, count - i, dc, gain, stats);
+}
+
+AudioConditioner::AudioConditioner(int16_t targetRms, float maxGain, int16_t noiseFloor)
+{
+    _targetRms = targetRms;
+    _noiseFloor = noiseFloor;
+    _maxGain = maxGain < 32767.0f / (1 << CONDITIONER_GAIN_BITS) ? maxGain : 32767.0f / (1 << CONDITIONER_GAIN_BITS);
+    reset();
+    resetStats();
+}
+
+AudioConditioner::~AudioConditioner(void)
+{
+}
+
+void AudioConditioner::reset()
+{
+    _dc = 0;
+    _gain = 1 << CONDITIONER_GAIN_BITS;
+    _primed = false;
+}
+
+void AudioConditioner::adapt(int32_t mean, uint32_t rms, int32_t peak, bool immediate)
+{
+    // DC: first order tracker at block rate
+    _dc = immediate ? saturate16(mean) : saturate16(_dc + (mean - _dc) / 8);
+
+    // Below the noise floor keep the gain, there is nothing to level
+    if (rms < (uint32_t)_noiseFloor) return;
+
+    float desired = (float)_targetRms / rms;
+    if (peak > 0 && desired > (float)PEAK_LIMIT / peak) desired = (float)PEAK_LIMIT / peak;
+    if (desired > _maxGain) desired = _maxGain;
+    if (desired < 1.0f / 8) desired = 1.0f / 8;
+
+    float current = (float)_gain / (1 << CONDITIONER_GAIN_BITS);
+    if (immediate || desired < current) current = desired;
+    else current += (desired - current) / 16;
+    _gain = (int16_t)(current * (1 << CONDITIONER_GAIN_BITS) + 0.5f);
+}
+
+void AudioConditioner::prime(const int16_t * samples, uint32_t count)
+{
+    // Measure the first block without touching it so the very first samples
+    // are already conditioned with a sensible offset and gain
+    int32_t sum = 0;
+    for (uint32_t i = 0; i < count; i++) sum += samples[i];
+    int32_t mean = sum / (int32_t)count;
+
+    uint32_t sumSquares = 0;
+    int32_t peak = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        int32_t d = saturate16(samples[i] - mean);
+        int32_t q = d >> 4;
+        sumSquares += q * q;
+        if (d < 0) d = -d;
+        if (d > peak) peak = d;
+    }
+    adapt(mean, (uint32_t)sqrtf((float)sumSquares / count) * 16, peak, true);
+    _primed = true;
+}
+
+void AudioConditioner::process(int16_t * samples, uint32_t count)
+{
+    uint32_t startUs = us_ticker_read();
+
+    for (uint32_t offset = 0; offset < count; offset += CONDITIONER_BLOCK_SAMPLES)
+    {
+        uint32_t blockLength = count - offset < CONDITIONER_BLOCK_SAMPLES ? count - offset : CONDITIONER_BLOCK_SAMPLES;
+        if (!_primed) prime(samples + offset, blockLength);
+
+        BlockStats stats;
+        conditionBlock(samples + offset, blockLength, _dc, _gain, &stats);
+        _clipped += stats.clipped;
+
+        // Measurements of this block steer the next one
+        adapt(stats.sum / (int32_t)blockLength, (uint32_t)sqrtf((float)stats.sumSquares / blockLength) * 16,
+              stats.peak, false);
+    }
+
+    _samples += count;
+    _elapsedUs += us_ticker_read() - startUs;
+}
+
+void AudioConditioner::getStats(AudioConditionerStats * stats)
+{
+    stats->samples = _samples;
+    stats->clipped = _clipped;
+    stats->dcOffset = _dc;
+    stats->gain = (float)_gain / (1 << CONDITIONER_GAIN_BITS);
+    stats->elapsedUs = _elapsedUs;
+    stats->samplesPerSec = _elapsedUs ? (uint32_t)((uint64_t)_samples * 1000000 / _elapsedUs) : 0;
+}
+
+void AudioConditioner::resetStats()
+{
+    _samples = 0;
+    _clipped = 0;
+    _elapsedUs = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef __AUDIO_CONDITIONER_H__
+#define __AUDIO_CONDITIONER_H__
+
+#include "mbed.h"
+
+#define CONDITIONER_BLOCK_SAMPLES   256
+#define CONDITIONER_GAIN_BITS       12      // gain is fixed point Q3.12
+
+typedef struct
+{
+    uint32_t samples;
+    uint32_t clipped;           // samples that hit full scale after the gain
+    int16_t dcOffset;           // current DC estimate
+    float gain;                 // current gain
+    uint32_t elapsedUs;
+    uint32_t samplesPerSec;
+}AudioConditionerStats;
+
+// Cleans up 16 bit microphone audio in place before it is uploaded: removes
+// the DC offset, levels the volume towards targetRms without letting peaks
+// clip, and saturates instead of wrapping around.
+//
+// All three steps are fused into one SSE2/NEON pass over the samples. To
+// keep that pass free of per-sample feedback, the DC offset and the gain are
+// measured per block of CONDITIONER_BLOCK_SAMPLES and applied to the next
+// one. Gain drops as soon as a block gets louder and recovers slowly.
+class AudioConditioner
+{
+    public:
+        AudioConditioner(int16_t targetRms = 3000, float maxGain = 7.9f, int16_t noiseFloor = 64);
+        virtual ~AudioConditioner(void);
+
+        void process(int16_t * samples, uint32_t count);
+        void reset();
+
+        void getStats(AudioConditionerStats * stats);
+        void resetStats();
+
+    private:
+        void prime(const int16_t * samples, uint32_t count);
+        void adapt(int32_t mean, uint32_t rms, int32_t peak, bool immediate);
+
+        int16_t _dc;
+        int16_t _gain;
+        bool _primed;
+        int16_t _targetRms;
+        int16_t _noiseFloor;
+        float _maxGain;
+
+        uint32_t _samples;
+        uint32_t _clipped;
+        uint32_t _elapsedUs;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef __AUDIO_RING_BUFFER_H__
+#define __AUDIO_RING_BUFFER_H__
+
+#include <stdint.h>
+#include <atomic>
+
+#define AUDIO_CACHE_LINE_SIZE 64
+
+// Lock-free ring buffer for exactly one producer and one consumer, e.g. the
+// microphone ISR/DMA callback and the network thread. Neither side ever
+// blocks: the producer gets NULL from writeSlot() when the buffer is full.
+//
+// Slots are written and read in place: the producer fills writeSlot() and
+// publishes it with commitWrite(), the consumer reads readSlot() and gives
+// it back with commitRead(). Capacity must be a power of two so the free
+// running indices can be masked instead of wrapped.
+template <typename T, uint32_t Capacity>
+class AudioRingBuffer
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        AudioRingBuffer() : _head(0), _tail(0) {}
+
+        // Producer side
+        T* writeSlot()
+        {
+            uint32_t head = _head.load(std::memory_order_relaxed);
+            if (head - _tail.load(std::memory_order_acquire) == Capacity) return NULL;
+            return &_slots[head & (Capacity - 1)];
+        }
+
+        void commitWrite()
+        {
+            _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool push(const T& item)
+        {
+            T* slot = writeSlot();
+            if (slot == NULL) return false;
+            *slot = item;
+            commitWrite();
+            return true;
+        }
+
+        // Consumer side
+        T* readSlot()
+        {
+            uint32_t tail = _tail.load(std::memory_order_relaxed);
+            if (_head.load(std::memory_order_acquire) == tail) return NULL;
+            return &_slots[tail & (Capacity - 1)];
+        }
+
+        void commitRead()
+        {
+            _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool pop(T* item)
+        {
+            T* slot = readSlot();
+            if (slot == NULL) return false;
+            *item = *slot;
+            commitRead();
+            return true;
+        }
+
+        // Only exact when called from one of the two sides
+        uint32_t size() const
+        {
+            return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+        }
+
+        uint32_t capacity() const { return Capacity; }
+
+    private:
+        // Each index lives on its own cache line so the producer and the
+        // consumer do not invalidate each other's line on every update.
+        alignas(AUDIO_CACHE_LINE_SIZE) std::atomic<uint32_t> _head;
+        alignas(AUDIO_CACHE_LINE_SIZE) std::atomic<uint32_t> _tail;
+        alignas(AUDIO_CACHE_LINE_SIZE) T _slots[Capacity];
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "HeapAccounting.h"
+#include <json_allocator.h>
+#include <cstddef>
+
+// Keeps the block behind the header as aligned as malloc() made it
+#define HEADER_SIZE alignof(std::max_align_t)
+
+typedef struct
+{
+    uint32_t live;
+    uint32_t allocated;
+    uint32_t allocations;
+}MarkStart;
+
+static uint32_t liveBytes;
+static uint32_t allocatedBytes;
+static uint32_t allocationCount;
+
+static int markDepth;
+static MarkStart markStart[HEAP_MAX_MARKS];
+static uint32_t markPeak[HEAP_MAX_MARKS];
+
+static void accountAlloc(uint32_t size)
+{
+    core_util_critical_section_enter();
+    liveBytes += size;
+    allocatedBytes += size;
+    allocationCount++;
+    for (int i = 0; i < markDepth; i++)
+    {
+        if (liveBytes > markPeak[i]) markPeak[i] = liveBytes;
+    }
+    core_util_critical_section_exit();
+}
+
+static void accountFree(uint32_t size)
+{
+    core_util_critical_section_enter();
+    liveBytes -= size;
+    core_util_critical_section_exit();
+}
+
+void* heapAccountingMalloc(size_t size)
+{
+    char* block = (char *)malloc(HEADER_SIZE + size);
+    if (block == NULL) return NULL;
+    *(uint32_t *)block = (uint32_t)size;
+    accountAlloc((uint32_t)size);
+    return block + HEADER_SIZE;
+}
+
+void* heapAccountingRealloc(void * ptr, size_t size)
+{
+    if (ptr == NULL) return heapAccountingMalloc(size);
+
+    char* block = (char *)ptr - HEADER_SIZE;
+    uint32_t oldSize = *(uint32_t *)block;
+    block = (char *)realloc(block, HEADER_SIZE + size);
+    if (block == NULL) return NULL;
+    *(uint32_t *)block = (uint32_t)size;
+    accountFree(oldSize);
+    accountAlloc((uint32_t)size);
+    return block + HEADER_SIZE;
+}
+
+void heapAccountingFree(void * ptr)
+{
+    if (ptr == NULL) return;
+
+    char* block = (char *)ptr - HEADER_SIZE;
+    accountFree(*(uint32_t *)block);
+    free(block);
+}
+
+static void* jsonMalloc(void * ctx, size_t size)
+{
+    return heapAccountingMalloc(size);
+}
+
+static void* jsonRealloc(void * ctx, void * ptr, size_t size)
+{
+    return heapAccountingRealloc(ptr, size);
+}
+
+static void jsonFree(void * ctx, void * ptr)
+{
+    heapAccountingFree(ptr);
+}
+
+void heapAccountingInstallJsonC()
+{
+    static const struct json_c_allocator allocator = { jsonMalloc, jsonRealloc, jsonFree, NULL };
+    json_c_set_allocator(&allocator);
+}
+
+int heapUsageBegin()
+{
+    core_util_critical_section_enter();
+    int mark = markDepth;
+    if (mark < HEAP_MAX_MARKS)
+    {
+        markStart[mark].live = liveBytes;
+        markStart[mark].allocated = allocatedBytes;
+        markStart[mark].allocations = allocationCount;
+        markPeak[mark] = liveBytes;
+        markDepth++;
+    }
+    core_util_critical_section_exit();
+    return mark;
+}
+
+void heapUsageEnd(int mark, HeapUsage * usage)
+{
+    core_util_critical_section_enter();
+    if (mark < HEAP_MAX_MARKS && mark < markDepth)
+    {
+        usage->bytesAllocated = allocatedBytes - markStart[mark].allocated;
+        usage->allocations = allocationCount - markStart[mark].allocations;
+        usage->peakBytes = markPeak[mark] - markStart[mark].live;
+        markDepth = mark;
+    }
+    else
+    {
+        // Nested too deep to be tracked
+        memset(usage, 0, sizeof(HeapUsage));
+    }
+    core_util_critical_section_exit();
+}
+
+uint32_t heapLiveBytes()
+{
+    return liveBytes;
+}
@@ -0,0 +1,32 @@
+#ifndef __HEAP_ACCOUNTING_H__
+#define __HEAP_ACCOUNTING_H__
+
+#include "mbed.h"
+
+#define HEAP_MAX_MARKS 4
+
+typedef struct
+{
+    uint32_t bytesAllocated;    // requested during the interval, frees not subtracted
+    uint32_t peakBytes;         // highest live bytes above the level at its start
+    uint32_t allocations;
+}HeapUsage;
+
+// Counting allocator. Every block carries a small header with its size so
+// frees can be accounted; blocks must be released by heapAccountingFree().
+void* heapAccountingMalloc(size_t size);
+void* heapAccountingRealloc(void * ptr, size_t size);
+void heapAccountingFree(void * ptr);
+
+// Route json-c's allocations through the counters too. Call once at start
+// up, before any json-c object exists.
+void heapAccountingInstallJsonC();
+
+// Measurement intervals, nested up to HEAP_MAX_MARKS deep. Ending a mark
+// also ends every mark begun after it.
+int heapUsageBegin();
+void heapUsageEnd(int mark, HeapUsage * usage);
+
+uint32_t heapLiveBytes();
+
+#endif
@@ -0,0 +1,608 @@
+#include "IntentMatcher.h"
+
+#define RULE_SLOT_VALUE     0
+#define RULE_SYNONYM        1
+#define RULE_INTENT         2
+
+struct IntentRule
+{
+    int kind;
+    int intent;
+    char* a;
+    char* b;
+};
+
+struct IntentWord
+{
+    char* text;     // lower case; slots are stored as "{name" so text + 1 is the name
+    int length;
+    int symbol;
+    int value;      // canonical slot value word, -1 for plain words
+};
+
+struct IntentPattern
+{
+    int intent;
+    const char* name;
+    int length;
+    int symbols[INTENT_MAX_PATTERN_WORDS];
+    int slots[INTENT_MAX_PATTERN_WORDS];    // slot word per position, -1 for literals
+};
+
+struct IntentEdge
+{
+    int state;      // -1 marks an empty slot of the table
+    int symbol;
+    int next;
+};
+
+typedef struct
+{
+    const char* text;
+    int length;
+    int value;
+}WordSpan;
+
+static bool isWordChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '\'';
+}
+
+// Whether text is one word as nextToken() splits them, so it can match
+static bool isSingleWord(const char * text)
+{
+    if (*text == '\0') return false;
+    while (isWordChar(*text)) text++;
+    return *text == '\0';
+}
+
+static char toLower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static uint32_t hashWord(const char * text, int length)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)toLower(text[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t hashEdge(int state, int symbol)
+{
+    uint32_t hash = (uint32_t)state * 0x9E3779B1u ^ (uint32_t)symbol * 0x85EBCA77u;
+    return hash ^ (hash >> 15);
+}
+
+// Next word or {slot} token at or after *pos; returns its length, 0 at the end
+static int nextToken(const char * text, int * pos, bool allowSlots)
+{
+    int i = *pos;
+    while (text[i] != '\0' && !isWordChar(text[i]) && !(allowSlots && text[i] == '{')) i++;
+    *pos = i;
+    if (text[i] == '\0') return 0;
+    if (text[i] == '{')
+    {
+        int end = i + 1;
+        while (text[end] != '\0' && text[end] != '}') end++;
+        return text[end] == '}' ? end + 1 - i : -1;
+    }
+    while (isWordChar(text[i])) i++;
+    return i - *pos;
+}
+
+static char* copyString(const char * text, int length)
+{
+    char* copy = (char *)malloc(length + 1);
+    if (copy == NULL) return NULL;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static bool growArray(void ** array, int * capacity, int needed, size_t elementSize)
+{
+    if (needed <= *capacity) return true;
+    int newCapacity = *capacity ? *capacity * 2 : 16;
+    while (newCapacity < needed) newCapacity *= 2;
+    void* grown = realloc(*array, newCapacity * elementSize);
+    if (grown == NULL) return false;
+    *array = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+IntentMatcher::IntentMatcher(bool debug)
+{
+    _rules = NULL;
+    _ruleCount = 0;
+    _ruleCapacity = 0;
+    _intentCount = 0;
+
+    _words = NULL;
+    _wordCount = 0;
+    _wordCapacity = 0;
+    _wordTable = NULL;
+    _wordTableSize = 0;
+    _symbolCount = 0;
+
+    _patterns = NULL;
+    _patternCount = 0;
+    _patternCapacity = 0;
+
+    _parent = NULL;
+    _inSymbol = NULL;
+    _depth = NULL;
+    _fail = NULL;
+    _output = NULL;
+    _dict = NULL;
+    _stateCount = 0;
+    _stateCapacity = 0;
+    _edges = NULL;
+    _edgeCount = 0;
+    _edgeTableSize = 0;
+
+    _debug = debug;
+}
+
+IntentMatcher::~IntentMatcher(void)
+{
+    clearAutomaton();
+    for (int i = 0; i < _ruleCount; i++)
+    {
+        free(_rules[i].a);
+        free(_rules[i].b);
+    }
+    free(_rules);
+}
+
+int IntentMatcher::addRule(int kind, const char * a, const char * b)
+{
+    if (!growArray((void **)&_rules, &_ruleCapacity, _ruleCount + 1, sizeof(IntentRule))) return -1;
+
+    IntentRule* rule = &_rules[_ruleCount];
+    rule->kind = kind;
+    rule->intent = 0;
+    rule->a = copyString(a, strlen(a));
+    rule->b = copyString(b, strlen(b));
+    if (rule->a == NULL || rule->b == NULL)
+    {
+        free(rule->a);
+        free(rule->b);
+        return -1;
+    }
+
+    if (kind == RULE_INTENT)
+    {
+        // Patterns of the same intent share its id; 0 is left for the
+        // other rules
+        rule->intent = _intentCount + 1;
+        for (int i = 0; i < _ruleCount; i++)
+        {
+            if (_rules[i].kind == RULE_INTENT && strcmp(_rules[i].a, rule->a) == 0)
+            {
+                rule->intent = _rules[i].intent;
+                break;
+            }
+        }
+        if (rule->intent > _intentCount) _intentCount++;
+    }
+    _ruleCount++;
+    return rule->intent;
+}
+
+int IntentMatcher::addIntent(const char * name, const char * pattern)
+{
+    return addRule(RULE_INTENT, name, pattern);
+}
+
+int IntentMatcher::addSlotValue(const char * slot, const char * value)
+{
+    if (!isSingleWord(value))
+    {
+        if (_debug) printf("Slot value \"%s\" is not a single word.\r\n", value);
+        return -1;
+    }
+    return addRule(RULE_SLOT_VALUE, slot, value);
+}
+
+int IntentMatcher::addSynonym(const char * word, const char * canonical)
+{
+    if (!isSingleWord(word) || !isSingleWord(canonical))
+    {
+        if (_debug) printf("Synonym \"%s\" of \"%s\" is not a single word.\r\n", word, canonical);
+        return -1;
+    }
+    return addRule(RULE_SYNONYM, word, canonical);
+}
+
+void IntentMatcher::clearAutomaton()
+{
+    for (int i = 0; i < _wordCount; i++) free(_words[i].text);
+    free(_words);
+    free(_wordTable);
+    free(_patterns);
+    free(_parent);
+    free(_inSymbol);
+    free(_depth);
+    free(_fail);
+    free(_output);
+    free(_dict);
+    free(_edges);
+
+    _words = NULL;
+    _wordCount = 0;
+    _wordCapacity = 0;
+    _wordTable = NULL;
+    _wordTableSize = 0;
+    _symbolCount = 0;
+    _patterns = NULL;
+    _patternCount = 0;
+    _patternCapacity = 0;
+    _parent = NULL;
+    _inSymbol = NULL;
+    _depth = NULL;
+    _fail = NULL;
+    _output = NULL;
+    _dict = NULL;
+    _stateCount = 0;
+    _stateCapacity = 0;
+    _edges = NULL;
+    _edgeCount = 0;
+    _edgeTableSize = 0;
+}
+
+int IntentMatcher::findWord(const char * text, int length)
+{
+    if (_wordTableSize == 0) return -1;
+
+    uint32_t mask = _wordTableSize - 1;
+    for (uint32_t i = hashWord(text, length) & mask; _wordTable[i] >= 0; i = (i + 1) & mask)
+    {
+        IntentWord* word = &_words[_wordTable[i]];
+        if (word->length != length) continue;
+
+        int j = 0;
+        while (j < length && word->text[j] == toLower(text[j])) j++;
+        if (j == length) return _wordTable[i];
+    }
+    return -1;
+}
+
+int IntentMatcher::insertWord(const char * text, int length, int symbol, int value)
+{
+    if (!growArray((void **)&_words, &_wordCapacity, _wordCount + 1, sizeof(IntentWord))) return -1;
+
+    // Keep the table at most half full
+    if ((_wordCount + 1) * 2 > _wordTableSize)
+    {
+        int size = _wordTableSize ? _wordTableSize * 2 : 64;
+        int* table = (int *)malloc(size * sizeof(int));
+        if (table == NULL) return -1;
+        memset(table, 0xFF, size * sizeof(int));
+        for (int w = 0; w < _wordCount; w++)
+        {
+            uint32_t i = hashWord(_words[w].text, _words[w].length) & (size - 1);
+            while (table[i] >= 0) i = (i + 1) & (size - 1);
+            table[i] = w;
+        }
+        free(_wordTable);
+        _wordTable = table;
+        _wordTableSize = size;
+    }
+
+    IntentWord* word = &_words[_wordCount];
+    word->text = copyString(text, length);
+    if (word->text == NULL) return -1;
+    for (int c = 0; c < length; c++) word->text[c] = toLower(word->text[c]);
+    word->length = length;
+    word->symbol = symbol;
+    word->value = value;
+
+    uint32_t i = hashWord(text, length) & (_wordTableSize - 1);
+    while (_wordTable[i] >= 0) i = (i + 1) & (_wordTableSize - 1);
+    _wordTable[i] = _wordCount;
+    return _wordCount++;
+}
+
+int IntentMatcher::findEdge(int state, int symbol)
+{
+    if (_edgeTableSize == 0) return -1;
+
+    uint32_t mask = _edgeTableSize - 1;
+    for (uint32_t i = hashEdge(state, symbol) & mask; _edges[i].state >= 0; i = (i + 1) & mask)
+    {
+        if (_edges[i].state == state && _edges[i].symbol == symbol) return _edges[i].next;
+    }
+    return -1;
+}
+
+int IntentMatcher::addEdge(int state, int symbol, int next)
+{
+    if ((_edgeCount + 1) * 2 > _edgeTableSize)
+    {
+        int size = _edgeTableSize ? _edgeTableSize * 2 : 256;
+        IntentEdge* table = (IntentEdge *)malloc(size * sizeof(IntentEdge));
+        if (table == NULL) return -1;
+        for (int i = 0; i < size; i++) table[i].state = -1;
+        for (int e = 0; e < _edgeTableSize; e++)
+        {
+            if (_edges[e].state < 0) continue;
+            uint32_t i = hashEdge(_edges[e].state, _edges[e].symbol) & (size - 1);
+            while (table[i].state >= 0) i = (i + 1) & (size - 1);
+            table[i] = _edges[e];
+        }
+        free(_edges);
+        _edges = table;
+        _edgeTableSize = size;
+    }
+
+    uint32_t i = hashEdge(state, symbol) & (_edgeTableSize - 1);
+    while (_edges[i].state >= 0) i = (i + 1) & (_edgeTableSize - 1);
+    _edges[i].state = state;
+    _edges[i].symbol = symbol;
+    _edges[i].next = next;
+    _edgeCount++;
+    return 0;
+}
+
+int IntentMatcher::newState(int parent, int symbol)
+{
+    int needed = _stateCount + 1;
+    int capacity = _stateCapacity;
+    if (needed > capacity)
+    {
+        int newCapacity = capacity ? capacity * 2 : 64;
+        int** arrays[] = { &_parent, &_inSymbol, &_depth, &_fail, &_output, &_dict };
+        for (unsigned a = 0; a < sizeof(arrays) / sizeof(arrays[0]); a++)
+        {
+            int* grown = (int *)realloc(*arrays[a], newCapacity * sizeof(int));
+            if (grown == NULL) return -1;
+            *arrays[a] = grown;
+        }
+        _stateCapacity = newCapacity;
+    }
+
+    int state = _stateCount++;
+    _parent[state] = parent;
+    _inSymbol[state] = symbol;
+    _depth[state] = parent < 0 ? 0 : _depth[parent] + 1;
+    _fail[state] = 0;
+    _output[state] = -1;
+    _dict[state] = -1;
+    if (parent >= 0 && addEdge(parent, symbol, state) != 0) return -1;
+    return state;
+}
+
+int IntentMatcher::addPattern(int intent, const char * source)
+{
+    if (!growArray((void **)&_patterns, &_patternCapacity, _patternCount + 1, sizeof(IntentPattern))) return -1;
+
+    IntentPattern* pattern = &_patterns[_patternCount];
+    pattern->intent = intent;
+    pattern->length = 0;
+
+    int pos = 0;
+    int length;
+    while ((length = nextToken(source, &pos, true)) != 0)
+    {
+        if (length < 0 || pattern->length == INTENT_MAX_PATTERN_WORDS)
+        {
+            if (_debug) printf("Intent pattern \"%s\" is malformed or too long.\r\n", source);
+            return -1;
+        }
+
+        int word;
+        if (source[pos] == '{')
+        {
+            // Slots are keyed without the closing brace
+            word = findWord(source + pos, length - 1);
+            if (word < 0)
+            {
+                if (_debug) printf("Intent pattern \"%s\" uses a slot without values.\r\n", source);
+                return -1;
+            }
+            pattern->slots[pattern->length] = word;
+        }
+        else
+        {
+            word = findWord(source + pos, length);
+            if (word < 0) word = insertWord(source + pos, length, _symbolCount++, -1);
+            if (word < 0) return -1;
+
+            // A slot value used literally still stands for its slot
+            pattern->slots[pattern->length] = -1;
+            for (int w = 0; _words[word].value >= 0 && w < _wordCount; w++)
+            {
+                if (_words[w].text[0] == '{' && _words[w].symbol == _words[word].symbol)
+                {
+                    pattern->slots[pattern->length] = w;
+                    break;
+                }
+            }
+        }
+        pattern->symbols[pattern->length++] = _words[word].symbol;
+        pos += length;
+    }
+    if (pattern->length == 0) return -1;
+
+
+    int state = 0;
+    for (int i = 0; i < pattern->length; i++)
+    {
+        int next = findEdge(state, pattern->symbols[i]);
+        if (next < 0) next = newState(state, pattern->symbols[i]);
+        if (next < 0) return -1;
+        state = next;
+    }
+    if (_output[state] < 0) _output[state] = _patternCount;
+    _patternCount++;
+    return 0;
+}
+
+void IntentMatcher::buildFailureLinks()
+{
+    // Visit the states by depth so every link target is already final
+    int maxDepth = 0;
+    for (int s = 0; s < _stateCount; s++) if (_depth[s] > maxDepth) maxDepth = _depth[s];
+
+    for (int depth = 1; depth <= maxDepth; depth++)
+    {
+        for (int s = 1; s < _stateCount; s++)
+        {
+            if (_depth[s] != depth) continue;
+
+            int fail = 0;
+            if (depth > 1)
+            {
+                int f = _fail[_parent[s]];
+                int next;
+                while ((next = findEdge(f, _inSymbol[s])) < 0 && f != 0) f = _fail[f];
+                fail = next >= 0 ? next : 0;
+            }
+            _fail[s] = fail;
+            _dict[s] = _output[fail] >= 0 ? fail : _dict[fail];
+        }
+    }
+}
+
+int IntentMatcher::compile()
+{
+    clearAutomaton();
+    if (newState(-1, -1) != 0) return -1;
+
+    // Slot values first, then synonyms of them or of plain words, then the
+    // patterns that refer to both
+    for (int kind = RULE_SLOT_VALUE; kind <= RULE_INTENT; kind++)
+    {
+        for (int r = 0; r < _ruleCount; r++)
+        {
+            IntentRule* rule = &_rules[r];
+            if (rule->kind != kind) continue;
+
+            if (kind == RULE_SLOT_VALUE)
+            {
+                int keyLength = strlen(rule->a) + 1;
+                char* key = (char *)malloc(keyLength + 1);
+                if (key == NULL) return -1;
+                sprintf(key, "{%s", rule->a);
+                int slot = findWord(key, keyLength);
+                if (slot < 0) slot = insertWord(key, keyLength, _symbolCount++, -1);
+                free(key);
+                if (slot < 0) return -1;
+
+                if (findWord(rule->b, strlen(rule->b)) >= 0)
+                {
+                    if (_debug) printf("Slot value \"%s\" is already defined.\r\n", rule->b);
+                    continue;
+                }
+                int value = insertWord(rule->b, strlen(rule->b), _words[slot].symbol, _wordCount);
+                if (value < 0) return -1;
+            }
+            else if (kind == RULE_SYNONYM)
+            {
+                int canonical = findWord(rule->b, strlen(rule->b));
+                if (canonical < 0) canonical = insertWord(rule->b, strlen(rule->b), _symbolCount++, -1);
+                if (canonical < 0) return -1;
+
+                if (findWord(rule->a, strlen(rule->a)) >= 0)
+                {
+                    if (_debug) printf("Synonym \"%s\" is already defined.\r\n", rule->a);
+                    continue;
+                }
+                if (insertWord(rule->a, strlen(rule->a), _words[canonical].symbol, _words[canonical].value) < 0) return -1;
+            }
+            else if (addPattern(rule->intent, rule->b) != 0)
+            {
+                return -1;
+            }
+            else
+            {
+                _patterns[_patternCount - 1].name = rule->a;
+            }
+        }
+    }
+
+    buildFailureLinks();
+    if (_debug) printf("Intent grammar: %d patterns, %d words, %d states.\r\n", _patternCount, _wordCount, _stateCount);
+    return 0;
+}
+
+int IntentMatcher::match(const char * text, IntentMatch * match)
+{
+    // The last INTENT_MAX_PATTERN_WORDS words, enough to fill in the slots
+    // of any pattern that ends at the current word
+    WordSpan recent[INTENT_MAX_PATTERN_WORDS];
+    int best = -1;
+    int state = 0;
+    int pos = 0;
+    int length;
+
+    match->intent = -1;
+    match->name = NULL;
+    match->words = 0;
+    match->slotCount = 0;
+    if (_stateCount == 0) return -1;
+
+    for (int index = 0; (length = nextToken(text, &pos, false)) > 0; index++, pos += length)
+    {
+        int word = findWord(text + pos, length);
+        WordSpan* span = &recent[index % INTENT_MAX_PATTERN_WORDS];
+        span->text = text + pos;
+        span->length = length;
+        span->value = word >= 0 ? _words[word].value : -1;
+
+        if (word < 0)
+        {
+            // No pattern contains this word
+            state = 0;
+            continue;
+        }
+
+        int symbol = _words[word].symbol;
+        int next;
+        while ((next = findEdge(state, symbol)) < 0 && state != 0) state = _fail[state];
+        state = next >= 0 ? next : 0;
+
+        for (int s = _output[state] >= 0 ? state : _dict[state]; s >= 0; s = _dict[s])
+        {
+            IntentPattern* pattern = &_patterns[_output[s]];
+            if (best >= 0 && (pattern->length < _patterns[best].length
+                              || (pattern->length == _patterns[best].length && _output[s] > best)))
+            {
+                continue;
+            }
+            best = _output[s];
+
+            match->intent = pattern->intent;
+            match->name = pattern->name;
+            match->words = pattern->length;
+            match->slotCount = 0;
+            for (int i = 0; i < pattern->length && match->slotCount < INTENT_MAX_SLOTS; i++)
+            {
+                if (pattern->slots[i] < 0) continue;
+                WordSpan* slotSpan = &recent[(index - pattern->length + 1 + i) % INTENT_MAX_PATTERN_WORDS];
+                IntentSlot* slot = &match->slots[match->slotCount++];
+                slot->name = _words[pattern->slots[i]].text + 1;
+                slot->value = _words[slotSpan->value].text;
+                slot->text = slotSpan->text;
+                slot->length = slotSpan->length;
+            }
+        }
+    }
+    return match->intent;
+}
+
+int IntentMatcher::patternCount()
+{
+    return _patternCount;
+}
+
+int IntentMatcher::stateCount()
+{
+    return _stateCount;
+}
@@ -0,0 +1,111 @@
+#ifndef __INTENT_MATCHER_H__
+#define __INTENT_MATCHER_H__
+
+#include "mbed.h"
+
+#define INTENT_MAX_SLOTS            4
+#define INTENT_MAX_PATTERN_WORDS    16
+
+typedef struct
+{
+    const char * name;      // slot name without the braces
+    const char * value;     // canonical value, owned by the matcher
+    const char * text;      // the word as it appears in the matched text
+    int length;
+}IntentSlot;
+
+typedef struct
+{
+    int intent;             // id returned by addIntent()
+    const char * name;
+    int words;              // length of the matched pattern in words
+    int slotCount;
+    IntentSlot slots[INTENT_MAX_SLOTS];
+}IntentMatch;
+
+struct IntentRule;
+struct IntentWord;
+struct IntentPattern;
+struct IntentEdge;
+
+// Maps recognized text to voice commands.
+//
+// A grammar is a list of intents, each with one or more patterns of words
+// and {slot} placeholders, e.g. "turn on the {device}". A slot matches any
+// one of the values added for it; synonyms map extra words onto a word or
+// slot value. Slot values and synonyms are single words, as the text is
+// split into words on everything else. compile() turns the grammar into an Aho-Corasick automaton
+// over word symbols, so match() finds the best pattern anywhere in the text
+// in a single pass, whatever the number of patterns.
+//
+// Words are compared case-insensitively. A word that is a slot value always
+// stands for its slot, also where a pattern uses it literally. The longest
+// matching pattern wins, ties go to the pattern added first.
+class IntentMatcher
+{
+    public:
+        IntentMatcher(bool debug = false);
+        virtual ~IntentMatcher(void);
+
+        // Grammar. Returns the intent id, counting from 1, or 0 for slot
+        // values and synonyms; -1 if the rule cannot be stored or a slot
+        // value or synonym is not a single word.
+        int addIntent(const char * name, const char * pattern);
+        int addSlotValue(const char * slot, const char * value);
+        int addSynonym(const char * word, const char * canonical);
+
+        // Build the automaton from every rule added so far. Returns 0 on
+        // success, -1 if a pattern is malformed or memory ran out.
+        int compile();
+
+        // Returns the intent id of the best match, -1 if nothing matched.
+        int match(const char * text, IntentMatch * match);
+
+        int patternCount();
+        int stateCount();
+
+    private:
+        int addRule(int kind, const char * a, const char * b);
+        void clearAutomaton();
+        int findWord(const char * text, int length);
+        int insertWord(const char * text, int length, int symbol, int value);
+        int findEdge(int state, int symbol);
+        int addEdge(int state, int symbol, int next);
+        int newState(int parent, int symbol);
+        int addPattern(int intent, const char * source);
+        void buildFailureLinks();
+
+        IntentRule* _rules;
+        int _ruleCount;
+        int _ruleCapacity;
+        int _intentCount;
+
+        // Vocabulary: every known word and {slot}, hashed by text
+        IntentWord* _words;
+        int _wordCount;
+        int _wordCapacity;
+        int* _wordTable;
+        int _wordTableSize;
+        int _symbolCount;
+
+        IntentPattern* _patterns;
+        int _patternCount;
+        int _patternCapacity;
+
+        // Automaton: per state arrays, edges hashed by (state, symbol)
+        int* _parent;
+        int* _inSymbol;
+        int* _depth;
+        int* _fail;
+        int* _output;       // pattern ending in this state, -1 if none
+        int* _dict;         // nearest state on the fail chain with an output
+        int _stateCount;
+        int _stateCapacity;
+        IntentEdge* _edges;
+        int _edgeCount;
+        int _edgeTableSize;
+
+        bool _debug;
+};
+
+#endif
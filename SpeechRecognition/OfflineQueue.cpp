@@ -0,0 +1,378 @@
+#include "OfflineQueue.h"
+#include <time.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+#define RECORD_MAGIC            0x5155      // "UQ"
+#define RECORD_PENDING          0xFFFF      // erased flash
+#define RECORD_SENT             0x0000
+#define RECORD_WAITING_MASK     0xFF00      // cleared once sent or abandoned
+#define RECORD_ATTEMPTS_MASK    0x00FF      // one bit cleared per failed send
+#define MAX_ATTEMPTS            8
+#define RECORD_HEADER_LENGTH    16
+#define COPY_CHUNK_SIZE         256
+
+static const uint32_t crcNibbleTable[16] =
+{
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static uint32_t crc32Update(uint32_t crc, const unsigned char * data, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crcNibbleTable[crc & 0x0F];
+        crc = (crc >> 4) ^ crcNibbleTable[crc & 0x0F];
+    }
+    return crc;
+}
+
+static void writeLe16(unsigned char * p, uint16_t value)
+{
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+}
+
+static void writeLe32(unsigned char * p, uint32_t value)
+{
+    writeLe16(p, (uint16_t)value);
+    writeLe16(p + 2, (uint16_t)(value >> 16));
+}
+
+static uint16_t readLe16(const unsigned char * p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t readLe32(const unsigned char * p)
+{
+    return readLe16(p) | ((uint32_t)readLe16(p + 2) << 16);
+}
+
+static int failedAttempts(uint16_t state)
+{
+    int attempts = 0;
+    for (uint16_t bits = ~state & RECORD_ATTEMPTS_MASK; bits != 0; bits >>= 1) attempts += bits & 1;
+    return attempts;
+}
+
+OfflineQueue::OfflineQueue(const char * path, uint32_t maxBytes, bool debug, int maxAttempts)
+{
+    _path = (char *)malloc(strlen(path) + 1);
+    strcpy(_path, path);
+    _maxBytes = maxBytes;
+    _maxAttempts = maxAttempts < 1 ? 1 : (maxAttempts > MAX_ATTEMPTS ? MAX_ATTEMPTS : maxAttempts);
+    _debug = debug;
+    _readOffset = 0;
+    _writeOffset = 0;
+    memset(&_stats, 0, sizeof(_stats));
+
+    _file = fopen(_path, "r+b");
+    if (_file == NULL)
+    {
+        // A compaction may have been cut short between removing the old
+        // file and renaming the new one into place
+        char* tmpPath = (char *)malloc(strlen(path) + 5);
+        sprintf(tmpPath, "%s.tmp", path);
+        if (rename(tmpPath, _path) == 0) _file = fopen(_path, "r+b");
+        free(tmpPath);
+    }
+    if (_file == NULL) _file = fopen(_path, "w+b");
+    if (_file == NULL)
+    {
+        if (_debug) printf("Cannot open offline queue %s.\r\n", _path);
+        return;
+    }
+    recover();
+}
+
+OfflineQueue::~OfflineQueue(void)
+{
+    if (_file != NULL) fclose(_file);
+    free(_path);
+}
+
+int OfflineQueue::readHeader(uint32_t offset, uint32_t * length, uint16_t * state, uint32_t * enqueueTime, uint32_t * crc)
+{
+    unsigned char header[RECORD_HEADER_LENGTH];
+    if (fseek(_file, offset, SEEK_SET) != 0 || fread(header, 1, RECORD_HEADER_LENGTH, _file) != RECORD_HEADER_LENGTH)
+    {
+        return -1;
+    }
+    if (readLe16(header) != RECORD_MAGIC) return -1;
+    *state = readLe16(header + 2);
+    *length = readLe32(header + 4);
+    *enqueueTime = readLe32(header + 8);
+    *crc = readLe32(header + 12);
+    return 0;
+}
+
+void OfflineQueue::recover()
+{
+    fseek(_file, 0, SEEK_END);
+    long fileSize = ftell(_file);
+    uint32_t offset = 0;
+
+    _readOffset = 0xFFFFFFFF;
+    while (offset + RECORD_HEADER_LENGTH <= (uint32_t)fileSize)
+    {
+        uint32_t length, enqueueTime, crc;
+        uint16_t state;
+        if (readHeader(offset, &length, &state, &enqueueTime, &crc) != 0
+            || length > (uint32_t)fileSize - offset - RECORD_HEADER_LENGTH)
+        {
+            break;
+        }
+
+        // Check the payload against the CRC written with it
+        unsigned char chunk[COPY_CHUNK_SIZE];
+        writeLe32(chunk, enqueueTime);
+        uint32_t computed = crc32Update(0xFFFFFFFF, chunk, 4);
+        uint32_t remaining = length;
+        while (remaining > 0)
+        {
+            uint32_t chunkLen = remaining < COPY_CHUNK_SIZE ? remaining : COPY_CHUNK_SIZE;
+            if (fread(chunk, 1, chunkLen, _file) != chunkLen) break;
+            computed = crc32Update(computed, chunk, chunkLen);
+            remaining -= chunkLen;
+        }
+        if (remaining != 0 || ~computed != crc) break;
+
+        if ((state & RECORD_WAITING_MASK) != 0)
+        {
+            if (_readOffset == 0xFFFFFFFF) _readOffset = offset;
+            _stats.depth++;
+            _stats.pendingBytes += length;
+        }
+        offset += RECORD_HEADER_LENGTH + length;
+    }
+
+    _writeOffset = offset;
+    if (_readOffset == 0xFFFFFFFF) _readOffset = _writeOffset;
+    _stats.recovered = _stats.depth;
+    _stats.discardedBytes = (uint32_t)fileSize - offset;
+    _stats.fileBytes = _writeOffset;
+    if (_debug) printf("Offline queue %s: %u pending, %u bytes discarded.\r\n", _path,
+                       (unsigned)_stats.depth, (unsigned)_stats.discardedBytes);
+
+    // Appends overwrite a torn tail, but start from an empty file when
+    // nothing in it is worth keeping
+    if (_stats.depth == 0 && fileSize > 0) reset();
+}
+
+int OfflineQueue::sync()
+{
+    if (fflush(_file) != 0) return -1;
+#if defined(__linux__)
+    if (fsync(fileno(_file)) != 0) return -1;
+#endif
+    return 0;
+}
+
+int OfflineQueue::reset()
+{
+    fclose(_file);
+    _file = fopen(_path, "w+b");
+    _readOffset = 0;
+    _writeOffset = 0;
+    _stats.fileBytes = 0;
+    if (_file == NULL)
+    {
+        if (_debug) printf("Cannot truncate offline queue %s.\r\n", _path);
+        return -1;
+    }
+    return 0;
+}
+
+int OfflineQueue::compact()
+{
+    char* tmpPath = (char *)malloc(strlen(_path) + 5);
+    sprintf(tmpPath, "%s.tmp", _path);
+    FILE* tmp = fopen(tmpPath, "wb");
+    if (tmp == NULL)
+    {
+        free(tmpPath);
+        return -1;
+    }
+
+    // Everything before _readOffset has been sent; records after it that
+    // were sent are rare (only the head is ever drained) and copied as is
+    unsigned char chunk[COPY_CHUNK_SIZE];
+    uint32_t remaining = _writeOffset - _readOffset;
+    int result = fseek(_file, _readOffset, SEEK_SET);
+    while (result == 0 && remaining > 0)
+    {
+        uint32_t chunkLen = remaining < COPY_CHUNK_SIZE ? remaining : COPY_CHUNK_SIZE;
+        if (fread(chunk, 1, chunkLen, _file) != chunkLen || fwrite(chunk, 1, chunkLen, tmp) != chunkLen) result = -1;
+        remaining -= chunkLen;
+    }
+    if (fflush(tmp) != 0) result = -1;
+#if defined(__linux__)
+    if (result == 0 && fsync(fileno(tmp)) != 0) result = -1;
+#endif
+    fclose(tmp);
+    if (result != 0)
+    {
+        remove(tmpPath);
+        free(tmpPath);
+        return -1;
+    }
+
+    // FAT cannot rename over an existing file; the constructor finishes the
+    // rename if we are cut off in between
+    fclose(_file);
+    remove(_path);
+    rename(tmpPath, _path);
+    free(tmpPath);
+
+    _file = fopen(_path, "r+b");
+    _writeOffset -= _readOffset;
+    _readOffset = 0;
+    _stats.fileBytes = _writeOffset;
+    if (_debug) printf("Offline queue compacted to %u bytes.\r\n", (unsigned)_writeOffset);
+    return _file != NULL ? 0 : -1;
+}
+
+// Every state change only clears bits of the field written by enqueue()
+int OfflineQueue::writeState(uint32_t offset, uint16_t state)
+{
+    unsigned char field[2];
+    writeLe16(field, state);
+    if (fseek(_file, offset + 2, SEEK_SET) != 0 || fwrite(field, 1, 2, _file) != 2) return -1;
+    return sync();
+}
+
+int OfflineQueue::enqueue(const char * audioFileBinary, uint32_t length)
+{
+    uint32_t recordLength = RECORD_HEADER_LENGTH + length;
+
+    if (_file != NULL && _writeOffset + recordLength > _maxBytes && _readOffset > 0) compact();
+    if (_file == NULL || _writeOffset + recordLength > _maxBytes)
+    {
+        if (_debug) printf("Offline queue full, dropping %u bytes of audio.\r\n", (unsigned)length);
+        _stats.dropped++;
+        return -1;
+    }
+
+    unsigned char header[RECORD_HEADER_LENGTH];
+    uint32_t enqueueTime = (uint32_t)time(NULL);
+    writeLe16(header, RECORD_MAGIC);
+    writeLe16(header + 2, RECORD_PENDING);
+    writeLe32(header + 4, length);
+    writeLe32(header + 8, enqueueTime);
+    uint32_t crc = crc32Update(0xFFFFFFFF, header + 8, 4);
+    crc = crc32Update(crc, (const unsigned char *)audioFileBinary, length);
+    writeLe32(header + 12, ~crc);
+
+    // Nothing is accounted until the record is on the medium; a failed or
+    // torn write is overwritten by the next append or cut off by recover()
+    if (fseek(_file, _writeOffset, SEEK_SET) != 0
+        || fwrite(header, 1, RECORD_HEADER_LENGTH, _file) != RECORD_HEADER_LENGTH
+        || fwrite(audioFileBinary, 1, length, _file) != length
+        || sync() != 0)
+    {
+        if (_debug) printf("Cannot write to offline queue %s.\r\n", _path);
+        _stats.dropped++;
+        return -1;
+    }
+
+    _writeOffset += recordLength;
+    _stats.fileBytes = _writeOffset;
+    _stats.depth++;
+    _stats.pendingBytes += length;
+    _stats.enqueued++;
+    return 0;
+}
+
+int OfflineQueue::drain(SpeechInterface * speechInterface, int maxRecords, OfflineResultCallback callback, void * context)
+{
+    if (_file == NULL || _stats.depth == 0) return 0;
+
+    // One token for the whole batch; if even that fails the link is still down
+    if (!speechInterface->beginBatch())
+    {
+        if (_debug) printf("Offline queue: service still unreachable.\r\n");
+        return 0;
+    }
+
+    Timer drainTimer;
+    drainTimer.start();
+    int sent = 0;
+    uint32_t offset = _readOffset;
+    while (sent < maxRecords && offset < _writeOffset)
+    {
+        uint32_t length, enqueueTime, crc;
+        uint16_t state;
+        if (readHeader(offset, &length, &state, &enqueueTime, &crc) != 0) break;
+        if ((state & RECORD_WAITING_MASK) == 0)
+        {
+            offset += RECORD_HEADER_LENGTH + length;
+            continue;
+        }
+
+        char* audio = (char *)malloc(length);
+        if (audio == NULL || fread(audio, 1, length, _file) != length)
+        {
+            if (_debug) printf("Cannot read %u bytes from offline queue.\r\n", (unsigned)length);
+            free(audio);
+            break;
+        }
+        SpeechResponse* speechResponse = speechInterface->recognizeSpeech(audio, length);
+        free(audio);
+        if (speechResponse == NULL)
+        {
+            // Clear the lowest attempt bit still set; the record stays at the
+            // head until it has failed too often
+            int attempts = failedAttempts(state) + 1;
+            uint16_t failed = attempts < _maxAttempts ? (uint16_t)(state & (state - 1)) : (uint16_t)(state & RECORD_ATTEMPTS_MASK);
+            if (writeState(offset, failed) != 0) _stats.stateErrors++;
+            if (attempts < _maxAttempts) break;
+
+            if (_debug) printf("Offline queue: giving up on a record after %d attempts.\r\n", attempts);
+            offset += RECORD_HEADER_LENGTH + length;
+            _readOffset = offset;
+            _stats.depth--;
+            _stats.pendingBytes -= length;
+            _stats.abandoned++;
+            continue;
+        }
+
+        if (writeState(offset, RECORD_SENT) != 0)
+        {
+            if (_debug) printf("Offline queue: cannot mark a sent record, it is sent again after a reset.\r\n");
+            _stats.stateErrors++;
+        }
+        offset += RECORD_HEADER_LENGTH + length;
+        _readOffset = offset;
+        _stats.depth--;
+        _stats.pendingBytes -= length;
+        _stats.drained++;
+        sent++;
+
+        if (callback != NULL) callback(enqueueTime, speechResponse, context);
+        else delete speechResponse;
+    }
+    drainTimer.stop();
+    speechInterface->endBatch();
+
+    _stats.lastDrainMs = drainTimer.read_ms();
+    _stats.drainRate = (uint32_t)((uint64_t)sent * 60000 / (_stats.lastDrainMs > 0 ? _stats.lastDrainMs : 1));
+    if (_debug) printf("Offline queue: sent %d in %u ms, %u left.\r\n", sent, (unsigned)_stats.lastDrainMs, (unsigned)_stats.depth);
+
+    if (_stats.depth == 0) reset();
+    return sent;
+}
+
+uint32_t OfflineQueue::depth()
+{
+    return _stats.depth;
+}
+
+void OfflineQueue::getStats(OfflineQueueStats * stats)
+{
+    *stats = _stats;
+}
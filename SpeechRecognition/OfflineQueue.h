@@ -0,0 +1,77 @@
+#ifndef __OFFLINE_QUEUE_H__
+#define __OFFLINE_QUEUE_H__
+
+#include "mbed.h"
+#include "SpeechInterface.h"
+
+// Called once per queued utterance that reached the service. response is
+// owned by the callee, as with recognizeSpeech().
+typedef void (*OfflineResultCallback)(uint32_t enqueueTime, SpeechResponse * response, void * context);
+
+typedef struct
+{
+    uint32_t depth;             // utterances waiting to be sent
+    uint32_t pendingBytes;      // their audio bytes
+    uint32_t fileBytes;         // size of the queue file, including sent records
+    uint32_t enqueued;
+    uint32_t drained;
+    uint32_t dropped;           // rejected because the queue was full
+    uint32_t abandoned;         // given up after maxAttempts failed sends
+    uint32_t stateErrors;       // records left unmarked after a send or failure; a sent
+                                // one goes out again after a reset
+    uint32_t recovered;         // pending records found when the queue was opened
+    uint32_t discardedBytes;    // torn or corrupt tail cut off during recovery
+    uint32_t lastDrainMs;
+    uint32_t drainRate;         // utterances per minute during the last drain
+}OfflineQueueStats;
+
+// Append-only queue of utterances that could not be sent, kept in a file on
+// flash or disk so they survive a reset and go out once the network is back.
+//
+// Every record is a 16 byte header followed by the WAVE data. A record only
+// counts once its CRC matches, so a write torn by a power cut is cut off on
+// the next open. Sending a record clears its state field in place; on flash
+// that only turns bits from 1 to 0 and needs no erase. Each failed send
+// clears one more bit of the state's low byte, and after maxAttempts of
+// them the record is abandoned, so one the service never accepts does not
+// hold up the rest. The file is truncated once everything in it has been
+// sent and compacted when it runs full.
+class OfflineQueue
+{
+    public:
+        // maxAttempts is at most 8
+        OfflineQueue(const char * path, uint32_t maxBytes, bool debug = false, int maxAttempts = 3);
+        virtual ~OfflineQueue(void);
+
+        // Returns 0 once the utterance is durable, -1 if it was not queued
+        int enqueue(const char * audioFileBinary, uint32_t length);
+
+        // Send up to maxRecords utterances, oldest first, sharing one token.
+        // Stops at the first failure and leaves that utterance queued, unless
+        // it has now failed maxAttempts times: then it is abandoned and the
+        // next one is sent.
+        // Returns the number of utterances sent.
+        int drain(SpeechInterface * speechInterface, int maxRecords, OfflineResultCallback callback = NULL, void * context = NULL);
+
+        uint32_t depth();
+        void getStats(OfflineQueueStats * stats);
+
+    private:
+        void recover();
+        int readHeader(uint32_t offset, uint32_t * length, uint16_t * state, uint32_t * enqueueTime, uint32_t * crc);
+        int writeState(uint32_t offset, uint16_t state);
+        int compact();
+        int reset();
+        int sync();
+
+        FILE* _file;
+        char* _path;
+        uint32_t _maxBytes;
+        int _maxAttempts;
+        uint32_t _readOffset;   // first record not known to be sent
+        uint32_t _writeOffset;  // end of the last valid record
+        OfflineQueueStats _stats;
+        bool _debug;
+};
+
+#endif
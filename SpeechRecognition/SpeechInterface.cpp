@@ -1,7 +1,18 @@
 #include "SpeechInterface.h"
+#include "SpeechResultParser.h"
+#include "WavHeader.h"
+#include "HeapAccounting.h"
 #include "http_client.h"
 #include <json.h>
 
+#if defined(__linux__)
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define SPEECH_RECOGNITION_API_REQUEST_URL  ""                                                                  \
                                             "https://speech.platform.bing.com/recognize?"                       \
                                             "scenarios=smd&appid=D4D52672-91D7-4C74-8AD8-42B1D98141A5"          \
@@ -11,25 +22,69 @@
 #define GUID_GENERATOR_HTTP_REQUEST_URL  "http://www.fileformat.info/tool/guid.htm?count=1&format=text&hyphen=true"
 #define TOKEN_REQUEST_URL "https://api.cognitive.microsoft.com/sts/v1.0/issueToken"
 
+// Size of the pieces the response body is handed to the result parser in
+#define RESPONSE_CHUNK_SIZE 256
+
+// Block size of the arena the response tree is parsed into, enough for a
+// typical response in one block
+#define RESPONSE_ARENA_BLOCK_SIZE 8192
+
+// Lowest sample rate the recognizer still accepts after decimation
+#define MIN_UPLOAD_SAMPLE_RATE 8000
+
+// Stack of the threads that run the two copies of a hedged request
+#define SPEECH_ATTEMPT_STACK_SIZE 8192
+
+// Hedged requests whose slower copy may still be sending; each holds two
+// threads and maybe the upload. Beyond this requests are not hedged.
+#define SPEECH_HEDGES_IN_FLIGHT 2
+
 SpeechInterface::SpeechInterface(const char * subscriptionKey, const char * deviceId, bool debug)
 {
-    _requestUri = (char *)malloc(260);
-    _cognitiveSubKey = (char *)malloc(33);
-    _deviceId = (char *)malloc(37);
+    _requestUri = (char *)heapAccountingMalloc(260);
+    _cognitiveSubKey = (char *)heapAccountingMalloc(33);
+    _deviceId = (char *)heapAccountingMalloc(37);
 
     memcpy(_cognitiveSubKey, subscriptionKey, 33);
     memcpy(_deviceId, deviceId, 37);
     
+    _batchToken = NULL;
     _debug = debug;
+    _uploadTargetMs = 0;
+    memset(&_stats, 0, sizeof(_stats));
+    memset(&_heapStats, 0, sizeof(_heapStats));
+    _responseArena = json_c_arena_new(RESPONSE_ARENA_BLOCK_SIZE);
+    _parser = new SpeechResultParser(debug, _responseArena);
+
+    _hedges = NULL;
+    _hedgeCount = 0;
+    _latencyCount = 0;
+    _latencyNext = 0;
+    _hedgePercentile = 0;
+    _hedgeMinDelayMs = 0;
+    _maxRetries = 0;
+    _retryBaseMs = 0;
+    _retryMaxMs = 0;
+
+    // Seeded from the device and the time it came up, so that devices that
+    // lost the link together spread their retries
+    _jitterState = 2166136261u;
+    for (int i = 0; _deviceId[i] != '\0' && i < 36; i++) _jitterState = (_jitterState ^ (uint8_t)_deviceId[i]) * 16777619u;
+    _jitterState ^= us_ticker_read();
+    if (_jitterState == 0) _jitterState = 1;
 
     if (_debug) printf("subscriptionKey: %s, deviceId: %s \r\n", subscriptionKey, deviceId);
 }
 
 SpeechInterface::~SpeechInterface(void)
 {  
-    delete _cognitiveSubKey;
-    delete _deviceId;
-    delete _requestUri;
+    heapAccountingFree(_cognitiveSubKey);
+    heapAccountingFree(_deviceId);
+    heapAccountingFree(_requestUri);
+    heapAccountingFree(_batchToken);
+    reapHedges(true);
+    delete _parser;
+    if (_responseArena) json_c_arena_free(_responseArena);
 }
 
 char* SpeechInterface::generateGuidStr()
@@ -42,7 +97,7 @@ char* SpeechInterface::generateGuidStr()
         return NULL;
     }
 
-    char* guidStr = (char *)malloc(37);
+    char* guidStr = (char *)heapAccountingMalloc(37);
     strcpy(guidStr, _response->body);
     if (_debug) printf("Got new guid: <%s> message <%s>\r\n", guidStr, _response -> status_message);
     return guidStr;
@@ -59,38 +114,514 @@ char* SpeechInterface::getJwtToken()
         return NULL;
     }
 
-    char* token = (char *)malloc(strlen(_response->body) + 8);
+    char* token = (char *)heapAccountingMalloc(strlen(_response->body) + 8);
     sprintf(token, "Bearer %s", _response->body);
     if (_debug) printf("Got JwtToken: <%s> message <%s>\r\n", token, _response -> status_message);
     return token;
 }
 
+bool SpeechInterface::beginBatch()
+{
+    if (_batchToken == NULL) _batchToken = getJwtToken();
+    return _batchToken != NULL;
+}
+
+void SpeechInterface::endBatch()
+{
+    heapAccountingFree(_batchToken);
+    _batchToken = NULL;
+}
+
+void SpeechInterface::releaseJwtToken(char * token)
+{
+    if (token != _batchToken) heapAccountingFree(token);
+}
+
+void SpeechInterface::setUploadTarget(uint32_t targetMs)
+{
+    _uploadTargetMs = targetMs;
+}
+
+void SpeechInterface::getStats(SpeechStats * stats)
+{
+    *stats = _stats;
+}
+
+void SpeechInterface::getHeapStats(SpeechHeapStats * stats)
+{
+    *stats = _heapStats;
+}
+
+char* SpeechInterface::transcodeForUpload(const char * audioFileBinary, int * length)
+{
+    WavInfo wavInfo;
+    if (parseWavHeader(audioFileBinary, *length, &wavInfo) != 0 || wavInfo.formatTag != WAV_FORMAT_PCM
+        || wavInfo.bitsPerSample != 16 || wavInfo.channels != 1)
+    {
+        return NULL;
+    }
+    _stats.codec = AUDIO_CODEC_PCM16;
+    _stats.sampleRate = wavInfo.sampleRate;
+
+    // Nothing measured yet: send the original and learn from it
+    if (_uploadTargetMs == 0 || _stats.throughputBps == 0) return NULL;
+
+    // Richest first; decimation only once the codecs alone are not enough
+    static const struct { AudioCodec codec; int decimation; } candidates[] =
+    {
+        { AUDIO_CODEC_PCM16, 1 },
+        { AUDIO_CODEC_MULAW, 1 },
+        { AUDIO_CODEC_IMA_ADPCM, 1 },
+        { AUDIO_CODEC_MULAW, 2 },
+        { AUDIO_CODEC_IMA_ADPCM, 2 },
+    };
+    uint32_t sampleCount = wavInfo.dataLength / 2;
+    uint32_t budget = (uint32_t)((uint64_t)_stats.throughputBps * _uploadTargetMs / 1000);
+    int chosen = -1;
+    uint32_t chosenLength = 0;
+    for (unsigned i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++)
+    {
+        if (wavInfo.sampleRate / candidates[i].decimation < MIN_UPLOAD_SAMPLE_RATE) continue;
+        uint32_t encodedLength = encodedWavLength(candidates[i].codec, sampleCount / candidates[i].decimation);
+        if (chosen < 0 || encodedLength < chosenLength)
+        {
+            chosen = i;
+            chosenLength = encodedLength;
+        }
+        if (encodedLength <= budget) break;
+    }
+    if (chosen <= 0) return NULL;
+
+    char* encoded = (char *)heapAccountingMalloc(chosenLength);
+    if (encoded == NULL)
+    {
+        if (_debug) printf("Cannot allocate %u bytes to transcode the upload.\r\n", (unsigned)chosenLength);
+        return NULL;
+    }
+    encodeWav(candidates[chosen].codec, audioFileBinary + wavInfo.dataOffset, sampleCount, wavInfo.sampleRate,
+              candidates[chosen].decimation, encoded);
+    _stats.codec = candidates[chosen].codec;
+    _stats.sampleRate = wavInfo.sampleRate / candidates[chosen].decimation;
+    if (_debug) printf("Uploading %s at %u Hz: %u bytes instead of %d (%u B/s measured)\r\n", audioCodecName(_stats.codec),
+                       (unsigned)_stats.sampleRate, (unsigned)chosenLength, *length, (unsigned)_stats.throughputBps);
+    *length = (int)chosenLength;
+    return encoded;
+}
+
+// Body of the response to one upload, NULL with *error set on failure.
+// Without accounting it is a plain malloc() block, for the attempt threads
+// whose allocations may fall into a later call's heap statistics.
+static char* sendAudio(const char * requestUri, const char * jwtToken, const char * audio, int length, int * error,
+                       bool accounted = true)
+{
+    HTTPClient speechRequest = HTTPClient(HTTP_POST, requestUri);
+    speechRequest.set_header("Content-Type", "plain/text");
+    speechRequest.set_header("Authorization", jwtToken);
+
+    const Http_Response* _response = speechRequest.send(audio, length);
+    if (!_response)
+    {
+        *error = speechRequest.get_error();
+        return NULL;
+    }
+    size_t bodyLength = strlen(_response->body) + 1;
+    char* body = (char*)(accounted ? heapAccountingMalloc(bodyLength) : malloc(bodyLength));
+    if (body != NULL) memcpy(body, _response->body, bodyLength);
+    return body;
+}
+
+// The audio a request sends, read by the call and by the attempts of its
+// hedges, which may outlive it. It goes with the last reference; only the
+// thread calling recognizeSpeech(), which also reaps the hedges, counts them.
+struct SpeechUpload
+{
+    const char* data;
+    int length;
+    int references;
+    bool borrowed;          // the caller's, only valid during the call
+    char* heap;             // heapAccountingMalloc() block to free with it
+    void* mapping;          // file mapping to unmap with it
+    size_t mappingLength;
+};
+
+static SpeechUpload* newUpload(const char * data, int length)
+{
+    SpeechUpload* upload = new SpeechUpload();
+    if (upload == NULL) return NULL;
+    upload->data = data;
+    upload->length = length;
+    upload->references = 1;
+    upload->borrowed = true;
+    return upload;
+}
+
+static void releaseUpload(SpeechUpload * upload)
+{
+    if (upload == NULL || --upload->references > 0) return;
+    heapAccountingFree(upload->heap);
+#if defined(__linux__)
+    if (upload->mapping != NULL) munmap(upload->mapping, upload->mappingLength);
+#endif
+    delete upload;
+}
+
+// One of the two concurrent copies of a hedged request. It keeps its own
+// URL and token because the loser may still be running when
+// recognizeSpeech() returns.
+struct SpeechAttempt
+{
+    Thread* thread;
+    EventFlags* done;
+    uint32_t flag;
+    char* requestUri;
+    char* jwtToken;
+    const char* audio;
+    int length;
+    char* body;
+    int error;
+
+    void run()
+    {
+        body = sendAudio(requestUri, jwtToken, audio, length, &error, false);
+        done->set(flag);
+    }
+};
+
+// A hedged request. It lives until both attempts are done, which may be
+// well after the winner's response was returned, and holds on to the
+// upload they read until then.
+struct SpeechHedge
+{
+    SpeechAttempt attempts[2];
+    EventFlags done;
+    uint32_t started;
+    SpeechUpload* upload;
+    SpeechHedge* next;
+};
+
+static void freeHedge(SpeechHedge * hedge)
+{
+    if (hedge == NULL) return;
+    for (int i = 0; i < 2; i++)
+    {
+        SpeechAttempt* attempt = &hedge->attempts[i];
+        if (attempt->thread != NULL)
+        {
+            attempt->thread->join();
+            delete attempt->thread;
+        }
+        heapAccountingFree(attempt->requestUri);
+        heapAccountingFree(attempt->jwtToken);
+        free(attempt->body);
+    }
+    releaseUpload(hedge->upload);
+    delete hedge;
+}
+
+void SpeechInterface::setHedging(int percentile, uint32_t minDelayMs)
+{
+    _hedgePercentile = percentile;
+    _hedgeMinDelayMs = minDelayMs;
+}
+
+void SpeechInterface::setRetryPolicy(int maxRetries, uint32_t baseDelayMs, uint32_t maxDelayMs)
+{
+    _maxRetries = maxRetries;
+    _retryBaseMs = baseDelayMs;
+    _retryMaxMs = maxDelayMs;
+}
+
+void SpeechInterface::recordLatency(uint32_t latencyMs)
+{
+    _latencies[_latencyNext] = latencyMs;
+    _latencyNext = (_latencyNext + 1) % SPEECH_LATENCY_HISTORY;
+    if (_latencyCount < SPEECH_LATENCY_HISTORY) _latencyCount++;
+}
+
+uint32_t SpeechInterface::hedgeDelay()
+{
+    // Too little history to tell a slow request from a normal one
+    if (_hedgePercentile <= 0 || _latencyCount < SPEECH_LATENCY_HISTORY / 4) return 0;
+
+    uint32_t sorted[SPEECH_LATENCY_HISTORY];
+    for (int i = 0; i < _latencyCount; i++)
+    {
+        uint32_t latency = _latencies[i];
+        int j = i;
+        for (; j > 0 && sorted[j - 1] > latency; j--) sorted[j] = sorted[j - 1];
+        sorted[j] = latency;
+    }
+    int index = _latencyCount * _hedgePercentile / 100;
+    if (index >= _latencyCount) index = _latencyCount - 1;
+    return sorted[index] > _hedgeMinDelayMs ? sorted[index] : _hedgeMinDelayMs;
+}
+
+int SpeechInterface::startAttempt(SpeechHedge * hedge, int index, SpeechUpload * upload, const char * jwtToken)
+{
+    SpeechAttempt* attempt = &hedge->attempts[index];
+    attempt->done = &hedge->done;
+    attempt->flag = 1 << index;
+    attempt->requestUri = (char *)heapAccountingMalloc(strlen(_requestUri) + 1);
+    attempt->jwtToken = (char *)heapAccountingMalloc(strlen(jwtToken) + 1);
+    attempt->audio = upload->data;
+    attempt->length = upload->length;
+    attempt->body = NULL;
+    attempt->error = 0;
+    attempt->thread = NULL;
+    if (attempt->requestUri == NULL || attempt->jwtToken == NULL) return -1;
+    strcpy(attempt->requestUri, _requestUri);
+    strcpy(attempt->jwtToken, jwtToken);
+
+    attempt->thread = new Thread(osPriorityNormal, SPEECH_ATTEMPT_STACK_SIZE);
+    if (attempt->thread == NULL) return -1;
+    if (attempt->thread->start(callback(attempt, &SpeechAttempt::run)) != osOK)
+    {
+        delete attempt->thread;
+        attempt->thread = NULL;
+        return -1;
+    }
+    hedge->started |= attempt->flag;
+    return 0;
+}
+
+// Free the hedges whose attempts are all done; with wait, wait for the rest
+void SpeechInterface::reapHedges(bool wait)
+{
+    SpeechHedge** link = &_hedges;
+    while (*link != NULL)
+    {
+        SpeechHedge* hedge = *link;
+        if (!wait && (hedge->done.get() & hedge->started) != hedge->started)
+        {
+            link = &hedge->next;
+            continue;
+        }
+        *link = hedge->next;
+        _hedgeCount--;
+        freeHedge(hedge);
+    }
+}
+
+// Either attempt may still be sending when this returns, so the hedge
+// holds on to the upload; a caller's is copied into it first, once for
+// every retry of the call.
+char* SpeechInterface::sendHedged(SpeechUpload * upload, const char * jwtToken, uint32_t delayMs, int * error)
+{
+    reapHedges(false);
+
+    SpeechHedge* hedge = NULL;
+    if (_hedgeCount < SPEECH_HEDGES_IN_FLIGHT)
+    {
+        if (upload->borrowed)
+        {
+            char* copy = (char *)heapAccountingMalloc(upload->length);
+            if (copy != NULL)
+            {
+                memcpy(copy, upload->data, upload->length);
+                upload->data = upload->heap = copy;
+                upload->borrowed = false;
+            }
+        }
+        if (!upload->borrowed) hedge = new SpeechHedge();
+    }
+    if (hedge != NULL)
+    {
+        hedge->upload = upload;
+        upload->references++;
+    }
+    if (hedge == NULL || startAttempt(hedge, 0, upload, jwtToken) != 0)
+    {
+        freeHedge(hedge);
+        return sendAudio(_requestUri, jwtToken, upload->data, upload->length, error);
+    }
+
+    uint32_t finished = hedge->done.wait_any(1, delayMs, false);
+    if (finished & osFlagsError)
+    {
+        finished = 0;
+        if (startAttempt(hedge, 1, upload, jwtToken) == 0)
+        {
+            _stats.hedges++;
+            if (_debug) printf("No response after %u ms, hedging.\r\n", (unsigned)delayMs);
+        }
+    }
+
+    // First successful response wins; only give up once both have failed
+    char* body = NULL;
+    bool noMemory = false;
+    for (;;)
+    {
+        for (int i = 0; i < 2 && body == NULL; i++)
+        {
+            if ((finished & (1 << i)) && hedge->attempts[i].body != NULL)
+            {
+                // Copied so that it counts in this call's heap statistics
+                size_t bodyLength = strlen(hedge->attempts[i].body) + 1;
+                body = (char *)heapAccountingMalloc(bodyLength);
+                if (body == NULL)
+                {
+                    noMemory = true;
+                    break;
+                }
+                memcpy(body, hedge->attempts[i].body, bodyLength);
+                if (i == 1) _stats.hedgeWins++;
+            }
+        }
+        if (body != NULL || noMemory) break;
+        if (finished == hedge->started)
+        {
+            *error = hedge->attempts[0].error;
+            break;
+        }
+        finished |= hedge->done.wait_any(hedge->started & ~finished, osWaitForever, false) & hedge->started;
+    }
+
+    if ((hedge->done.get() & hedge->started) == hedge->started)
+    {
+        freeHedge(hedge);
+    }
+    else
+    {
+        hedge->next = _hedges;
+        _hedges = hedge;
+        _hedgeCount++;
+    }
+    return body;
+}
+
+uint32_t SpeechInterface::retryJitter(uint32_t boundMs)
+{
+    // xorshift32
+    _jitterState ^= _jitterState << 13;
+    _jitterState ^= _jitterState >> 17;
+    _jitterState ^= _jitterState << 5;
+    return boundMs > 0 ? _jitterState % (boundMs + 1) : 0;
+}
+
+char* SpeechInterface::postAudio(SpeechUpload * upload, const char * jwtToken, uint32_t * elapsedMs)
+{
+    for (int retry = 0; ; retry++)
+    {
+        uint32_t delayMs = hedgeDelay();
+        int error = 0;
+        Timer requestTimer;
+        requestTimer.start();
+        char* body = delayMs > 0 ? sendHedged(upload, jwtToken, delayMs, &error)
+                                 : sendAudio(_requestUri, jwtToken, upload->data, upload->length, &error);
+        requestTimer.stop();
+
+        if (body != NULL)
+        {
+            *elapsedMs = requestTimer.read_ms() > 0 ? requestTimer.read_ms() : 1;
+            _stats.hedgeDelayMs = delayMs;
+            recordLatency(*elapsedMs);
+            return body;
+        }
+        if (_debug) printf("Speech API request failed (error code %d).\r\n", error);
+        if (retry >= _maxRetries) return NULL;
+
+        // Full jitter: a random wait up to the exponential bound keeps
+        // devices that lost the link together from retrying in lockstep
+        uint32_t boundMs = _retryBaseMs << (retry < 16 ? retry : 16);
+        if (boundMs > _retryMaxMs || boundMs < _retryBaseMs) boundMs = _retryMaxMs;
+        uint32_t waitMs = retryJitter(boundMs);
+        _stats.retries++;
+        if (_debug) printf("Retrying in %u ms.\r\n", (unsigned)waitMs);
+        wait_ms(waitMs);
+    }
+}
+
 SpeechResponse* SpeechInterface::recognizeSpeech(char * audioFileBinary, int length)
 {
+    return recognizeSpeech(audioFileBinary, length, NULL, NULL);
+}
+
+SpeechResponse* SpeechInterface::recognizeSpeech(char * audioFileBinary, int length, SpeechResultCallback callback, void * context)
+{
+    SpeechUpload* upload = newUpload(audioFileBinary, length);
+    if (upload == NULL) return NULL;
+    SpeechResponse* speechResponse = recognizeUpload(upload, callback, context);
+    releaseUpload(upload);
+    return speechResponse;
+}
+
+SpeechResponse* SpeechInterface::recognizeUpload(SpeechUpload * upload, SpeechResultCallback callback, void * context)
+{
+    // Phases that return early are closed together with the call
+    memset(&_heapStats, 0, sizeof(_heapStats));
+    int callMark = heapUsageBegin();
+    SpeechResponse* speechResponse = recognize(upload, callback, context);
+    heapUsageEnd(callMark, &_heapStats.call);
+
+    if (_debug) printf("Heap: %u bytes in %u allocations, peak %u (auth %u, upload %u, parse %u)\r\n",
+                       (unsigned)_heapStats.call.bytesAllocated, (unsigned)_heapStats.call.allocations,
+                       (unsigned)_heapStats.call.peakBytes, (unsigned)_heapStats.auth.peakBytes,
+                       (unsigned)_heapStats.upload.peakBytes, (unsigned)_heapStats.parse.peakBytes);
+    return speechResponse;
+}
+
+SpeechResponse* SpeechInterface::recognize(SpeechUpload * upload, SpeechResultCallback callback, void * context)
+{
+    int length = upload->length;
     if (_debug) printf("file length : %d\r\n", length);
+    int phaseMark = heapUsageBegin();
 
     // Generate a new guid for cognitive service API request
     char* guid = generateGuidStr();
 
     // Generate a JWT token for cognitove service authentication
-    char* jwtToken = getJwtToken();
+    char* jwtToken = _batchToken ? _batchToken : getJwtToken();
+    if (guid == NULL || jwtToken == NULL)
+    {
+        // Offline: nothing to send the request with
+        heapUsageEnd(phaseMark, &_heapStats.auth);
+        heapAccountingFree(guid);
+        if (jwtToken != NULL) releaseJwtToken(jwtToken);
+        return NULL;
+    }
     
     // Preapre Speech Recognition API request URL
     sprintf(_requestUri, SPEECH_RECOGNITION_API_REQUEST_URL, _deviceId, guid);
     if (_debug) printf("recognizeSpeech request URL: %s\r\n", _requestUri);
+    heapUsageEnd(phaseMark, &_heapStats.auth);
 
-    HTTPClient speechRequest = HTTPClient(HTTP_POST, (const char*)_requestUri);
-    speechRequest.set_header("Content-Type", "plain/text");
-    speechRequest.set_header("Authorization", jwtToken);
-    
-    const Http_Response* _response = speechRequest.send(audioFileBinary, length);
-    if (!_response)
+    // The audio is never transcoded in place, it may be a read-only mapping
+    phaseMark = heapUsageBegin();
+    char* encoded = transcodeForUpload(upload->data, &length);
+    SpeechUpload* sent = encoded ? newUpload(encoded, length) : upload;
+    if (sent == NULL)
+    {
+        heapAccountingFree(encoded);
+        sent = upload;
+        length = upload->length;
+    }
+    else if (sent != upload)
     {
-        if (_debug) printf("Speech API request failed (error code %d).\r\n", speechRequest.get_error());
+        sent->heap = encoded;
+        sent->borrowed = false;
+    }
+
+    uint32_t elapsedMs;
+    char* bodyStr = postAudio(sent, jwtToken, &elapsedMs);
+    if (sent != upload) releaseUpload(sent);
+    heapUsageEnd(phaseMark, &_heapStats.upload);
+    if (bodyStr == NULL)
+    {
+        heapAccountingFree(guid);
+        releaseJwtToken(jwtToken);
         return NULL;
     }
-    char* bodyStr = (char*)malloc(strlen(_response->body) + 1);
-    strcpy(bodyStr, _response->body);
+
+    // The client does not report when the body went out, so the round trip
+    // stands in for the upload time. Smooth it so a single slow response
+    // does not flip the codec back and forth.
+    uint32_t throughputBps = (uint32_t)((uint64_t)length * 1000 / elapsedMs);
+    _stats.throughputBps = _stats.throughputBps == 0 ? throughputBps
+                         : _stats.throughputBps - _stats.throughputBps / 4 + throughputBps / 4;
+    _stats.lastUploadBytes = length;
+    _stats.lastUploadMs = elapsedMs;
+    _stats.requests++;
+    if (_debug) printf("Uploaded %d bytes in %u ms\r\n", length, (unsigned)elapsedMs);
     if (_debug) printf("congnitive result: %s\r\n", bodyStr);
     
     SpeechResponse *speechResponse = new SpeechResponse();
@@ -98,40 +629,130 @@ SpeechResponse* SpeechInterface::recognizeSpeech(char * audioFileBinary, int len
         if (_debug) printf("SpeechResponse is null \r\n");
         return NULL;
     }
-    // Parse Jso n result to SpeechResponse object
-    struct json_object *responseObj, *subObj, *valueObj, *bestResult;
+    // Parse Json result to SpeechResponse object, reporting each result
+    // element to the callback as soon as it is complete
+    phaseMark = heapUsageBegin();
 
-    responseObj = json_tokener_parse(bodyStr);
-    if (_debug) printf("JSON object from response:\n%s\n", json_object_to_json_string_ext(responseObj, JSON_C_TO_STRING_SPACED | JSON_C_TO_STRING_PRETTY));
+    // The previous response goes, its strings were only valid until now
+    _parser->reset(callback, context);
+    if (_responseArena) json_c_arena_reset(_responseArena);
+    int bodyLen = strlen(bodyStr);
+    int offset = 0;
+    int parsed = 0;
+    while (parsed == 0 && offset < bodyLen)
+    {
+        int chunkLen = bodyLen - offset < RESPONSE_CHUNK_SIZE ? bodyLen - offset : RESPONSE_CHUNK_SIZE;
+        parsed = _parser->feed(bodyStr + offset, chunkLen);
+        offset += chunkLen;
+    }
+    if (parsed != 1)
+    {
+        if (_debug) printf("Speech API response is not valid JSON.\r\n");
+        heapAccountingFree(guid);
+        releaseJwtToken(jwtToken);
+        heapAccountingFree(bodyStr);
+        delete speechResponse;
+        return NULL;
+    }
+    // The tree without a callback, the events with one
+    _parser->getResponse(speechResponse);
+    if (_debug && speechResponse->status != NULL && strcmp(speechResponse->status, "error") == 0) printf("Audio recognize failed.");
+    heapUsageEnd(phaseMark, &_heapStats.parse);
 
-     // parse status value from header->status
-    json_object_object_get_ex(responseObj, "header", &subObj);
-    json_object_object_get_ex(subObj, "status", &valueObj);
-    speechResponse->status =  (char *)json_object_get_string(valueObj);
+    heapAccountingFree(guid);
+    releaseJwtToken(jwtToken);
+    heapAccountingFree(bodyStr);
+    return speechResponse;
+}
+
+SpeechResponse* SpeechInterface::recognizeSpeechFromFile(const char * path, SpeechResultCallback callback, void * context)
+{
+    char* audio;
+    uint32_t fileLength;
 
-    if (strcmp(speechResponse->status, "error") == 0)
+#if defined(__linux__)
+    // Map the clip instead of reading it: the pages are faulted in while the
+    // request body is written to the socket and dropped again afterwards, so
+    // no heap copy of the audio is ever made.
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
     {
-        if (_debug) printf("Audio recognize failed.");
-        
+        if (_debug) printf("Cannot open audio file %s.\r\n", path);
+        return NULL;
     }
-    else
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0 || fileStat.st_size > INT_MAX)
+    {
+        if (_debug) printf("Audio file %s has no usable size.\r\n", path);
+        close(fd);
+        return NULL;
+    }
+    fileLength = (uint32_t)fileStat.st_size;
+    audio = (char *)mmap(NULL, fileLength, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (audio == MAP_FAILED)
     {
-        // parse status value from header->lexical
-        json_object_object_get_ex(subObj, "lexical", &valueObj);
-        speechResponse->text =  (char *)json_object_get_string(valueObj);
+        if (_debug) printf("Cannot map audio file %s.\r\n", path);
+        return NULL;
+    }
+    madvise(audio, fileLength, MADV_SEQUENTIAL);
 
-        // parse confidence value from results[0]->confidence
-        json_object_object_get_ex(responseObj, "results", &subObj);
-        array_list * array = json_object_get_array(valueObj);
-        bestResult = json_object_array_get_idx(subObj, 0);
-        json_object_object_get_ex(bestResult, "confidence", &valueObj);
+    // Hedges share the mapping instead of copying it, the last one unmaps it
+    SpeechUpload* upload = newUpload(audio, fileLength);
+    if (upload == NULL)
+    {
+        munmap(audio, fileLength);
+        return NULL;
+    }
+    upload->mapping = audio;
+    upload->mappingLength = fileLength;
+    upload->borrowed = false;
+#else
+    // No virtual memory on the MCU targets, read the clip into the heap
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        if (_debug) printf("Cannot open audio file %s.\r\n", path);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    audio = size > 0 ? (char *)heapAccountingMalloc(size) : NULL;
+    if (audio == NULL || fread(audio, 1, size, file) != (size_t)size)
+    {
+        if (_debug) printf("Cannot read audio file %s.\r\n", path);
+        heapAccountingFree(audio);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    fileLength = (uint32_t)size;
 
-        speechResponse->confidence = (double)json_object_get_double(valueObj);
+    SpeechUpload* upload = newUpload(audio, fileLength);
+    if (upload == NULL)
+    {
+        heapAccountingFree(audio);
+        return NULL;
     }
+    upload->heap = audio;
+    upload->borrowed = false;
+#endif
 
-    free(guid);
-    free(jwtToken);
-    free(bodyStr);
+    SpeechResponse* speechResponse = NULL;
+    WavInfo wavInfo;
+    if (parseWavHeader(audio, fileLength, &wavInfo) != 0)
+    {
+        if (_debug) printf("%s is not a WAVE file.\r\n", path);
+    }
+    else
+    {
+        if (_debug) printf("%s: %u Hz, %u bit, %u channel(s), %u data bytes\r\n", path,
+                           (unsigned)wavInfo.sampleRate, wavInfo.bitsPerSample, wavInfo.channels, (unsigned)wavInfo.dataLength);
+        upload->length = wavInfo.fileLength;
+        speechResponse = recognizeUpload(upload, callback, context);
+    }
+    releaseUpload(upload);
     return speechResponse;
 }
 
@@ -2,6 +2,8 @@
 #define __SPEECH_INTERFACE_OS5_H__
 
 #include "mbed.h"
+#include "AudioCodec.h"
+#include "HeapAccounting.h"
 
 typedef struct
 {
@@ -10,7 +12,46 @@ typedef struct
     double confidence;
 }SpeechResponse;
 
+// Called for every element of the recognition "results" array as soon as it
+// has been parsed, before the rest of the response body is consumed.
+typedef void (*SpeechResultCallback)(const SpeechResponse * partial, int index, void * context);
 
+typedef struct
+{
+    uint32_t requests;
+    uint32_t lastUploadBytes;
+    uint32_t lastUploadMs;      // request send until the response arrived
+    uint32_t throughputBps;     // smoothed upload throughput, bytes per second
+    AudioCodec codec;           // format of the last upload
+    uint32_t sampleRate;
+    uint32_t retries;           // attempts repeated after a failed request
+    uint32_t hedges;            // duplicate requests sent for a slow one
+    uint32_t hedgeWins;         // duplicates that answered first
+    uint32_t hedgeDelayMs;      // wait before hedging the last request, 0 if off
+}SpeechStats;
+
+// Heap used by the last recognizeSpeech() call and its phases: auth (guid
+// and token), upload (transcoding and the request) and parse (the json-c
+// tree). json-c is only included after heapAccountingInstallJsonC().
+typedef struct
+{
+    HeapUsage call;
+    HeapUsage auth;
+    HeapUsage upload;
+    HeapUsage parse;
+}SpeechHeapStats;
+
+// Recent request latencies kept for the hedging percentile
+#define SPEECH_LATENCY_HISTORY 32
+
+struct SpeechHedge;
+struct SpeechUpload;
+struct json_c_arena;
+class SpeechResultParser;
+
+// The status and text of a SpeechResponse point into the parsed response,
+// which stays valid until the next recognizeSpeech() call on the same
+// interface.
 class SpeechInterface
 {
     public:
@@ -18,17 +59,79 @@ class SpeechInterface
         virtual ~SpeechInterface(void);
 
         SpeechResponse* recognizeSpeech(char * audioFileBinary, int length);
+        SpeechResponse* recognizeSpeech(char * audioFileBinary, int length, SpeechResultCallback callback, void * context = NULL);
+        SpeechResponse* recognizeSpeechFromFile(const char * path, SpeechResultCallback callback = NULL, void * context = NULL);
         int convertTextToSpeech(char * text, int length, char * audioFileBinary, int audioLen); 
 
+        // Transcode 16 bit mono uploads to the richest format that is
+        // expected to upload within targetMs at the measured throughput.
+        // 0 sends the audio unchanged.
+        void setUploadTarget(uint32_t targetMs);
+        void getStats(SpeechStats * stats);
+
+        // Requests between beginBatch() and endBatch() share one JWT token
+        // instead of fetching a new one each. Returns false if no token
+        // could be fetched, i.e. the service is still unreachable.
+        bool beginBatch();
+        void endBatch();
+
+        // Send a second copy of a request that has not been answered after
+        // the given percentile of recent latencies (but at least minDelayMs)
+        // and use whichever response arrives first. 0 turns hedging off.
+        // The slower copy keeps sending after recognizeSpeech() returned.
+        // Audio passed to recognizeSpeech() and uploaded as it is (no
+        // setUploadTarget(), or PCM16 chosen) is copied first because the
+        // caller may free it, so a hedged call holds the upload twice; a
+        // request whose copy does not fit is sent without hedging. The
+        // transcoded upload and the clip of recognizeSpeechFromFile() are
+        // shared with the slower copy instead.
+        void setHedging(int percentile, uint32_t minDelayMs = 0);
+
+        // Repeat requests that failed outright up to maxRetries times, after
+        // a random wait of up to baseDelayMs * 2^retry, capped at maxDelayMs
+        void setRetryPolicy(int maxRetries, uint32_t baseDelayMs, uint32_t maxDelayMs);
+
+        void getHeapStats(SpeechHeapStats * stats);
+
     private:
         char* generateGuidStr();
         char* getJwtToken();
+        SpeechResponse* recognizeUpload(SpeechUpload * upload, SpeechResultCallback callback, void * context);
+        SpeechResponse* recognize(SpeechUpload * upload, SpeechResultCallback callback, void * context);
+        char* transcodeForUpload(const char * audioFileBinary, int * length);
+        void releaseJwtToken(char * token);
+        char* postAudio(SpeechUpload * upload, const char * jwtToken, uint32_t * elapsedMs);
+        char* sendHedged(SpeechUpload * upload, const char * jwtToken, uint32_t delayMs, int * error);
+        int startAttempt(SpeechHedge * hedge, int index, SpeechUpload * upload, const char * jwtToken);
+        void reapHedges(bool wait);
+        void recordLatency(uint32_t latencyMs);
+        uint32_t hedgeDelay();
+        uint32_t retryJitter(uint32_t boundMs);
 
         char* _cognitiveSubKey;
         char* _deviceId;
 
         char * _requestUri;
+        char * _batchToken;
         bool _debug;
+
+        uint32_t _uploadTargetMs;
+        SpeechStats _stats;
+        SpeechHeapStats _heapStats;
+        struct json_c_arena* _responseArena;
+        SpeechResultParser* _parser;    // keeps the last response's strings
+
+        SpeechHedge* _hedges;       // hedged requests whose slower copy is still sending
+        int _hedgeCount;
+        uint32_t _latencies[SPEECH_LATENCY_HISTORY];
+        int _latencyCount;
+        int _latencyNext;
+        int _hedgePercentile;
+        uint32_t _hedgeMinDelayMs;
+        int _maxRetries;
+        uint32_t _retryBaseMs;
+        uint32_t _retryMaxMs;
+        uint32_t _jitterState;      // per device, so devices do not retry in lockstep
 };
 
 #endif
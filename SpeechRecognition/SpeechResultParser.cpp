@@ -0,0 +1,263 @@
+#include "SpeechResultParser.h"
+#include <json.h>
+#include <stdlib.h>
+
+const struct json_tokener_events SpeechResultParser::_responseEvents = {
+    SpeechResultParser::onObjectStart,
+    SpeechResultParser::onObjectEnd,
+    SpeechResultParser::onArrayStart,
+    SpeechResultParser::onArrayEnd,
+    SpeechResultParser::onKey,
+    SpeechResultParser::onString,
+    SpeechResultParser::onInt64,
+    SpeechResultParser::onDouble,
+    NULL,
+    NULL
+};
+
+SpeechResultParser::SpeechResultParser(bool debug, struct json_c_arena * arena)
+{
+    _tokener = json_tokener_new();
+    if (_tokener && arena) json_tokener_set_allocator(_tokener, json_c_arena_allocator(arena));
+    _result = NULL;
+    _debug = debug;
+    _status = NULL;
+    _statusCapacity = 0;
+    _text = NULL;
+    _textCapacity = 0;
+    _lexical = NULL;
+    _lexicalCapacity = 0;
+    reset();
+}
+
+SpeechResultParser::~SpeechResultParser(void)
+{
+    json_object_put(_result);
+    if (_tokener) json_tokener_free(_tokener);
+    heapAccountingFree(_status);
+    heapAccountingFree(_text);
+    heapAccountingFree(_lexical);
+}
+
+void SpeechResultParser::reset(SpeechResultCallback callback, void * context)
+{
+    json_object_put(_result);
+    _result = NULL;
+    _done = false;
+    _callback = callback;
+    _context = context;
+    _reported = 0;
+    if (_tokener)
+    {
+        json_tokener_reset(_tokener);
+        json_tokener_set_events(_tokener, callback ? &_responseEvents : NULL, this);
+    }
+    _depth = 0;
+    _hasStatus = false;
+    _hasText = false;
+    _confidence = 0;
+    _hasLexical = false;
+    _bestConfidence = 0;
+}
+
+int SpeechResultParser::feed(const char * chunk, int length)
+{
+    if (_tokener == NULL || _done) return -1;
+
+    // With the events nothing is built and obj stays NULL
+    json_object* obj = json_tokener_parse_ex(_tokener, chunk, length);
+    enum json_tokener_error jerr = json_tokener_get_error(_tokener);
+    if (jerr == json_tokener_continue) return 0;
+    if (jerr != json_tokener_success)
+    {
+        if (_debug) printf("Speech result parse failed: %s\r\n", json_tokener_error_desc(jerr));
+        return -1;
+    }
+
+    _result = obj;
+    _done = true;
+    return 1;
+}
+
+void SpeechResultParser::getResponse(SpeechResponse * response)
+{
+    if (_callback)
+    {
+        response->status = _hasStatus ? _status : NULL;
+        if (response->status == NULL || strcmp(response->status, "error") != 0)
+        {
+            response->text = _hasLexical ? _lexical : NULL;
+            response->confidence = _bestConfidence;
+        }
+        return;
+    }
+
+    if (_debug) printf("JSON object from response:\n%s\n", json_object_to_json_string_ext(_result, JSON_C_TO_STRING_SPACED | JSON_C_TO_STRING_PRETTY));
+    struct json_object *header = NULL, *value = NULL, *results = NULL;
+
+    // parse status value from header->status
+    json_object_object_get_ex(_result, "header", &header);
+    json_object_object_get_ex(header, "status", &value);
+    response->status = (char *)json_object_get_string(value);
+    if (response->status != NULL && strcmp(response->status, "error") == 0) return;
+
+    // parse text value from header->lexical
+    value = NULL;
+    json_object_object_get_ex(header, "lexical", &value);
+    response->text = (char *)json_object_get_string(value);
+
+    // parse confidence value from results[0]->confidence
+    value = NULL;
+    if (json_object_object_get_ex(_result, "results", &results) && json_object_is_type(results, json_type_array))
+        json_object_object_get_ex(json_object_array_get_idx(results, 0), "confidence", &value);
+    response->confidence = json_object_get_double(value);
+}
+
+struct json_object* SpeechResultParser::takeResult()
+{
+    struct json_object* result = _result;
+    _result = NULL;
+    return result;
+}
+
+// The root is depth 1, header and the results array depth 2 and each
+// result element depth 3
+bool SpeechResultParser::inHeader() const
+{
+    return _depth == 2 && !_isArray[1] && _field[1] == FIELD_HEADER && !_isArray[2];
+}
+
+bool SpeechResultParser::inResult() const
+{
+    return _depth == 3 && !_isArray[1] && _field[1] == FIELD_RESULTS && _isArray[2] && !_isArray[3];
+}
+
+void SpeechResultParser::enter(bool isArray)
+{
+    _depth++;
+    if (_depth > TRACKED_DEPTH) return;
+    _isArray[_depth] = isArray;
+    _field[_depth] = FIELD_OTHER;
+    if (inResult())
+    {
+        _hasText = false;
+        _confidence = 0;
+    }
+}
+
+int SpeechResultParser::onObjectStart(void * userdata)
+{
+    ((SpeechResultParser *)userdata)->enter(false);
+    return 0;
+}
+
+int SpeechResultParser::onArrayStart(void * userdata)
+{
+    ((SpeechResultParser *)userdata)->enter(true);
+    return 0;
+}
+
+int SpeechResultParser::onObjectEnd(void * userdata)
+{
+    SpeechResultParser *parser = (SpeechResultParser *)userdata;
+    if (parser->inResult()) parser->reportResult();
+    parser->_depth--;
+    return 0;
+}
+
+int SpeechResultParser::onArrayEnd(void * userdata)
+{
+    ((SpeechResultParser *)userdata)->_depth--;
+    return 0;
+}
+
+static bool keyIs(const char * key, size_t len, const char * name)
+{
+    return len == strlen(name) && memcmp(key, name, len) == 0;
+}
+
+int SpeechResultParser::onKey(void * userdata, const char * key, size_t len)
+{
+    SpeechResultParser *parser = (SpeechResultParser *)userdata;
+    if (parser->_depth > TRACKED_DEPTH) return 0;
+
+    Field field = FIELD_OTHER;
+    if (keyIs(key, len, "header")) field = FIELD_HEADER;
+    else if (keyIs(key, len, "results")) field = FIELD_RESULTS;
+    else if (keyIs(key, len, "status")) field = FIELD_STATUS;
+    else if (keyIs(key, len, "lexical")) field = FIELD_LEXICAL;
+    else if (keyIs(key, len, "confidence")) field = FIELD_CONFIDENCE;
+    parser->_field[parser->_depth] = field;
+    return 0;
+}
+
+bool SpeechResultParser::copyText(char ** buffer, int * capacity, const char * str, size_t len)
+{
+    if ((int)len >= *capacity)
+    {
+        char *grown = (char *)heapAccountingRealloc(*buffer, len + 1);
+        if (grown == NULL) return false;
+        *buffer = grown;
+        *capacity = len + 1;
+    }
+    memcpy(*buffer, str, len);
+    (*buffer)[len] = '\0';
+    return true;
+}
+
+int SpeechResultParser::onString(void * userdata, const char * str, size_t len)
+{
+    SpeechResultParser *parser = (SpeechResultParser *)userdata;
+    if (parser->inHeader() && parser->_field[2] == FIELD_STATUS)
+    {
+        if (!parser->copyText(&parser->_status, &parser->_statusCapacity, str, len)) return -1;
+        parser->_hasStatus = true;
+    }
+    else if (parser->inHeader() && parser->_field[2] == FIELD_LEXICAL)
+    {
+        if (!parser->copyText(&parser->_lexical, &parser->_lexicalCapacity, str, len)) return -1;
+        parser->_hasLexical = true;
+    }
+    else if (parser->inResult() && parser->_field[3] == FIELD_LEXICAL)
+    {
+        if (!parser->copyText(&parser->_text, &parser->_textCapacity, str, len)) return -1;
+        parser->_hasText = true;
+    }
+    else if (parser->inResult() && parser->_field[3] == FIELD_CONFIDENCE)
+    {
+        // The service sends the confidence as a string
+        char number[32];
+        if (len >= sizeof(number)) len = sizeof(number) - 1;
+        memcpy(number, str, len);
+        number[len] = '\0';
+        parser->_confidence = strtod(number, NULL);
+    }
+    return 0;
+}
+
+int SpeechResultParser::onInt64(void * userdata, int64_t value)
+{
+    SpeechResultParser *parser = (SpeechResultParser *)userdata;
+    if (parser->inResult() && parser->_field[3] == FIELD_CONFIDENCE) parser->_confidence = (double)value;
+    return 0;
+}
+
+int SpeechResultParser::onDouble(void * userdata, double value, const char * text, size_t len)
+{
+    SpeechResultParser *parser = (SpeechResultParser *)userdata;
+    if (parser->inResult() && parser->_field[3] == FIELD_CONFIDENCE) parser->_confidence = value;
+    return 0;
+}
+
+void SpeechResultParser::reportResult()
+{
+    SpeechResponse partial;
+    partial.status = _hasStatus ? _status : (char *)"";
+    partial.text = _hasText ? _text : NULL;
+    partial.confidence = _confidence;
+
+    if (_reported == 0) _bestConfidence = _confidence;
+    if (_debug) printf("partial result %d: %s (%f)\r\n", _reported, partial.text ? partial.text : "(no text)", partial.confidence);
+    _callback(&partial, _reported, _context);
+    _reported++;
+}
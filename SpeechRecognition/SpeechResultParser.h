@@ -0,0 +1,95 @@
+#ifndef __SPEECH_RESULT_PARSER_H__
+#define __SPEECH_RESULT_PARSER_H__
+
+#include "SpeechInterface.h"
+
+struct json_object;
+struct json_tokener;
+struct json_c_arena;
+struct json_tokener_events;
+
+// Incremental parser for the recognition response body.
+// The body can be fed in arbitrary chunks as it arrives from the network.
+//
+// The body goes through a single tokener. With a callback it follows the
+// body through json-c's event callbacks and builds no tree: each element
+// of the "results" array is reported as soon as it has been read, before
+// the rest of the body is, and header.status, header.lexical and the
+// confidence of the first result are kept for the final response. The
+// status of a partial result is empty as long as header.status has not
+// been read. Without a callback the tokener builds the tree that
+// takeResult() returns and the response is read from it.
+//
+// With an arena the whole response tree is placed in it and released by
+// resetting the arena instead of being freed object by object.
+class SpeechResultParser
+{
+    public:
+        SpeechResultParser(bool debug = false, struct json_c_arena * arena = NULL);
+        virtual ~SpeechResultParser(void);
+
+        // Starts a new response, reported to callback if it is not NULL.
+        // Must come before the arena is reset, the tokener may still hold
+        // objects from it.
+        void reset(SpeechResultCallback callback = NULL, void * context = NULL);
+
+        // Returns 1 when the whole response has been parsed, 0 if more data
+        // is needed and -1 on a parse error.
+        int feed(const char * chunk, int length);
+
+        // Status, text and confidence of the whole response once feed()
+        // returned 1. The strings point into the parser or into the tree
+        // and stay valid until the next reset(). The text is left alone if
+        // the status is "error".
+        void getResponse(SpeechResponse * response);
+
+        // Parsed response tree, owned by the caller once feed() returned 1,
+        // or by the arena. Only built without a callback.
+        struct json_object* takeResult();
+
+    private:
+        // Where the value the tokener is reading sits in the response
+        enum Field { FIELD_OTHER, FIELD_HEADER, FIELD_RESULTS, FIELD_STATUS, FIELD_LEXICAL, FIELD_CONFIDENCE };
+        enum { TRACKED_DEPTH = 3 };
+
+        static const struct json_tokener_events _responseEvents;
+        static int onObjectStart(void * userdata);
+        static int onObjectEnd(void * userdata);
+        static int onArrayStart(void * userdata);
+        static int onArrayEnd(void * userdata);
+        static int onKey(void * userdata, const char * key, size_t len);
+        static int onString(void * userdata, const char * str, size_t len);
+        static int onInt64(void * userdata, int64_t value);
+        static int onDouble(void * userdata, double value, const char * text, size_t len);
+
+        void enter(bool isArray);
+        bool inHeader() const;
+        bool inResult() const;
+        bool copyText(char ** buffer, int * capacity, const char * str, size_t len);
+        void reportResult();
+
+        struct json_tokener* _tokener;
+        struct json_object* _result;
+        bool _done;
+        SpeechResultCallback _callback;
+        void * _context;
+        int _reported;
+        bool _debug;
+
+        int _depth;                             // containers open
+        bool _isArray[TRACKED_DEPTH + 1];       // by depth, 1 is the root
+        Field _field[TRACKED_DEPTH + 1];        // last key read at each object depth
+        char * _status;
+        int _statusCapacity;
+        bool _hasStatus;
+        char * _text;
+        int _textCapacity;
+        bool _hasText;
+        double _confidence;
+        char * _lexical;                        // header.lexical
+        int _lexicalCapacity;
+        bool _hasLexical;
+        double _bestConfidence;                 // of the first result
+};
+
+#endif
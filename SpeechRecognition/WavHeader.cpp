@@ -0,0 +1,93 @@
+#include "WavHeader.h"
+#include <string.h>
+
+static uint16_t readLe16(const unsigned char * p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t readLe32(const unsigned char * p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void writeLe16(unsigned char * p, uint16_t value)
+{
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+}
+
+static void writeLe32(unsigned char * p, uint32_t value)
+{
+    writeLe16(p, (uint16_t)value);
+    writeLe16(p + 2, (uint16_t)(value >> 16));
+}
+
+int parseWavHeader(const char * data, uint32_t length, WavInfo * info)
+{
+    const unsigned char * p = (const unsigned char *)data;
+    bool haveFormat = false;
+
+    if (length < 12 || memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0)
+        return -1;
+
+    memset(info, 0, sizeof(WavInfo));
+    info->fileLength = readLe32(p + 4) + 8;
+    if (info->fileLength > length || info->fileLength < 12)
+        info->fileLength = length;
+
+    // Walk the chunk list until the sample data; chunks are word aligned
+    uint32_t offset = 12;
+    while (offset + 8 <= info->fileLength)
+    {
+        uint32_t chunkLength = readLe32(p + offset + 4);
+        const unsigned char * chunk = p + offset + 8;
+
+        if (memcmp(p + offset, "fmt ", 4) == 0)
+        {
+            if (chunkLength < 16 || offset + 8 + 16 > info->fileLength)
+                return -1;
+            info->formatTag = readLe16(chunk);
+            info->channels = readLe16(chunk + 2);
+            info->sampleRate = readLe32(chunk + 4);
+            info->blockAlign = readLe16(chunk + 12);
+            info->bitsPerSample = readLe16(chunk + 14);
+            haveFormat = true;
+        }
+        else if (memcmp(p + offset, "data", 4) == 0)
+        {
+            if (!haveFormat)
+                return -1;
+            info->dataOffset = offset + 8;
+            info->dataLength = chunkLength;
+            if (info->dataLength > info->fileLength - info->dataOffset)
+                info->dataLength = info->fileLength - info->dataOffset;
+            return 0;
+        }
+
+        if (chunkLength > info->fileLength - offset - 8)
+            break;
+        offset += 8 + chunkLength + (chunkLength & 1);
+    }
+    return -1;
+}
+
+int writeWavHeader(char * dest, uint32_t sampleRate, uint16_t bitsPerSample, uint16_t channels, uint32_t dataLength)
+{
+    unsigned char * p = (unsigned char *)dest;
+    uint16_t blockAlign = channels * ((bitsPerSample + 7) / 8);
+
+    memcpy(p, "RIFF", 4);
+    writeLe32(p + 4, WAV_HEADER_LENGTH - 8 + dataLength);
+    memcpy(p + 8, "WAVEfmt ", 8);
+    writeLe32(p + 16, 16);
+    writeLe16(p + 20, WAV_FORMAT_PCM);
+    writeLe16(p + 22, channels);
+    writeLe32(p + 24, sampleRate);
+    writeLe32(p + 28, sampleRate * blockAlign);
+    writeLe16(p + 32, blockAlign);
+    writeLe16(p + 34, bitsPerSample);
+    memcpy(p + 36, "data", 4);
+    writeLe32(p + 40, dataLength);
+    return WAV_HEADER_LENGTH;
+}
@@ -0,0 +1,32 @@
+#ifndef __WAV_HEADER_H__
+#define __WAV_HEADER_H__
+
+#include <stdint.h>
+
+#define WAV_FORMAT_PCM          0x0001
+#define WAV_FORMAT_MULAW        0x0007
+#define WAV_FORMAT_IMA_ADPCM    0x0011
+
+typedef struct
+{
+    uint16_t formatTag;
+    uint16_t channels;
+    uint32_t sampleRate;
+    uint16_t blockAlign;
+    uint16_t bitsPerSample;
+    uint32_t dataOffset;    // offset of the first sample from the start of the file
+    uint32_t dataLength;    // bytes of sample data, clipped to the buffer
+    uint32_t fileLength;    // bytes of the RIFF file, clipped to the buffer
+}WavInfo;
+
+#define WAV_HEADER_LENGTH   44
+
+// Parse the RIFF/WAVE header at the start of data without copying it.
+// Returns 0 on success, -1 if data does not hold a usable WAVE file.
+int parseWavHeader(const char * data, uint32_t length, WavInfo * info);
+
+// Write a canonical 44 byte header for uncompressed PCM data to dest.
+// Returns the number of bytes written.
+int writeWavHeader(char * dest, uint32_t sampleRate, uint16_t bitsPerSample, uint16_t channels, uint32_t dataLength);
+
+#endif
@@ -0,0 +1,176 @@
+// Checks json_parse_double() bit for bit against strtod() on random
+// numbers, then times it against strtod() and sscanf("%lf"), as it used to
+// work, and parsing an array of telemetry readings.
+//
+// This is a program of its own: build it as the main file of an mbed
+// application that includes the SpeechRecognition library. The .mbedignore
+// next to it keeps it out of the library build. It takes about 80 kB of
+// heap; lower NUMBER_COUNT on smaller targets. printf and sscanf need
+// floating point support, which minimal printf leaves out by default.
+//
+// The check is only as good as the C library's strtod(), which has to be
+// correctly rounded itself; glibc's and newlib's are.
+
+#include "mbed.h"
+#include <json.h>
+
+#define CHECK_COUNT     200000
+#define NUMBER_COUNT    2000
+#define NUMBER_SIZE     32
+#define PARSE_ROUNDS    20
+
+static uint32_t seed = 12345;
+
+static uint32_t nextRandom()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static double randomDouble()
+{
+    uint64_t bits;
+    double value;
+    do
+    {
+        bits = ((uint64_t)nextRandom() << 40) ^ ((uint64_t)nextRandom() << 20) ^ nextRandom();
+        memcpy(&value, &bits, sizeof(value));
+    }
+    while (value != value || value - value != 0);   // no NaN or infinity
+    return value;
+}
+
+// Round trips, short forms that need rounding, long mantissas past what
+// the fast path can take, subnormals and values close to the limits
+static void makeCheckNumber(char* text)
+{
+    switch (nextRandom() % 5)
+    {
+    case 0:
+        sprintf(text, "%.17g", randomDouble());
+        break;
+    case 1:
+        sprintf(text, "%.*g", 1 + (int)(nextRandom() % 16), randomDouble());
+        break;
+    case 2:
+    {
+        int digits = 1 + nextRandom() % 30;
+        char* p = text;
+        if (nextRandom() & 1) *p++ = '-';
+        for (int i = 0; i < digits; i++)
+        {
+            if (i == 1) *p++ = '.';
+            *p++ = '0' + nextRandom() % 10;
+        }
+        sprintf(p, "e%d", (int)(nextRandom() % 660) - 340);
+        break;
+    }
+    case 3:
+        sprintf(text, "%.*e", (int)(nextRandom() % 20), randomDouble() * 1e-300 * 1e-10);
+        break;
+    default:
+        sprintf(text, "%.*e", (int)(nextRandom() % 20), (1 + nextRandom() % 17) * 1e307);
+        break;
+    }
+}
+
+// Readings as devices send them: a few decimals
+static void makeReading(char* text)
+{
+    int decimals = 1 + nextRandom() % 6;
+    double value = (int)(nextRandom() % 2000000) / 1000.0 - 1000;
+    sprintf(text, "%.*f", decimals, value);
+}
+
+static int checkCorpus()
+{
+    char text[64];
+    int mismatches = 0;
+    for (int i = 0; i < CHECK_COUNT; i++)
+    {
+        makeCheckNumber(text);
+        double parsed = 0, expected = strtod(text, NULL);
+        if (json_parse_double(text, &parsed) != 0 || memcmp(&parsed, &expected, sizeof(parsed)) != 0)
+        {
+            if (mismatches++ < 5) printf("mismatch: %s: %.17g instead of %.17g\r\n", text, parsed, expected);
+        }
+    }
+    return mismatches;
+}
+
+int main()
+{
+    Timer timer;
+    timer.start();
+    int mismatches = checkCorpus();
+    timer.stop();
+    printf("%d random numbers against strtod: %d mismatches (%d ms)\r\n", CHECK_COUNT, mismatches, timer.read_ms());
+
+    char* numbers = (char *)malloc(NUMBER_COUNT * NUMBER_SIZE);
+    char* array = (char *)malloc(NUMBER_COUNT * NUMBER_SIZE + 2);
+    if (numbers == NULL || array == NULL)
+    {
+        printf("out of memory\r\n");
+        return 1;
+    }
+
+    char* end = array;
+    *end++ = '[';
+    for (int i = 0; i < NUMBER_COUNT; i++)
+    {
+        char* text = numbers + i * NUMBER_SIZE;
+        if (i % 4 == 0) sprintf(text, "%.17g", randomDouble());
+        else makeReading(text);
+        end += sprintf(end, i ? ",%s" : "%s", text);
+    }
+    strcpy(end, "]");
+    int arrayLength = strlen(array);
+
+    double value;
+    int parsed = 0;
+    timer.reset();
+    timer.start();
+    for (int r = 0; r < PARSE_ROUNDS; r++)
+        for (int i = 0; i < NUMBER_COUNT; i++)
+            parsed += json_parse_double(numbers + i * NUMBER_SIZE, &value) == 0;
+    timer.stop();
+    int parseUs = timer.read_us();
+
+    timer.reset();
+    timer.start();
+    for (int r = 0; r < PARSE_ROUNDS; r++)
+        for (int i = 0; i < NUMBER_COUNT; i++)
+            parsed += strtod(numbers + i * NUMBER_SIZE, NULL) != 0;
+    timer.stop();
+    int strtodUs = timer.read_us();
+
+    timer.reset();
+    timer.start();
+    for (int r = 0; r < PARSE_ROUNDS; r++)
+        for (int i = 0; i < NUMBER_COUNT; i++)
+            parsed += sscanf(numbers + i * NUMBER_SIZE, "%lf", &value) == 1;
+    timer.stop();
+    int sscanfUs = timer.read_us();
+
+    // The tokener reads the digits straight from the input
+    int treeRounds = PARSE_ROUNDS / 4;
+    timer.reset();
+    timer.start();
+    for (int r = 0; r < treeRounds; r++)
+    {
+        json_object* tree = json_tokener_parse(array);
+        parsed += json_object_array_length(tree);
+        json_object_put(tree);
+    }
+    timer.stop();
+    int treeUs = timer.read_us();
+
+    int count = PARSE_ROUNDS * NUMBER_COUNT;
+    printf("%d numbers: json_parse_double %.1f ns, strtod %.1f ns, sscanf %.1f ns per number (%d parsed)\r\n",
+           NUMBER_COUNT, parseUs * 1000.0 / count, strtodUs * 1000.0 / count, sscanfUs * 1000.0 / count, parsed);
+    printf("array of %d bytes: parse and free %.1f us, %.2f MB/s\r\n",
+           arrayLength, (double)treeUs / treeRounds, (double)arrayLength * treeRounds / treeUs);
+    free(array);
+    free(numbers);
+    return 0;
+}
@@ -0,0 +1,120 @@
+// Time of json_parse_int64() and of parsing an array of integers, against
+// sscanf("%lld") as json_parse_int64() used to work and strtoll().
+//
+// This is a program of its own: build it as the main file of an mbed
+// application that includes the SpeechRecognition library. The .mbedignore
+// next to it keeps it out of the library build. It takes about 100 kB of
+// heap; lower NUMBER_COUNT on smaller targets.
+//
+// Every number is also checked against strtoll(), which saturates out of
+// range values the same way, so a mismatch is a bug rather than noise.
+
+#include "mbed.h"
+#include <json.h>
+
+#define NUMBER_COUNT    2000
+#define NUMBER_SIZE     24
+#define PARSE_ROUNDS    20
+
+static uint32_t seed = 12345;
+
+static uint32_t nextRandom()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+// Mostly short counters and ids as they appear in responses, some full
+// width values and some with up to 21 digits that have to saturate.
+static void makeNumber(char* text)
+{
+    uint32_t kind = nextRandom() % 16;
+    int digits = kind < 8 ? 1 + nextRandom() % 3 : kind < 12 ? 4 + nextRandom() % 6 :
+                 kind < 15 ? 10 + nextRandom() % 9 : 19 + nextRandom() % 3;
+
+    if ((nextRandom() & 3) == 0) *text++ = '-';
+    for (int i = 0; i < digits; i++) *text++ = '0' + (i == 0 ? 1 + nextRandom() % 9 : nextRandom() % 10);
+    *text = '\0';
+}
+
+int main()
+{
+    char* numbers = (char *)malloc(NUMBER_COUNT * NUMBER_SIZE);
+    char* array = (char *)malloc(NUMBER_COUNT * NUMBER_SIZE + 2);
+    if (numbers == NULL || array == NULL)
+    {
+        printf("out of memory\r\n");
+        return 1;
+    }
+
+    char* end = array;
+    *end++ = '[';
+    for (int i = 0; i < NUMBER_COUNT; i++)
+    {
+        char* text = numbers + i * NUMBER_SIZE;
+        makeNumber(text);
+        end += sprintf(end, i ? ",%s" : "%s", text);
+    }
+    strcpy(end, "]");
+    int arrayLength = strlen(array);
+
+    int mismatches = 0;
+    for (int i = 0; i < NUMBER_COUNT; i++)
+    {
+        const char* text = numbers + i * NUMBER_SIZE;
+        int64_t value = 0;
+        if (json_parse_int64(text, &value) != 0 || value != strtoll(text, NULL, 10))
+        {
+            if (mismatches++ < 5) printf("mismatch: %s\r\n", text);
+        }
+    }
+
+    Timer timer;
+    int64_t value;
+    long long scanned, sum = 0;
+    timer.start();
+    for (int r = 0; r < PARSE_ROUNDS; r++)
+        for (int i = 0; i < NUMBER_COUNT; i++)
+            if (json_parse_int64(numbers + i * NUMBER_SIZE, &value) == 0) sum += value;
+    timer.stop();
+    int parseUs = timer.read_us();
+
+    timer.reset();
+    timer.start();
+    for (int r = 0; r < PARSE_ROUNDS; r++)
+        for (int i = 0; i < NUMBER_COUNT; i++)
+            if (sscanf(numbers + i * NUMBER_SIZE, "%lld", &scanned) == 1) sum += scanned;
+    timer.stop();
+    int sscanfUs = timer.read_us();
+
+    timer.reset();
+    timer.start();
+    for (int r = 0; r < PARSE_ROUNDS; r++)
+        for (int i = 0; i < NUMBER_COUNT; i++)
+            sum += strtoll(numbers + i * NUMBER_SIZE, NULL, 10);
+    timer.stop();
+    int strtollUs = timer.read_us();
+
+    // The tokener reads the digits straight from the input
+    int treeRounds = PARSE_ROUNDS / 4;
+    timer.reset();
+    timer.start();
+    for (int r = 0; r < treeRounds; r++)
+    {
+        json_object* tree = json_tokener_parse(array);
+        sum += json_object_array_length(tree);
+        json_object_put(tree);
+    }
+    timer.stop();
+    int treeUs = timer.read_us();
+
+    int count = PARSE_ROUNDS * NUMBER_COUNT;
+    printf("%d numbers, %d mismatches: json_parse_int64 %.1f ns, sscanf %.1f ns, strtoll %.1f ns per number (checksum %d)\r\n",
+           NUMBER_COUNT, mismatches, parseUs * 1000.0 / count, sscanfUs * 1000.0 / count, strtollUs * 1000.0 / count,
+           (int)(sum & 1));
+    printf("array of %d bytes: parse and free %.1f us, %.2f MB/s\r\n",
+           arrayLength, (double)treeUs / treeRounds, (double)arrayLength * treeRounds / treeUs);
+    free(array);
+    free(numbers);
+    return 0;
+}
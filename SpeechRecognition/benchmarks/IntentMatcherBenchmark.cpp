@@ -0,0 +1,100 @@
+// Compile and match time of IntentMatcher for thousands of command patterns,
+// against trying every pattern in turn with strstr().
+//
+// This is a program of its own: build it as the main file of an mbed
+// application that includes the SpeechRecognition library. The .mbedignore
+// next to it keeps it out of the library build. The largest grammar takes
+// about 1 MB of heap; drop it from grammarSizes on smaller targets.
+
+#include "mbed.h"
+#include "IntentMatcher.h"
+
+#define SLOT_VALUES     50
+#define MATCH_ROUNDS    20000
+
+static const int grammarSizes[] = { 250, 1000, 5000 };
+
+static const char * utterances[] =
+{
+    "hey please command4321 set mode29 for the dev7 thanks",
+    "command17 set mode17 for the dev49",
+    "no command matches this sentence at all okay",
+};
+#define UTTERANCE_COUNT (int)(sizeof(utterances) / sizeof(utterances[0]))
+
+static void benchmark(int patternCount)
+{
+    IntentMatcher matcher;
+    char name[32];
+    char* patterns = (char *)malloc(patternCount * 64);
+    if (patterns == NULL)
+    {
+        printf("%d patterns: out of memory\r\n", patternCount);
+        return;
+    }
+
+    for (int i = 0; i < SLOT_VALUES; i++)
+    {
+        sprintf(name, "dev%d", i);
+        matcher.addSlotValue("device", name);
+    }
+    for (int i = 0; i < patternCount; i++)
+    {
+        char* pattern = patterns + i * 64;
+        sprintf(pattern, "command%d set mode%d for the {device}", i, i % 37);
+        sprintf(name, "Intent%d", i);
+        matcher.addIntent(name, pattern);
+    }
+
+    Timer timer;
+    timer.start();
+    int compiled = matcher.compile();
+    timer.stop();
+    int compileUs = timer.read_us();
+    if (compiled != 0)
+    {
+        printf("%d patterns: compile failed\r\n", patternCount);
+        free(patterns);
+        return;
+    }
+
+    IntentMatch match;
+    int hits = 0;
+    timer.reset();
+    timer.start();
+    for (int i = 0; i < MATCH_ROUNDS; i++) hits += matcher.match(utterances[i % UTTERANCE_COUNT], &match) >= 0;
+    timer.stop();
+    int matchUs = timer.read_us();
+
+    // The alternative: every pattern tried on its own. Only the literal
+    // words before the slot are compared, which flatters it.
+    int rounds = MATCH_ROUNDS / 100;
+    int scanHits = 0;
+    timer.reset();
+    timer.start();
+    for (int i = 0; i < rounds; i++)
+    {
+        const char* text = utterances[i % UTTERANCE_COUNT];
+        for (int p = 0; p < patternCount; p++)
+        {
+            char* pattern = patterns + p * 64;
+            char* slot = strchr(pattern, '{');
+            *slot = '\0';
+            scanHits += strstr(text, pattern) != NULL;
+            *slot = '{';
+        }
+    }
+    timer.stop();
+    int scanUs = timer.read_us();
+
+    printf("%d patterns, %d states: compile %d ms, match %.3f us per utterance (%d hits), pattern scan %.1f us (%d hits)\r\n",
+           patternCount, matcher.stateCount(), compileUs / 1000, (double)matchUs / MATCH_ROUNDS, hits,
+           (double)scanUs / rounds, scanHits);
+    free(patterns);
+}
+
+int main()
+{
+    for (unsigned i = 0; i < sizeof(grammarSizes) / sizeof(grammarSizes[0]); i++) benchmark(grammarSizes[i]);
+    return 0;
+}
@@ -0,0 +1,142 @@
+// Parse and free time of json-c trees from the C library's malloc, from a
+// json_c_arena and from a json_c_pool, for a recognition response and for
+// a larger document of small objects.
+//
+// This is a program of its own: build it as the main file of an mbed
+// application that includes the SpeechRecognition library. The .mbedignore
+// next to it keeps it out of the library build. It takes about 64 kB of
+// heap; lower OBJECT_COUNT on smaller targets.
+//
+// All three draw on malloc through a counting allocator, so the calls per
+// parse show what the arena and the pool save. On hosts with per thread
+// storage, nodes and tables from malloc go through json-c's slabs first,
+// see json_c_slab_release().
+
+#include "mbed.h"
+#include <json.h>
+#include <json_allocator.h>
+
+#define OBJECT_COUNT    100
+#define PARSE_ROUNDS    200
+#define ARENA_BLOCK     4096
+
+static const char response[] =
+    "{\"version\":\"3.0\",\"header\":{\"status\":\"success\",\"scenario\":\"websearch\","
+    "\"name\":\"turn on the light in the kitchen\",\"lexical\":\"turn on the light in the kitchen\","
+    "\"properties\":{\"requestid\":\"6e0a9a2f-8f3e-4f4c-9b1e-3e1d5a7c2b11\",\"HIGHCONF\":\"1\"}},"
+    "\"results\":[{\"scenario\":\"websearch\",\"name\":\"turn on the light in the kitchen\","
+    "\"lexical\":\"turn on the light in the kitchen\",\"confidence\":\"0.9185341\","
+    "\"properties\":{\"HIGHCONF\":\"1\"}},{\"scenario\":\"websearch\",\"name\":\"turn on the lights in the kitchen\","
+    "\"lexical\":\"turn on the lights in the kitchen\",\"confidence\":\"0.4711\",\"properties\":{}}]}";
+
+static int allocatorCalls;
+
+static void* countingMalloc(void* context, size_t size)
+{
+    allocatorCalls++;
+    return malloc(size);
+}
+
+static void* countingRealloc(void* context, void* ptr, size_t size)
+{
+    allocatorCalls++;
+    return realloc(ptr, size);
+}
+
+static void countingFree(void* context, void* ptr)
+{
+    free(ptr);
+}
+
+static const struct json_c_allocator countingAllocator = { countingMalloc, countingRealloc, countingFree, NULL };
+
+static char* makeDocument()
+{
+    char* document = (char *)malloc(OBJECT_COUNT * 128 + 2);
+    if (document == NULL) return NULL;
+
+    char* end = document;
+    *end++ = '[';
+    for (int i = 0; i < OBJECT_COUNT; i++)
+    {
+        end += sprintf(end, "%s{\"id\":%d,\"name\":\"sensor%d\",\"value\":%d.%d,\"ok\":%s,\"tags\":[\"room%d\",\"floor%d\"]}",
+                       i ? "," : "", i, i, i * 7 % 1000, i % 10, i % 3 ? "true" : "false", i % 12, i % 4);
+    }
+    strcpy(end, "]");
+    return document;
+}
+
+// allocator NULL parses from malloc, arena is reset instead of freeing
+static void benchmark(const char* name, const char* text, const struct json_c_allocator* allocator,
+                      struct json_c_arena* arena)
+{
+    json_tokener* tokener = json_tokener_new();
+    if (tokener == NULL)
+    {
+        printf("%s: out of memory\r\n", name);
+        return;
+    }
+    json_tokener_set_allocator(tokener, allocator);
+
+    Timer parseTimer, freeTimer;
+    int calls = allocatorCalls;
+    int failed = 0;
+    for (int i = 0; i < PARSE_ROUNDS; i++)
+    {
+        json_tokener_reset(tokener);
+        parseTimer.start();
+        json_object* tree = json_tokener_parse_ex(tokener, text, -1);
+        parseTimer.stop();
+        failed += tree == NULL;
+
+        freeTimer.start();
+        if (arena) json_c_arena_reset(arena);
+        else json_object_put(tree);
+        freeTimer.stop();
+    }
+    calls = allocatorCalls - calls;
+    json_tokener_free(tokener);
+
+    printf("%-16s parse %7.1f us, free %6.1f us, %5.1f malloc calls per parse%s\r\n",
+           name, (double)parseTimer.read_us() / PARSE_ROUNDS, (double)freeTimer.read_us() / PARSE_ROUNDS,
+           (double)calls / PARSE_ROUNDS, failed ? " (parse failed)" : "");
+}
+
+static void benchmarkAll(const char* title, const char* text)
+{
+    printf("%s, %d bytes:\r\n", title, (int)strlen(text));
+    benchmark("  malloc", text, NULL, NULL);
+
+    struct json_c_arena* arena = json_c_arena_new(ARENA_BLOCK);
+    if (arena)
+    {
+        benchmark("  arena", text, json_c_arena_allocator(arena), arena);
+        json_c_arena_free(arena);
+    }
+
+    struct json_c_pool* pool = json_c_pool_new();
+    if (pool)
+    {
+        benchmark("  pool", text, json_c_pool_allocator(pool), NULL);
+        json_c_pool_free(pool);
+    }
+}
+
+int main()
+{
+    // The arena and the pool take their blocks from the allocator current
+    // when they are created, this one
+    json_c_set_allocator(&countingAllocator);
+
+    benchmarkAll("recognition response", response);
+
+    char* document = makeDocument();
+    if (document == NULL)
+    {
+        printf("out of memory\r\n");
+        return 1;
+    }
+    benchmarkAll("small objects", document);
+    free(document);
+    return 0;
+}
@@ -0,0 +1,151 @@
+// Parse and free throughput of a numeric json-c document, whose cost is
+// mostly allocating and freeing one json_object per number, with nodes
+// from the global allocator and from a json_c_pool.
+//
+// This is a program of its own: build it as the main file of an mbed
+// application that includes the SpeechRecognition library. The .mbedignore
+// next to it keeps it out of the library build. It takes about 200 kB of
+// heap; lower NUMBER_COUNT and OBJECT_COUNT on smaller targets.
+//
+// mbed OS has no slabs, see json_c_slab_release(), there the pool is the
+// alternative. To see what the slabs do, build it on a host against json-c
+// twice, the second time with JSON_C_NO_SLAB, and compare "global":
+//
+//   cmake -S json-c -B slab && cmake --build slab
+//   cmake -S json-c -B noslab -DCMAKE_C_FLAGS=-DJSON_C_NO_SLAB && cmake --build noslab
+//   c++ -O2 -Ijson-c -Islab SpeechRecognition/benchmarks/JsonNodeBenchmark.cpp slab/libjson-c.a -o slab/nodes
+//   c++ -O2 -Ijson-c -Inoslab SpeechRecognition/benchmarks/JsonNodeBenchmark.cpp noslab/libjson-c.a -o noslab/nodes
+
+#if defined(__MBED__)
+#include "mbed.h"
+#else
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The part of mbed's Timer used here
+class Timer
+{
+    public:
+        Timer() : _elapsed(0), _running(false) {}
+        void start() { _start = std::chrono::steady_clock::now(); _running = true; }
+        void stop()
+        {
+            if (_running) _elapsed += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start).count();
+            _running = false;
+        }
+        int read_us() { return (int)_elapsed; }
+
+    private:
+        std::chrono::steady_clock::time_point _start;
+        long long _elapsed;
+        bool _running;
+};
+#endif
+#include <json.h>
+#include <json_allocator.h>
+
+#define NUMBER_COUNT    1000
+#define OBJECT_COUNT    200
+#define PARSE_ROUNDS    20
+
+static int allocatorCalls;
+
+static void* countingMalloc(void* context, size_t size)
+{
+    allocatorCalls++;
+    return malloc(size);
+}
+
+static void* countingRealloc(void* context, void* ptr, size_t size)
+{
+    allocatorCalls++;
+    return realloc(ptr, size);
+}
+
+static void countingFree(void* context, void* ptr)
+{
+    allocatorCalls++;
+    free(ptr);
+}
+
+static const struct json_c_allocator countingAllocator = { countingMalloc, countingRealloc, countingFree, NULL };
+
+// An array of integers followed by small objects, one node per number
+static char* makeDocument()
+{
+    char* document = (char *)malloc(NUMBER_COUNT * 12 + OBJECT_COUNT * 32 + 2);
+    if (document == NULL) return NULL;
+
+    char* end = document;
+    *end++ = '[';
+    for (int i = 0; i < NUMBER_COUNT; i++) end += sprintf(end, "%s%d", i ? "," : "", i * 7919 % 100000);
+    for (int i = 0; i < OBJECT_COUNT; i++) end += sprintf(end, ",{\"id\":%d,\"v\":%d}", i, i * 31 % 1000);
+    strcpy(end, "]");
+    return document;
+}
+
+static void benchmark(const char* name, const char* text, const struct json_c_allocator* allocator)
+{
+    json_tokener* tokener = json_tokener_new();
+    if (tokener == NULL)
+    {
+        printf("%s: out of memory\r\n", name);
+        return;
+    }
+    json_tokener_set_allocator(tokener, allocator);
+
+    Timer parseTimer, freeTimer;
+    int parseCalls = 0, freeCalls = 0, failed = 0;
+    for (int i = 0; i < PARSE_ROUNDS; i++)
+    {
+        int calls = allocatorCalls;
+        json_tokener_reset(tokener);
+        parseTimer.start();
+        json_object* tree = json_tokener_parse_ex(tokener, text, -1);
+        parseTimer.stop();
+        parseCalls += allocatorCalls - calls;
+        failed += tree == NULL;
+
+        calls = allocatorCalls;
+        freeTimer.start();
+        json_object_put(tree);
+        freeTimer.stop();
+        freeCalls += allocatorCalls - calls;
+    }
+    json_tokener_free(tokener);
+
+    // Every number, object and member value is a node
+    double nodes = (double)(NUMBER_COUNT + OBJECT_COUNT * 3 + 1) * PARSE_ROUNDS;
+    printf("%-7s parse %7.1f us (%5.2f M nodes/s, %6.1f allocator calls), free %7.1f us (%5.2f M nodes/s, %6.1f calls)%s\r\n",
+           name, (double)parseTimer.read_us() / PARSE_ROUNDS, nodes / parseTimer.read_us(),
+           (double)parseCalls / PARSE_ROUNDS, (double)freeTimer.read_us() / PARSE_ROUNDS,
+           nodes / freeTimer.read_us(), (double)freeCalls / PARSE_ROUNDS, failed ? " (parse failed)" : "");
+}
+
+int main()
+{
+    // The pool takes its chunks from the allocator current when it is
+    // created, this one
+    json_c_set_allocator(&countingAllocator);
+
+    char* document = makeDocument();
+    if (document == NULL)
+    {
+        printf("out of memory\r\n");
+        return 1;
+    }
+    printf("%d numbers and %d objects, %d bytes:\r\n", NUMBER_COUNT, OBJECT_COUNT, (int)strlen(document));
+    benchmark("global", document, NULL);
+
+    struct json_c_pool* pool = json_c_pool_new();
+    if (pool)
+    {
+        benchmark("pool", document, json_c_pool_allocator(pool));
+        json_c_pool_free(pool);
+    }
+    free(document);
+    json_c_slab_release();
+    return 0;
+}
@@ -0,0 +1,109 @@
+// Parse time of the same json-c document minified, spaced and pretty
+// printed with spaces and with tabs, to show what skipping whitespace
+// costs the tokener.
+//
+// This is a program of its own: build it as the main file of an mbed
+// application that includes the SpeechRecognition library. The .mbedignore
+// next to it keeps it out of the library build. It takes about 100 kB of
+// heap; lower RECORD_COUNT on smaller targets.
+//
+// json_validate() runs the tokener without building objects, so it shows
+// the scanning alone; parse includes building and freeing the tree.
+
+#include "mbed.h"
+#include <json.h>
+
+#define RECORD_COUNT    60
+#define PARSE_ROUNDS    50
+
+struct Layout
+{
+    const char* name;
+    int flags;
+};
+
+static const Layout layouts[] =
+{
+    { "minified", JSON_C_TO_STRING_PLAIN },
+    { "spaced", JSON_C_TO_STRING_SPACED },
+    { "pretty", JSON_C_TO_STRING_PRETTY },
+    { "pretty, tabs", JSON_C_TO_STRING_PRETTY | JSON_C_TO_STRING_PRETTY_TAB },
+};
+#define LAYOUT_COUNT (int)(sizeof(layouts) / sizeof(layouts[0]))
+
+// Nested records as a device would report them, to be printed in each layout
+static json_object* makeDocument()
+{
+    char text[32];
+    json_object* records = json_object_new_array();
+
+    for (int i = 0; i < RECORD_COUNT; i++)
+    {
+        json_object* record = json_object_new_object();
+        json_object* readings = json_object_new_array();
+        json_object* location = json_object_new_object();
+
+        sprintf(text, "device-%d", i);
+        json_object_object_add(record, "id", json_object_new_string(text));
+        json_object_object_add(record, "online", json_object_new_boolean(i % 5 != 0));
+        sprintf(text, "room %d", i % 12);
+        json_object_object_add(location, "room", json_object_new_string(text));
+        json_object_object_add(location, "x", json_object_new_double(i * 0.25));
+        json_object_object_add(location, "y", json_object_new_double(i * 0.5));
+        json_object_object_add(record, "location", location);
+        for (int r = 0; r < 6; r++) json_object_array_add(readings, json_object_new_double(20 + (i * 7 + r) % 50 * 0.1));
+        json_object_object_add(record, "readings", readings);
+        json_object_array_add(records, record);
+    }
+    return records;
+}
+
+int main()
+{
+    json_object* document = makeDocument();
+    if (document == NULL)
+    {
+        printf("out of memory\r\n");
+        return 1;
+    }
+
+    int minifiedLength = 0;
+    for (int l = 0; l < LAYOUT_COUNT; l++)
+    {
+        char* text = strdup(json_object_to_json_string_ext(document, layouts[l].flags));
+        if (text == NULL)
+        {
+            printf("%s: out of memory\r\n", layouts[l].name);
+            break;
+        }
+        int length = strlen(text);
+        if (l == 0) minifiedLength = length;
+
+        Timer timer;
+        int failed = 0;
+        timer.start();
+        for (int i = 0; i < PARSE_ROUNDS; i++) failed += json_validate(text, length, 0) != json_tokener_success;
+        timer.stop();
+        int validateUs = timer.read_us();
+
+        timer.reset();
+        timer.start();
+        for (int i = 0; i < PARSE_ROUNDS; i++)
+        {
+            json_object* tree = json_tokener_parse(text);
+            failed += tree == NULL;
+            json_object_put(tree);
+        }
+        timer.stop();
+        int parseUs = timer.read_us();
+
+        printf("%-13s %6d bytes (%3d%% whitespace): validate %7.1f us %6.2f MB/s, parse %7.1f us %6.2f MB/s%s\r\n",
+               layouts[l].name, length, (length - minifiedLength) * 100 / length,
+               (double)validateUs / PARSE_ROUNDS, (double)length * PARSE_ROUNDS / validateUs,
+               (double)parseUs / PARSE_ROUNDS, (double)length * PARSE_ROUNDS / parseUs,
+               failed ? " (failed)" : "");
+        free(text);
+    }
+    json_object_put(document);
+    return 0;
+}
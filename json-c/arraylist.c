@@ -33,19 +33,28 @@
 #endif
 
 #include "arraylist.h"
+#include "json_allocator.h"
+#include "json_allocator_private.h"
 
 struct array_list*
 array_list_new(array_list_free_fn *free_fn)
+{
+  return array_list_new_with(json_c_get_allocator(), free_fn);
+}
+
+struct array_list*
+array_list_new_with(const struct json_c_allocator *allocator, array_list_free_fn *free_fn)
 {
   struct array_list *arr;
 
-  arr = (struct array_list*)calloc(1, sizeof(struct array_list));
+  arr = (struct array_list*)json_c_allocator_calloc(allocator, 1, sizeof(struct array_list));
   if(!arr) return NULL;
   arr->size = ARRAY_LIST_DEFAULT_SIZE;
   arr->length = 0;
   arr->free_fn = free_fn;
-  if(!(arr->array = (void**)calloc(sizeof(void*), arr->size))) {
-    free(arr);
+  arr->allocator = allocator;
+  if(!(arr->array = (void**)json_c_allocator_calloc(allocator, sizeof(void*), arr->size))) {
+    json_c_allocator_free(allocator, arr);
     return NULL;
   }
   return arr;
@@ -57,8 +66,8 @@ array_list_free(struct array_list *arr)
   size_t i;
   for(i = 0; i < arr->length; i++)
     if(arr->array[i]) arr->free_fn(arr->array[i]);
-  free(arr->array);
-  free(arr);
+  json_c_allocator_free(arr->allocator, arr->array);
+  json_c_allocator_free(arr->allocator, arr);
 }
 
 void*
@@ -84,7 +93,7 @@ static int array_list_expand_internal(struct array_list *arr, size_t max)
       new_size = max;
   }
   if (new_size > (~((size_t)0)) / sizeof(void*)) return -1;
-  if (!(t = realloc(arr->array, new_size*sizeof(void*)))) return -1;
+  if (!(t = json_c_allocator_realloc(arr->allocator, arr->array, new_size*sizeof(void*)))) return -1;
   arr->array = (void**)t;
   (void)memset(arr->array + arr->size, 0, (new_size-arr->size)*sizeof(void*));
   arr->size = new_size;
@@ -20,12 +20,15 @@ extern "C" {
 
 typedef void (array_list_free_fn) (void *data);
 
+struct json_c_allocator;
+
 struct array_list
 {
   void **array;
   size_t length;
   size_t size;
   array_list_free_fn *free_fn;
+  const struct json_c_allocator *allocator; /* current at creation */
 };
 
 extern struct array_list*
@@ -0,0 +1,849 @@
+/*
+ * Copyright (c) 2017 json-c contributors
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See COPYING for details.
+ *
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>   /* Get InterlockedCompareExchangePointer */
+#endif
+
+#include "json_object.h"
+#include "json_object_private.h"
+#include "linkhash.h"
+#include "json_allocator.h"
+#include "json_allocator_private.h"
+
+static void *json_c_default_malloc(void *ctx, size_t size)
+{
+	return malloc(size);
+}
+
+static void *json_c_default_realloc(void *ctx, void *ptr, size_t size)
+{
+	return realloc(ptr, size);
+}
+
+static void json_c_default_free(void *ctx, void *ptr)
+{
+	free(ptr);
+}
+
+static const struct json_c_allocator json_c_default_allocator = {
+	json_c_default_malloc,
+	json_c_default_realloc,
+	json_c_default_free,
+	NULL
+};
+
+static struct json_c_allocator json_c_global_allocator = {
+	json_c_default_malloc,
+	json_c_default_realloc,
+	json_c_default_free,
+	NULL
+};
+
+#ifdef JSON_C_HAVE_THREAD_LOCAL
+/* NULL while the global allocator is in use */
+static JSON_C_THREAD_LOCAL const struct json_c_allocator *json_c_thread_allocator;
+#endif
+
+void json_c_set_allocator(const struct json_c_allocator *allocator)
+{
+	/* Give this thread's spare slab chunks back now; every chunk keeps the
+	   allocator it came from, so other threads' go back to it later */
+	json_c_slab_release();
+	json_c_global_allocator = allocator ? *allocator : json_c_default_allocator;
+}
+
+#ifdef JSON_C_HAVE_THREAD_LOCAL
+const struct json_c_allocator *json_c_get_allocator(void)
+{
+	return json_c_thread_allocator ? json_c_thread_allocator : &json_c_global_allocator;
+}
+
+const struct json_c_allocator *json_c_use_allocator(const struct json_c_allocator *allocator)
+{
+	const struct json_c_allocator *previous = json_c_thread_allocator;
+
+	json_c_thread_allocator = allocator;
+	return previous;
+}
+#else
+const struct json_c_allocator *json_c_get_allocator(void)
+{
+	return &json_c_global_allocator;
+}
+#endif
+
+void *json_c_allocator_malloc(const struct json_c_allocator *allocator, size_t size)
+{
+	return allocator->malloc_fn(allocator->ctx, size);
+}
+
+void *json_c_allocator_calloc(const struct json_c_allocator *allocator, size_t nmemb, size_t size)
+{
+	void *ptr;
+
+	if (size != 0 && nmemb > SIZE_MAX / size)
+		return NULL;
+	ptr = allocator->malloc_fn(allocator->ctx, nmemb * size);
+	if (ptr)
+		memset(ptr, 0, nmemb * size);
+	return ptr;
+}
+
+void *json_c_allocator_realloc(const struct json_c_allocator *allocator, void *ptr, size_t size)
+{
+	return allocator->realloc_fn(allocator->ctx, ptr, size);
+}
+
+void json_c_allocator_free(const struct json_c_allocator *allocator, void *ptr)
+{
+	if (ptr)
+		allocator->free_fn(allocator->ctx, ptr);
+}
+
+char *json_c_allocator_strdup(const struct json_c_allocator *allocator, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *copy = (char *)allocator->malloc_fn(allocator->ctx, len);
+
+	if (copy)
+		memcpy(copy, str, len);
+	return copy;
+}
+
+void *json_c_malloc(size_t size)
+{
+	return json_c_allocator_malloc(json_c_get_allocator(), size);
+}
+
+void *json_c_calloc(size_t nmemb, size_t size)
+{
+	return json_c_allocator_calloc(json_c_get_allocator(), nmemb, size);
+}
+
+void *json_c_realloc(void *ptr, size_t size)
+{
+	return json_c_allocator_realloc(json_c_get_allocator(), ptr, size);
+}
+
+void json_c_free(void *ptr)
+{
+	json_c_allocator_free(json_c_get_allocator(), ptr);
+}
+
+char *json_c_strdup(const char *str)
+{
+	return json_c_allocator_strdup(json_c_get_allocator(), str);
+}
+
+/*
+ * Arena and pool blocks are preceded by a header, which also sets the
+ * alignment of everything they hand out.
+ */
+struct json_c_slab_chunk;
+
+union json_c_block_header
+{
+	size_t size;
+	void *next;
+	struct json_c_slab_chunk *chunk;
+	double align_double;
+	int64_t align_int64;
+};
+
+#define JSON_C_BLOCK_ALIGN(n) \
+	(((n) + sizeof(union json_c_block_header) - 1) & ~(sizeof(union json_c_block_header) - 1))
+#define JSON_C_HEADER_SIZE sizeof(union json_c_block_header)
+
+/* arena */
+
+struct json_c_arena_block
+{
+	struct json_c_arena_block *next;
+	size_t size;
+	size_t used;
+};
+
+#define JSON_C_ARENA_BLOCK_DATA(b) ((char *)(b) + JSON_C_BLOCK_ALIGN(sizeof(struct json_c_arena_block)))
+
+struct json_c_arena
+{
+	struct json_c_allocator allocator;
+	struct json_c_allocator backing;
+	struct json_c_arena_block *blocks;	/* newest first */
+	size_t block_size;
+	size_t used;
+	union json_c_block_header *last;	/* most recent allocation */
+};
+
+static void *json_c_arena_malloc(void *ctx, size_t size)
+{
+	struct json_c_arena *arena = (struct json_c_arena *)ctx;
+	struct json_c_arena_block *block = arena->blocks;
+	size_t need = JSON_C_HEADER_SIZE + JSON_C_BLOCK_ALIGN(size);
+	union json_c_block_header *header;
+
+	if (size > SIZE_MAX / 2)
+		return NULL;
+	if (!block || block->size - block->used < need)
+	{
+		size_t block_size = arena->block_size;
+
+		if (block_size < need)
+			block_size = need;
+		block = (struct json_c_arena_block *)json_c_allocator_malloc(&arena->backing,
+			JSON_C_BLOCK_ALIGN(sizeof(struct json_c_arena_block)) + block_size);
+		if (!block)
+			return NULL;
+		block->size = block_size;
+		block->used = 0;
+		block->next = arena->blocks;
+		arena->blocks = block;
+	}
+	header = (union json_c_block_header *)(JSON_C_ARENA_BLOCK_DATA(block) + block->used);
+	header->size = JSON_C_BLOCK_ALIGN(size);
+	block->used += need;
+	arena->used += need;
+	arena->last = header;
+	return header + 1;
+}
+
+static void *json_c_arena_realloc(void *ctx, void *ptr, size_t size)
+{
+	struct json_c_arena *arena = (struct json_c_arena *)ctx;
+	union json_c_block_header *header;
+	void *copy;
+
+	if (!ptr)
+		return json_c_arena_malloc(ctx, size);
+	header = (union json_c_block_header *)ptr - 1;
+	if (size <= header->size)
+		return ptr;
+
+	/* The most recent allocation grows in place while its block has room */
+	if (header == arena->last && size <= SIZE_MAX / 2)
+	{
+		struct json_c_arena_block *block = arena->blocks;
+		size_t grow = JSON_C_BLOCK_ALIGN(size) - header->size;
+
+		if (block->size - block->used >= grow)
+		{
+			header->size += grow;
+			block->used += grow;
+			arena->used += grow;
+			return ptr;
+		}
+	}
+
+	copy = json_c_arena_malloc(ctx, size);
+	if (copy)
+		memcpy(copy, ptr, header->size);
+	return copy;
+}
+
+static void json_c_arena_release(void *ctx, void *ptr)
+{
+	struct json_c_arena *arena = (struct json_c_arena *)ctx;
+	union json_c_block_header *header = (union json_c_block_header *)ptr - 1;
+
+	/* Only the most recent allocation can be given back */
+	if (header == arena->last)
+	{
+		size_t size = JSON_C_HEADER_SIZE + header->size;
+
+		arena->blocks->used -= size;
+		arena->used -= size;
+		arena->last = NULL;
+	}
+}
+
+struct json_c_arena *json_c_arena_new(size_t block_size)
+{
+	const struct json_c_allocator *backing = json_c_get_allocator();
+	struct json_c_arena *arena;
+
+	arena = (struct json_c_arena *)json_c_allocator_calloc(backing, 1, sizeof(struct json_c_arena));
+	if (!arena)
+		return NULL;
+	arena->allocator.malloc_fn = json_c_arena_malloc;
+	arena->allocator.realloc_fn = json_c_arena_realloc;
+	arena->allocator.free_fn = json_c_arena_release;
+	arena->allocator.ctx = arena;
+	arena->backing = *backing;
+	arena->block_size = JSON_C_BLOCK_ALIGN(block_size);
+	return arena;
+}
+
+const struct json_c_allocator *json_c_arena_allocator(struct json_c_arena *arena)
+{
+	return &arena->allocator;
+}
+
+int json_c_allocator_is_arena(const struct json_c_allocator *allocator)
+{
+	return allocator->malloc_fn == json_c_arena_malloc;
+}
+
+size_t json_c_arena_used(const struct json_c_arena *arena)
+{
+	return arena->used;
+}
+
+void json_c_arena_reset(struct json_c_arena *arena)
+{
+	struct json_c_arena_block *block = arena->blocks;
+
+	if (!block)
+		return;
+	while (block->next)
+	{
+		struct json_c_arena_block *next = block->next;
+
+		json_c_allocator_free(&arena->backing, block);
+		block = next;
+	}
+	block->used = 0;
+	arena->blocks = block;
+	arena->used = 0;
+	arena->last = NULL;
+}
+
+void json_c_arena_free(struct json_c_arena *arena)
+{
+	struct json_c_allocator backing = arena->backing;
+
+	while (arena->blocks)
+	{
+		struct json_c_arena_block *next = arena->blocks->next;
+
+		json_c_allocator_free(&backing, arena->blocks);
+		arena->blocks = next;
+	}
+	json_c_allocator_free(&backing, arena);
+}
+
+/* pool */
+
+#define JSON_C_POOL_CLASSES 10
+#define JSON_C_POOL_LARGE JSON_C_POOL_CLASSES
+#define JSON_C_POOL_CHUNK_SIZE 8192
+
+static const size_t json_c_pool_class_size[JSON_C_POOL_CLASSES] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512
+};
+
+/* Size class by (size + 15) / 16 */
+static const unsigned char json_c_pool_class_of[JSON_C_POOL_MAX_SIZE / 16 + 1] = {
+	0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7,
+	8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9
+};
+
+struct json_c_pool
+{
+	struct json_c_allocator allocator;
+	struct json_c_allocator backing;
+	union json_c_block_header *free_list[JSON_C_POOL_CLASSES];
+	union json_c_block_header *chunks;
+};
+
+/* Carve a new chunk into blocks of one size class */
+static int json_c_pool_refill(struct json_c_pool *pool, int size_class)
+{
+	size_t slot = JSON_C_HEADER_SIZE + json_c_pool_class_size[size_class];
+	union json_c_block_header *chunk;
+	char *p, *end;
+
+	chunk = (union json_c_block_header *)json_c_allocator_malloc(&pool->backing, JSON_C_POOL_CHUNK_SIZE);
+	if (!chunk)
+		return -1;
+	chunk->next = pool->chunks;
+	pool->chunks = chunk;
+
+	end = (char *)chunk + JSON_C_POOL_CHUNK_SIZE - slot;
+	for (p = (char *)(chunk + 1); p <= end; p += slot)
+	{
+		union json_c_block_header *header = (union json_c_block_header *)p;
+
+		header->size = size_class;
+		*(void **)(header + 1) = pool->free_list[size_class];
+		pool->free_list[size_class] = header;
+	}
+	return 0;
+}
+
+static void *json_c_pool_malloc(void *ctx, size_t size)
+{
+	struct json_c_pool *pool = (struct json_c_pool *)ctx;
+	union json_c_block_header *header;
+	int size_class;
+
+	if (size > JSON_C_POOL_MAX_SIZE)
+	{
+		if (size > SIZE_MAX - JSON_C_HEADER_SIZE)
+			return NULL;
+		header = (union json_c_block_header *)json_c_allocator_malloc(&pool->backing,
+			JSON_C_HEADER_SIZE + size);
+		if (!header)
+			return NULL;
+		header->size = JSON_C_POOL_LARGE;
+		return header + 1;
+	}
+
+	size_class = json_c_pool_class_of[(size + 15) / 16];
+	if (!pool->free_list[size_class] && json_c_pool_refill(pool, size_class) != 0)
+		return NULL;
+	header = pool->free_list[size_class];
+	pool->free_list[size_class] = (union json_c_block_header *)*(void **)(header + 1);
+	return header + 1;
+}
+
+static void json_c_pool_release(void *ctx, void *ptr)
+{
+	struct json_c_pool *pool = (struct json_c_pool *)ctx;
+	union json_c_block_header *header = (union json_c_block_header *)ptr - 1;
+	size_t size_class = header->size;
+
+	if (size_class == JSON_C_POOL_LARGE)
+	{
+		json_c_allocator_free(&pool->backing, header);
+		return;
+	}
+	*(void **)ptr = pool->free_list[size_class];
+	pool->free_list[size_class] = header;
+}
+
+static void *json_c_pool_realloc(void *ctx, void *ptr, size_t size)
+{
+	struct json_c_pool *pool = (struct json_c_pool *)ctx;
+	union json_c_block_header *header;
+	size_t old_size;
+	void *copy;
+
+	if (!ptr)
+		return json_c_pool_malloc(ctx, size);
+	header = (union json_c_block_header *)ptr - 1;
+
+	if (header->size == JSON_C_POOL_LARGE)
+	{
+		if (size > JSON_C_POOL_MAX_SIZE)
+		{
+			if (size > SIZE_MAX - JSON_C_HEADER_SIZE)
+				return NULL;
+			header = (union json_c_block_header *)json_c_allocator_realloc(&pool->backing,
+				header, JSON_C_HEADER_SIZE + size);
+			return header ? header + 1 : NULL;
+		}
+		/* Shrinking below the pool limit, the copy can stop at the new size */
+		old_size = size;
+	}
+	else
+	{
+		old_size = json_c_pool_class_size[header->size];
+		if (size <= old_size)
+			return ptr;
+	}
+
+	copy = json_c_pool_malloc(ctx, size);
+	if (!copy)
+		return NULL;
+	memcpy(copy, ptr, old_size < size ? old_size : size);
+	json_c_pool_release(ctx, ptr);
+	return copy;
+}
+
+struct json_c_pool *json_c_pool_new(void)
+{
+	const struct json_c_allocator *backing = json_c_get_allocator();
+	struct json_c_pool *pool;
+
+	pool = (struct json_c_pool *)json_c_allocator_calloc(backing, 1, sizeof(struct json_c_pool));
+	if (!pool)
+		return NULL;
+	pool->allocator.malloc_fn = json_c_pool_malloc;
+	pool->allocator.realloc_fn = json_c_pool_realloc;
+	pool->allocator.free_fn = json_c_pool_release;
+	pool->allocator.ctx = pool;
+	pool->backing = *backing;
+	return pool;
+}
+
+const struct json_c_allocator *json_c_pool_allocator(struct json_c_pool *pool)
+{
+	return &pool->allocator;
+}
+
+void json_c_pool_free(struct json_c_pool *pool)
+{
+	struct json_c_allocator backing = pool->backing;
+
+	while (pool->chunks)
+	{
+		union json_c_block_header *next = (union json_c_block_header *)pool->chunks->next;
+
+		json_c_allocator_free(&backing, pool->chunks);
+		pool->chunks = next;
+	}
+	json_c_allocator_free(&backing, pool);
+}
+
+/* slab */
+
+#if defined(__ATOMIC_ACQUIRE) && __GCC_ATOMIC_POINTER_LOCK_FREE == 2 && __GCC_ATOMIC_LONG_LOCK_FREE == 2
+#define JSON_C_SLAB_ATOMIC 1
+#endif
+
+/* Host only: the slabs need per thread storage and atomics, which mbed OS
+   does not have, so they are left out of its build altogether */
+#if defined(JSON_C_HAVE_THREAD_LOCAL) && !defined(JSON_C_NO_SLAB) && \
+	!defined(__MBED__) && (defined(JSON_C_SLAB_ATOMIC) || defined(_MSC_VER))
+
+#define JSON_C_SLAB_CLASSES 2
+#define JSON_C_SLAB_SLOTS 64
+
+static const size_t json_c_slab_class_size[JSON_C_SLAB_CLASSES] = {
+	sizeof(struct json_object),
+	sizeof(struct lh_table)
+};
+
+/*
+ * JSON_C_SLAB_SLOTS blocks of one size class, each preceded by a header
+ * pointing back to the chunk.  Only the owning thread allocates from a
+ * chunk; blocks other threads free go on remote_free and are collected by
+ * the owner.  The chunk goes back to the global allocator it was taken
+ * from, which may have been replaced since.
+ */
+struct json_c_slab_chunk
+{
+	struct json_c_slab_chunk *next;
+	struct json_c_slab_chunk *prev;
+	struct json_c_allocator backing;
+	long owner;
+	void *free_slots;
+	void *volatile remote_free;
+	int used;
+	int size_class;
+};
+
+#define JSON_C_SLAB_CHUNK_DATA(c) ((char *)(c) + JSON_C_BLOCK_ALIGN(sizeof(struct json_c_slab_chunk)))
+#define JSON_C_SLAB_SLOT_SIZE(size_class) \
+	(JSON_C_HEADER_SIZE + JSON_C_BLOCK_ALIGN(json_c_slab_class_size[size_class]))
+
+struct json_c_slab_list
+{
+	struct json_c_slab_chunk *available;	/* chunks with free slots */
+	struct json_c_slab_chunk *full;
+	int empty;				/* available chunks with no slot in use */
+};
+
+struct json_c_slab
+{
+	long id;
+	long remote_seen;	/* json_c_slab_remote_frees at the last collection */
+	struct json_c_slab_list lists[JSON_C_SLAB_CLASSES];
+};
+
+static JSON_C_THREAD_LOCAL struct json_c_slab json_c_thread_slab;
+static volatile long json_c_slab_next_id;
+/* Blocks freed by a thread other than their owner, on any chunk */
+static volatile long json_c_slab_remote_frees;
+
+static void *json_c_slab_load(void *volatile *target)
+{
+#ifdef JSON_C_SLAB_ATOMIC
+	return __atomic_load_n(target, __ATOMIC_ACQUIRE);
+#else
+	return *target;
+#endif
+}
+
+static void *json_c_slab_exchange(void *volatile *target, void *value)
+{
+#ifdef JSON_C_SLAB_ATOMIC
+	return __atomic_exchange_n(target, value, __ATOMIC_ACQ_REL);
+#else
+	return InterlockedExchangePointer((PVOID volatile *)target, value);
+#endif
+}
+
+static int json_c_slab_push(void *volatile *target, void *expected, void *value)
+{
+#ifdef JSON_C_SLAB_ATOMIC
+	return __atomic_compare_exchange_n(target, &expected, value, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+#else
+	return InterlockedCompareExchangePointer((PVOID volatile *)target, value, expected) == expected;
+#endif
+}
+
+static long json_c_slab_increment(volatile long *counter)
+{
+#ifdef JSON_C_SLAB_ATOMIC
+	return __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+#else
+	return InterlockedIncrement(counter);
+#endif
+}
+
+static long json_c_slab_count(volatile long *counter)
+{
+#ifdef JSON_C_SLAB_ATOMIC
+	return __atomic_load_n(counter, __ATOMIC_RELAXED);
+#else
+	return *counter;
+#endif
+}
+
+static struct json_c_slab *json_c_slab_get(void)
+{
+	struct json_c_slab *slab = &json_c_thread_slab;
+
+	/* Chunks are told apart by the id of their thread, the storage of a
+	   thread that ended may be reused by the next one */
+	if (!slab->id)
+		slab->id = json_c_slab_increment(&json_c_slab_next_id);
+	return slab;
+}
+
+static void json_c_slab_unlink(struct json_c_slab_chunk **list, struct json_c_slab_chunk *chunk)
+{
+	if (chunk->prev)
+		chunk->prev->next = chunk->next;
+	else
+		*list = chunk->next;
+	if (chunk->next)
+		chunk->next->prev = chunk->prev;
+}
+
+static void json_c_slab_link(struct json_c_slab_chunk **list, struct json_c_slab_chunk *chunk)
+{
+	chunk->prev = NULL;
+	chunk->next = *list;
+	if (*list)
+		(*list)->prev = chunk;
+	*list = chunk;
+}
+
+static void json_c_slab_chunk_free(struct json_c_slab_chunk *chunk)
+{
+	struct json_c_allocator backing = chunk->backing;
+
+	json_c_allocator_free(&backing, chunk);
+}
+
+/* Keep one empty chunk per class for the next refill, release the rest */
+static void json_c_slab_chunk_emptied(struct json_c_slab_list *list, struct json_c_slab_chunk *chunk)
+{
+	if (list->empty == 0)
+	{
+		list->empty++;
+		return;
+	}
+	json_c_slab_unlink(&list->available, chunk);
+	json_c_slab_chunk_free(chunk);
+}
+
+/* Take back the blocks other threads freed, returns how many */
+static int json_c_slab_collect_chunk(struct json_c_slab_chunk *chunk)
+{
+	void *slot = json_c_slab_exchange(&chunk->remote_free, NULL);
+	int count = 0;
+
+	while (slot)
+	{
+		void *next = *(void **)slot;
+
+		*(void **)slot = chunk->free_slots;
+		chunk->free_slots = slot;
+		chunk->used--;
+		count++;
+		slot = next;
+	}
+	return count;
+}
+
+static void json_c_slab_collect(struct json_c_slab *slab)
+{
+	int size_class;
+
+	slab->remote_seen = json_c_slab_count(&json_c_slab_remote_frees);
+	for (size_class = 0; size_class < JSON_C_SLAB_CLASSES; size_class++)
+	{
+		struct json_c_slab_list *list = &slab->lists[size_class];
+		struct json_c_slab_chunk *chunk = list->full, *next;
+
+		for (; chunk; chunk = next)
+		{
+			next = chunk->next;
+			if (!json_c_slab_collect_chunk(chunk))
+				continue;
+			json_c_slab_unlink(&list->full, chunk);
+			json_c_slab_link(&list->available, chunk);
+			if (chunk->used == 0)
+				json_c_slab_chunk_emptied(list, chunk);
+		}
+	}
+}
+
+/* Batch refill: one allocation for JSON_C_SLAB_SLOTS blocks */
+static struct json_c_slab_chunk *json_c_slab_refill(struct json_c_slab *slab, int size_class)
+{
+	size_t slot_size = JSON_C_SLAB_SLOT_SIZE(size_class);
+	struct json_c_slab_chunk *chunk;
+	char *p;
+	int i;
+
+	chunk = (struct json_c_slab_chunk *)json_c_allocator_malloc(&json_c_global_allocator,
+		JSON_C_BLOCK_ALIGN(sizeof(struct json_c_slab_chunk)) + JSON_C_SLAB_SLOTS * slot_size);
+	if (!chunk)
+		return NULL;
+	chunk->backing = json_c_global_allocator;
+	chunk->owner = slab->id;
+	chunk->free_slots = NULL;
+	chunk->remote_free = NULL;
+	chunk->used = 0;
+	chunk->size_class = size_class;
+	p = JSON_C_SLAB_CHUNK_DATA(chunk) + (JSON_C_SLAB_SLOTS - 1) * slot_size;
+	for (i = 0; i < JSON_C_SLAB_SLOTS; i++, p -= slot_size)
+	{
+		union json_c_block_header *header = (union json_c_block_header *)p;
+
+		header->chunk = chunk;
+		*(void **)(header + 1) = chunk->free_slots;
+		chunk->free_slots = header + 1;
+	}
+	json_c_slab_link(&slab->lists[size_class].available, chunk);
+	slab->lists[size_class].empty++;
+	return chunk;
+}
+
+void *json_c_slab_calloc(const struct json_c_allocator *allocator, enum json_c_slab_class size_class)
+{
+	struct json_c_slab *slab;
+	struct json_c_slab_list *list;
+	struct json_c_slab_chunk *chunk;
+	void *slot;
+
+	if (allocator != &json_c_global_allocator)
+		return json_c_allocator_calloc(allocator, 1, json_c_slab_class_size[size_class]);
+
+	slab = json_c_slab_get();
+	list = &slab->lists[size_class];
+	if (!list->available && slab->remote_seen != json_c_slab_count(&json_c_slab_remote_frees))
+		json_c_slab_collect(slab);
+	chunk = list->available;
+	if (!chunk && !(chunk = json_c_slab_refill(slab, size_class)))
+		return NULL;
+
+	slot = chunk->free_slots;
+	chunk->free_slots = *(void **)slot;
+	if (chunk->used++ == 0)
+		list->empty--;
+	if (!chunk->free_slots && !json_c_slab_collect_chunk(chunk))
+	{
+		json_c_slab_unlink(&list->available, chunk);
+		json_c_slab_link(&list->full, chunk);
+	}
+	memset(slot, 0, json_c_slab_class_size[size_class]);
+	return slot;
+}
+
+void json_c_slab_free(const struct json_c_allocator *allocator, void *ptr)
+{
+	struct json_c_slab_chunk *chunk;
+	struct json_c_slab *slab;
+	struct json_c_slab_list *list;
+
+	if (allocator != &json_c_global_allocator)
+	{
+		json_c_allocator_free(allocator, ptr);
+		return;
+	}
+	if (!ptr)
+		return;
+
+	chunk = ((union json_c_block_header *)ptr - 1)->chunk;
+	slab = &json_c_thread_slab;
+	if (!slab->id || chunk->owner != slab->id)
+	{
+		void *head;
+
+		do {
+			head = json_c_slab_load(&chunk->remote_free);
+			*(void **)ptr = head;
+		} while (!json_c_slab_push(&chunk->remote_free, head, ptr));
+		json_c_slab_increment(&json_c_slab_remote_frees);
+		return;
+	}
+
+	list = &slab->lists[chunk->size_class];
+	if (!chunk->free_slots)
+	{
+		json_c_slab_unlink(&list->full, chunk);
+		json_c_slab_link(&list->available, chunk);
+	}
+	*(void **)ptr = chunk->free_slots;
+	chunk->free_slots = ptr;
+	if (--chunk->used == 0)
+		json_c_slab_chunk_emptied(list, chunk);
+}
+
+void json_c_slab_release(void)
+{
+	struct json_c_slab *slab = &json_c_thread_slab;
+	int size_class;
+
+	if (!slab->id)
+		return;
+	json_c_slab_collect(slab);
+	for (size_class = 0; size_class < JSON_C_SLAB_CLASSES; size_class++)
+	{
+		struct json_c_slab_list *list = &slab->lists[size_class];
+		struct json_c_slab_chunk *chunk = list->available, *next;
+
+		for (; chunk; chunk = next)
+		{
+			next = chunk->next;
+			json_c_slab_collect_chunk(chunk);
+			if (chunk->used == 0)
+			{
+				json_c_slab_unlink(&list->available, chunk);
+				json_c_slab_chunk_free(chunk);
+			}
+		}
+		list->empty = 0;
+	}
+}
+
+#else /* no slab: nodes and tables go straight to their allocator */
+
+static const size_t json_c_slab_class_size[] = {
+	sizeof(struct json_object),
+	sizeof(struct lh_table)
+};
+
+void *json_c_slab_calloc(const struct json_c_allocator *allocator, enum json_c_slab_class size_class)
+{
+	return json_c_allocator_calloc(allocator, 1, json_c_slab_class_size[size_class]);
+}
+
+void json_c_slab_free(const struct json_c_allocator *allocator, void *ptr)
+{
+	json_c_allocator_free(allocator, ptr);
+}
+
+void json_c_slab_release(void)
+{
+}
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2017 json-c contributors
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See COPYING for details.
+ *
+ */
+
+#ifndef _json_allocator_h_
+#define _json_allocator_h_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Defined where json-c keeps per thread state.  mbed OS toolchains accept
+ * __thread but have no runtime support for it, so there it is not.
+ */
+#if defined(_MSC_VER) || (defined(__GNUC__) && !defined(__MBED__))
+#define JSON_C_HAVE_THREAD_LOCAL 1
+#endif
+
+/**
+ * A memory allocator for json-c.
+ *
+ * realloc_fn must behave like realloc(): a NULL ptr allocates, and the
+ * contents are kept up to the smaller of the old and new sizes.
+ * free_fn is never called with NULL.  ctx is passed through unchanged.
+ */
+struct json_c_allocator
+{
+	void *(*malloc_fn)(void *ctx, size_t size);
+	void *(*realloc_fn)(void *ctx, void *ptr, size_t size);
+	void (*free_fn)(void *ctx, void *ptr);
+	void *ctx;
+};
+
+/**
+ * Set the global allocator: the memory json-c allocates for objects, hash
+ * tables, arrays, print buffers and tokeners is taken from it, e.g. to
+ * account for it or to take it from a dedicated heap.  NULL restores
+ * malloc/realloc/free.
+ *
+ * The allocator is copied.  Objects, tables, arrays and print buffers
+ * remember the allocator they were created with and release their memory
+ * through it, so for the global allocator only change it while no json-c
+ * object is alive.
+ */
+extern void json_c_set_allocator(const struct json_c_allocator *allocator);
+
+/**
+ * The allocator json-c currently allocates from on the calling thread:
+ * the one installed with json_c_use_allocator(), or the global one.
+ */
+extern const struct json_c_allocator *json_c_get_allocator(void);
+
+#ifdef JSON_C_HAVE_THREAD_LOCAL
+/**
+ * Allocate from allocator on the calling thread until the previous one is
+ * restored, e.g. to build a tree in an arena.  NULL stands for the global
+ * allocator.  allocator is not copied and must outlive everything created
+ * from it.
+ *
+ * Only available with per thread storage: without it the override would
+ * apply to every thread.  json_tokener_set_allocator() and
+ * json_tokener_parse_arena() work everywhere.
+ *
+ * @returns the previous allocator, to be passed back in to restore it
+ */
+extern const struct json_c_allocator *json_c_use_allocator(const struct json_c_allocator *allocator);
+#endif
+
+/**
+ * Allocate and release through a given allocator.
+ */
+extern void *json_c_allocator_malloc(const struct json_c_allocator *allocator, size_t size);
+extern void *json_c_allocator_calloc(const struct json_c_allocator *allocator, size_t nmemb, size_t size);
+extern void *json_c_allocator_realloc(const struct json_c_allocator *allocator, void *ptr, size_t size);
+extern void json_c_allocator_free(const struct json_c_allocator *allocator, void *ptr);
+extern char *json_c_allocator_strdup(const struct json_c_allocator *allocator, const char *str);
+
+/**
+ * Allocate and release through the current allocator.  These are exported
+ * for custom serializers and delete functions that want their memory
+ * accounted the same way as json-c's own.
+ */
+extern void *json_c_malloc(size_t size);
+extern void *json_c_calloc(size_t nmemb, size_t size);
+extern void *json_c_realloc(void *ptr, size_t size);
+extern void json_c_free(void *ptr);
+extern char *json_c_strdup(const char *str);
+
+/**
+ * json_object nodes and hash table headers from the global allocator are
+ * kept in per thread slabs: chunks of 64 that are allocated at once and
+ * given back once all of their blocks are free, except for one spare per
+ * size.  Give the spare chunks of the calling thread back, e.g. before
+ * the thread ends.  Chunks with objects still in use when their thread
+ * ends are not reclaimed.  A chunk goes back to the global allocator it
+ * was taken from, even after json_c_set_allocator() replaced it.
+ *
+ * The slabs are host only.  Without JSON_C_HAVE_THREAD_LOCAL, on mbed OS
+ * in particular, or with JSON_C_NO_SLAB defined, nodes and tables go
+ * straight to the global allocator and this does nothing.  There a
+ * json_c_pool recycles them the same way, for trees that are only used
+ * from one thread at a time.
+ */
+extern void json_c_slab_release(void);
+
+/**
+ * A bump allocator for memory that is released all at once, e.g. every
+ * object parsed for one request.
+ *
+ * Memory is taken in blocks of block_size bytes from the allocator current
+ * when the arena is created.  Freeing is a no-op except for the most
+ * recent allocation, which can also grow in place.  Nothing allocated from
+ * the arena may be used after json_c_arena_reset() or json_c_arena_free().
+ */
+struct json_c_arena;
+
+extern struct json_c_arena *json_c_arena_new(size_t block_size);
+extern const struct json_c_allocator *json_c_arena_allocator(struct json_c_arena *arena);
+extern size_t json_c_arena_used(const struct json_c_arena *arena);
+/**
+ * Whether allocator belongs to an arena.  json-c objects allocated from an
+ * arena are not reference counted, see json_object_put().
+ */
+extern int json_c_allocator_is_arena(const struct json_c_allocator *allocator);
+/** Release everything allocated so far, keeping the first block for reuse */
+extern void json_c_arena_reset(struct json_c_arena *arena);
+extern void json_c_arena_free(struct json_c_arena *arena);
+
+/**
+ * A pool allocator with size classes up to JSON_C_POOL_MAX_SIZE bytes.
+ *
+ * Freed blocks go on a free list per size class and are reused by the
+ * next allocation of that class, so the objects and tables of repeated
+ * parses recycle the same memory.  Larger requests are passed on to the
+ * allocator current when the pool is created, which also provides the
+ * chunks the classes are carved from.  json_c_pool_free() releases the
+ * chunks; blocks above JSON_C_POOL_MAX_SIZE must have been freed before.
+ */
+#define JSON_C_POOL_MAX_SIZE 512
+
+struct json_c_pool;
+
+extern struct json_c_pool *json_c_pool_new(void);
+extern const struct json_c_allocator *json_c_pool_allocator(struct json_c_pool *pool);
+extern void json_c_pool_free(struct json_c_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
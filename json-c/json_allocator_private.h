@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2017 json-c contributors
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See COPYING for details.
+ *
+ */
+
+#ifndef _json_allocator_private_h_
+#define _json_allocator_private_h_
+
+#include "json_allocator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Per thread storage, see JSON_C_HAVE_THREAD_LOCAL */
+#if defined(_MSC_VER)
+#define JSON_C_THREAD_LOCAL __declspec(thread)
+#elif defined(JSON_C_HAVE_THREAD_LOCAL)
+#define JSON_C_THREAD_LOCAL __thread
+#endif
+
+/*
+ * Fixed size blocks that are allocated and freed for every object are
+ * taken from a per thread slab when they come from the global allocator,
+ * on hosts only, see json_c_slab_release().
+ */
+enum json_c_slab_class {
+	json_c_slab_object,
+	json_c_slab_table
+};
+
+extern void *json_c_slab_calloc(const struct json_c_allocator *allocator, enum json_c_slab_class size_class);
+extern void json_c_slab_free(const struct json_c_allocator *allocator, void *ptr);
+
+/*
+ * Containers that json-c allocates for objects, from a given allocator
+ * rather than the current one.  The table frees its entries with
+ * free_with_fn, see struct lh_table.
+ */
+struct array_list;
+struct printbuf;
+struct lh_table;
+struct lh_entry;
+
+extern struct array_list *array_list_new_with(const struct json_c_allocator *allocator,
+					      void (*free_fn)(void *data));
+extern struct printbuf *printbuf_new_with(const struct json_c_allocator *allocator);
+extern struct lh_table *lh_kchar_table_new_with(const struct json_c_allocator *allocator, int size,
+					       void (*free_with_fn)(const struct json_c_allocator *allocator,
+								    struct lh_entry *e));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -27,6 +27,8 @@
 #include "json_inttypes.h"
 #include "json_object.h"
 #include "json_object_private.h"
+#include "json_allocator.h"
+#include "json_allocator_private.h"
 #include "json_util.h"
 #include "math_compat.h"
 #include "strdup_compat.h"
@@ -38,7 +40,18 @@ const char *json_number_chars = "0123456789.+-eE";
 const char *json_hex_chars = "0123456789abcdefABCDEF";
 
 static void json_object_generic_delete(struct json_object* jso);
-static struct json_object* json_object_new(enum json_type o_type);
+static json_object_delete_fn json_object_free_own_userdata;
+static struct json_object* json_object_new(const struct json_c_allocator *allocator,
+					   enum json_type o_type);
+static void json_object_string_delete(struct json_object* jso);
+static void json_object_borrowed_string_delete(struct json_object* jso);
+static void json_object_insitu_string_delete(struct json_object* jso);
+static int json_object_string_own(struct json_object *jso);
+static void json_object_lazy_delete(struct json_object* jso);
+static int json_object_lazy_build(struct json_object *jso);
+static void json_object_number_text_delete(struct json_object* jso);
+static void json_object_number_convert(struct json_object *jso);
+static void json_object_number_drop_text(struct json_object *jso);
 
 static json_object_to_json_string_fn json_object_object_to_json_string;
 static json_object_to_json_string_fn json_object_boolean_to_json_string;
@@ -46,6 +59,8 @@ static json_object_to_json_string_fn json_object_double_to_json_string_default;
 static json_object_to_json_string_fn json_object_int_to_json_string;
 static json_object_to_json_string_fn json_object_string_to_json_string;
 static json_object_to_json_string_fn json_object_array_to_json_string;
+static json_object_to_json_string_fn json_object_lazy_to_json_string;
+static json_object_to_json_string_fn json_object_number_text_to_json_string;
 
 
 /* ref count debugging */
@@ -94,6 +109,28 @@ get_string_component(const struct json_object *jso)
 		   jso->o.c_string.str.data : jso->o.c_string.str.ptr;
 }
 
+/* Borrowed strings point into the parser's input, see
+ * JSON_TOKENER_BORROW_STRINGS. They are not NUL terminated.
+ */
+#define json_object_string_is_borrowed(jso) \
+	((jso)->_delete == &json_object_borrowed_string_delete)
+
+/* Lazy containers are the text they were parsed from until something
+ * needs their members, see JSON_TOKENER_LAZY. Accessors call this
+ * first; it is 0 once the members are there.
+ */
+#define json_object_build(jso) \
+	(((jso)->_delete == &json_object_lazy_delete) ? \
+	 json_object_lazy_build((struct json_object *)(jso)) : 0)
+
+/* Numbers parsed with JSON_TOKENER_LAZY_NUMBERS are their text until
+ * something reads their value. Readers of c_int64 and c_double call this
+ * first.
+ */
+#define json_object_convert(jso) \
+	(((jso)->_delete == &json_object_number_text_delete) ? \
+	 json_object_number_convert((struct json_object *)(jso)) : (void)0)
+
 /* string escaping */
 
 static int json_escape_str(struct printbuf *pb, const char *str, int len, int flags)
@@ -159,16 +196,19 @@ static int json_escape_str(struct printbuf *pb, const char *str, int len, int fl
 
 /* reference counting */
 
+/* Objects in an arena are not counted, they are released with the arena */
+#define JSON_OBJECT_IN_ARENA -1
+
 extern struct json_object* json_object_get(struct json_object *jso)
 {
-	if (jso)
+	if (jso && jso->_ref_count != JSON_OBJECT_IN_ARENA)
 		jso->_ref_count++;
 	return jso;
 }
 
 int json_object_put(struct json_object *jso)
 {
-	if(jso)
+	if(jso && jso->_ref_count != JSON_OBJECT_IN_ARENA)
 	{
 		jso->_ref_count--;
 		if(!jso->_ref_count)
@@ -193,18 +233,20 @@ static void json_object_generic_delete(struct json_object* jso)
 	lh_table_delete(json_object_table, jso);
 #endif /* REFCOUNT_DEBUG */
 	printbuf_free(jso->_pb);
-	free(jso);
+	json_c_slab_free(jso->_allocator, jso);
 }
 
-static struct json_object* json_object_new(enum json_type o_type)
+static struct json_object* json_object_new(const struct json_c_allocator *allocator,
+					   enum json_type o_type)
 {
 	struct json_object *jso;
 
-	jso = (struct json_object*)calloc(sizeof(struct json_object), 1);
+	jso = (struct json_object*)json_c_slab_calloc(allocator, json_c_slab_object);
 	if (!jso)
 		return NULL;
+	jso->_allocator = allocator;
 	jso->o_type = o_type;
-	jso->_ref_count = 1;
+	jso->_ref_count = json_c_allocator_is_arena(allocator) ? JSON_OBJECT_IN_ARENA : 1;
 	jso->_delete = &json_object_generic_delete;
 #ifdef REFCOUNT_DEBUG
 	lh_table_insert(json_object_table, jso, jso);
@@ -293,6 +335,12 @@ void json_object_set_serializer(json_object *jso,
 
 /* extended conversion to string */
 
+/* The print buffer is owned by the object, take it from the same allocator */
+static struct printbuf* json_object_printbuf_new(struct json_object *jso)
+{
+	return printbuf_new_with(jso->_allocator);
+}
+
 const char* json_object_to_json_string_length(struct json_object *jso, int flags, size_t *length)
 {
 	const char *r = NULL;
@@ -303,7 +351,7 @@ const char* json_object_to_json_string_length(struct json_object *jso, int flags
 		s = 4;
 		r = "null";
 	}
-	else if ((jso->_pb) || (jso->_pb = printbuf_new()))
+	else if ((jso->_pb) || (jso->_pb = json_object_printbuf_new(jso)))
 	{
 		printbuf_reset(jso->_pb);
 
@@ -396,10 +444,14 @@ static int json_object_object_to_json_string(struct json_object* jso,
 }
 
 
-static void json_object_lh_entry_free(struct lh_entry *ent)
+/*
+ * The keys of an object come from its allocator, which is also the one
+ * of its table
+ */
+static void json_object_lh_entry_free(const struct json_c_allocator *allocator, struct lh_entry *ent)
 {
 	if (!ent->k_is_constant)
-		free(lh_entry_k(ent));
+		json_c_allocator_free(allocator, (void *)lh_entry_k(ent));
 	json_object_put((struct json_object*)lh_entry_v(ent));
 }
 
@@ -411,13 +463,18 @@ static void json_object_object_delete(struct json_object* jso)
 
 struct json_object* json_object_new_object(void)
 {
-	struct json_object *jso = json_object_new(json_type_object);
+	return json_object_new_object_with(json_c_get_allocator());
+}
+
+struct json_object* json_object_new_object_with(const struct json_c_allocator *allocator)
+{
+	struct json_object *jso = json_object_new(allocator, json_type_object);
 	if (!jso)
 		return NULL;
 	jso->_delete = &json_object_object_delete;
 	jso->_to_json_string = &json_object_object_to_json_string;
-	jso->o.c_object = lh_kchar_table_new(JSON_OBJECT_DEF_HASH_ENTRIES,
-					     &json_object_lh_entry_free);
+	jso->o.c_object = lh_kchar_table_new_with(allocator, JSON_OBJECT_DEF_HASH_ENTRIES,
+						  &json_object_lh_entry_free);
 	if (!jso->o.c_object)
 	{
 		json_object_generic_delete(jso);
@@ -434,6 +491,8 @@ struct lh_table* json_object_get_object(const struct json_object *jso)
 	switch(jso->o_type)
 	{
 	case json_type_object:
+		if (json_object_build(jso) != 0)
+			return NULL;
 		return jso->o.c_object;
 	default:
 		return NULL;
@@ -446,6 +505,8 @@ int json_object_object_add_ex(struct json_object* jso,
 	const unsigned opts)
 {
 	assert(json_object_get_type(jso) == json_type_object);
+	if (json_object_build(jso) != 0)
+		return -1;
 
 	// We lookup the entry and replace the value, rather than just deleting
 	// and re-adding it, so the existing key remains valid.
@@ -464,10 +525,16 @@ int json_object_object_add_ex(struct json_object* jso,
 	if (!existing_entry)
 	{
 		const void *const k = (opts & JSON_C_OBJECT_KEY_IS_CONSTANT) ?
-					(const void *)key : strdup(key);
+					(const void *)key : json_c_allocator_strdup(jso->_allocator, key);
 		if (k == NULL)
 			return -1;
-		return lh_table_insert_w_hash(jso->o.c_object, k, val, hash, opts);
+		if (lh_table_insert_w_hash(jso->o.c_object, k, val, hash, opts) != 0)
+		{
+			if (!(opts & JSON_C_OBJECT_KEY_IS_CONSTANT))
+				json_c_allocator_free(jso->_allocator, (void *)k);
+			return -1;
+		}
+		return 0;
 	}
 	existing_value = (json_object *) lh_entry_v(existing_entry);
 	if (existing_value)
@@ -486,6 +553,8 @@ int json_object_object_add(struct json_object* jso, const char *key,
 int json_object_object_length(const struct json_object *jso)
 {
 	assert(json_object_get_type(jso) == json_type_object);
+	if (json_object_build(jso) != 0)
+		return 0;
 	return lh_table_length(jso->o.c_object);
 }
 
@@ -509,6 +578,8 @@ json_bool json_object_object_get_ex(const struct json_object* jso, const char *k
 	switch(jso->o_type)
 	{
 	case json_type_object:
+		if (json_object_build(jso) != 0)
+			return FALSE;
 		return lh_table_lookup_ex(jso->o.c_object, (const void *) key,
 					  (void**) value);
 	default:
@@ -521,6 +592,8 @@ json_bool json_object_object_get_ex(const struct json_object* jso, const char *k
 void json_object_object_del(struct json_object* jso, const char *key)
 {
 	assert(json_object_get_type(jso) == json_type_object);
+	if (json_object_build(jso) != 0)
+		return;
 	lh_table_delete(jso->o.c_object, key);
 }
 
@@ -539,7 +612,13 @@ static int json_object_boolean_to_json_string(struct json_object* jso,
 
 struct json_object* json_object_new_boolean(json_bool b)
 {
-	struct json_object *jso = json_object_new(json_type_boolean);
+	return json_object_new_boolean_with(json_c_get_allocator(), b);
+}
+
+struct json_object* json_object_new_boolean_with(const struct json_c_allocator *allocator,
+						 json_bool b)
+{
+	struct json_object *jso = json_object_new(allocator, json_type_boolean);
 	if (!jso)
 		return NULL;
 	jso->_to_json_string = &json_object_boolean_to_json_string;
@@ -556,8 +635,10 @@ json_bool json_object_get_boolean(const struct json_object *jso)
 	case json_type_boolean:
 		return jso->o.c_boolean;
 	case json_type_int:
+		json_object_convert(jso);
 		return (jso->o.c_int64 != 0);
 	case json_type_double:
+		json_object_convert(jso);
 		return (jso->o.c_double != 0);
 	case json_type_string:
 		return (jso->o.c_string.len != 0);
@@ -583,18 +664,14 @@ static int json_object_int_to_json_string(struct json_object* jso,
 {
 	/* room for 19 digits, the sign char, and a null term */
 	static char sbuf[21];
+	json_object_convert(jso);
 	snprintf(sbuf, sizeof(sbuf), "%"PRId64, jso->o.c_int64);
 	return printbuf_memappend (pb, sbuf, strlen(sbuf));
 }
 
 struct json_object* json_object_new_int(int32_t i)
 {
-	struct json_object *jso = json_object_new(json_type_int);
-	if (!jso)
-		return NULL;
-	jso->_to_json_string = &json_object_int_to_json_string;
-	jso->o.c_int64 = i;
-	return jso;
+	return json_object_new_int64_with(json_c_get_allocator(), i);
 }
 
 int32_t json_object_get_int(const struct json_object *jso)
@@ -604,6 +681,7 @@ int32_t json_object_get_int(const struct json_object *jso)
 
   if(!jso) return 0;
 
+  json_object_convert(jso);
   o_type = jso->o_type;
   cint64 = jso->o.c_int64;
 
@@ -613,7 +691,7 @@ int32_t json_object_get_int(const struct json_object *jso)
 	 * Parse strings into 64-bit numbers, then use the
 	 * 64-to-32-bit number handling below.
 	 */
-	if (json_parse_int64(get_string_component(jso), &cint64) != 0)
+	if (json_parse_int64_len(get_string_component(jso), jso->o.c_string.len, &cint64) != 0)
 		return 0; /* whoops, it didn't work. */
 	o_type = json_type_int;
   }
@@ -638,6 +716,7 @@ int32_t json_object_get_int(const struct json_object *jso)
 int json_object_set_int(struct json_object *jso,int new_value){
 	if (!jso || jso->o_type!=json_type_int)
 		return 0;
+	json_object_number_drop_text(jso);
 	jso->o.c_int64=new_value;
 	return 1;
 }
@@ -645,7 +724,13 @@ int json_object_set_int(struct json_object *jso,int new_value){
 
 struct json_object* json_object_new_int64(int64_t i)
 {
-	struct json_object *jso = json_object_new(json_type_int);
+	return json_object_new_int64_with(json_c_get_allocator(), i);
+}
+
+struct json_object* json_object_new_int64_with(const struct json_c_allocator *allocator,
+					       int64_t i)
+{
+	struct json_object *jso = json_object_new(allocator, json_type_int);
 	if (!jso)
 		return NULL;
 	jso->_to_json_string = &json_object_int_to_json_string;
@@ -659,6 +744,7 @@ int64_t json_object_get_int64(const struct json_object *jso)
 
 	if (!jso)
 		return 0;
+	json_object_convert(jso);
 	switch(jso->o_type)
 	{
 	case json_type_int:
@@ -668,7 +754,7 @@ int64_t json_object_get_int64(const struct json_object *jso)
 	case json_type_boolean:
 		return jso->o.c_boolean;
 	case json_type_string:
-		if (json_parse_int64(get_string_component(jso), &cint) == 0)
+		if (json_parse_int64_len(get_string_component(jso), jso->o.c_string.len, &cint) == 0)
 			return cint;
 	default:
 		return 0;
@@ -678,6 +764,7 @@ int64_t json_object_get_int64(const struct json_object *jso)
 int json_object_set_int64(struct json_object *jso,int64_t new_value){
 	if (!jso || jso->o_type!=json_type_int)
 		return 0;
+	json_object_number_drop_text(jso);
 	jso->o.c_int64=new_value;
 	return 1;
 }
@@ -697,6 +784,7 @@ static int json_object_double_to_json_string_format(struct json_object* jso,
      NaN or Infinity as numeric values
      ECMA 262 section 9.8.1 defines
      how to handle these cases as strings */
+  json_object_convert(jso);
   if(isnan(jso->o.c_double))
     size = snprintf(buf, sizeof(buf), "NaN");
   else if(isinf(jso->o.c_double))
@@ -750,7 +838,13 @@ int json_object_double_to_json_string(struct json_object* jso,
 
 struct json_object* json_object_new_double(double d)
 {
-	struct json_object *jso = json_object_new(json_type_double);
+	return json_object_new_double_with(json_c_get_allocator(), d);
+}
+
+struct json_object* json_object_new_double_with(const struct json_c_allocator *allocator,
+						double d)
+{
+	struct json_object *jso = json_object_new(allocator, json_type_double);
 	if (!jso)
 		return NULL;
 	jso->_to_json_string = &json_object_double_to_json_string_default;
@@ -760,11 +854,17 @@ struct json_object* json_object_new_double(double d)
 
 struct json_object* json_object_new_double_s(double d, const char *ds)
 {
-	struct json_object *jso = json_object_new_double(d);
+	return json_object_new_double_s_with(json_c_get_allocator(), d, ds);
+}
+
+struct json_object* json_object_new_double_s_with(const struct json_c_allocator *allocator,
+						  double d, const char *ds)
+{
+	struct json_object *jso = json_object_new_double_with(allocator, d);
 	if (!jso)
 		return NULL;
 
-	char *new_ds = strdup(ds);
+	char *new_ds = json_c_allocator_strdup(jso->_allocator, ds);
 	if (!new_ds)
 	{
 		json_object_generic_delete(jso);
@@ -772,7 +872,7 @@ struct json_object* json_object_new_double_s(double d, const char *ds)
 		return NULL;
 	}
 	json_object_set_serializer(jso, json_object_userdata_to_json_string,
-	    new_ds, json_object_free_userdata);
+	    new_ds, json_object_free_own_userdata);
 	return jso;
 }
 
@@ -789,12 +889,19 @@ void json_object_free_userdata(struct json_object *jso, void *userdata)
 	free(userdata);
 }
 
+/* For userdata json-c allocated itself, i.e. through the json-c allocator */
+static void json_object_free_own_userdata(struct json_object *jso, void *userdata)
+{
+	json_c_allocator_free(jso->_allocator, userdata);
+}
+
 double json_object_get_double(const struct json_object *jso)
 {
   double cdouble;
   char *errPtr = NULL;
 
   if(!jso) return 0.0;
+  json_object_convert(jso);
   switch(jso->o_type) {
   case json_type_double:
     return jso->o.c_double;
@@ -803,6 +910,10 @@ double json_object_get_double(const struct json_object *jso)
   case json_type_boolean:
     return jso->o.c_boolean;
   case json_type_string:
+    /* strtod() needs the terminator; the copy is kept, as by get_string */
+    if (json_object_string_is_borrowed(jso) &&
+        json_object_string_own((struct json_object *)jso) != 0)
+        return 0.0;
     errno = 0;
     cdouble = strtod(get_string_component(jso), &errPtr);
 
@@ -841,10 +952,63 @@ double json_object_get_double(const struct json_object *jso)
 int json_object_set_double(struct json_object *jso,double new_value){
 	if (!jso || jso->o_type!=json_type_double)
 		return 0;
+	json_object_number_drop_text(jso);
 	jso->o.c_double=new_value;
 	return 1;
 }
 
+/* json_object numbers kept as text */
+
+static void json_object_number_text_delete(struct json_object* jso)
+{
+	json_object_generic_delete(jso);
+}
+
+static int json_object_number_text_to_json_string(struct json_object* jso,
+						  struct printbuf *pb,
+						  int level,
+						  int flags)
+{
+	return printbuf_memappend(pb, jso->o.c_number.text, jso->o.c_number.len);
+}
+
+struct json_object* json_object_new_number_text(const struct json_c_allocator *allocator,
+						enum json_type o_type,
+						const char *s, int len)
+{
+	struct json_object *jso = json_object_new(allocator, o_type);
+	if (!jso)
+		return NULL;
+	jso->_delete = &json_object_number_text_delete;
+	jso->_to_json_string = &json_object_number_text_to_json_string;
+	jso->o.c_number.text = s;
+	jso->o.c_number.len = len;
+	return jso;
+}
+
+static void json_object_number_convert(struct json_object *jso)
+{
+	/* The text was checked when it was parsed; the value goes where
+	   c_int64 and c_double are, and the text stays for serializing */
+	if (jso->o_type == json_type_int)
+		json_parse_int64_len(jso->o.c_number.text, jso->o.c_number.len,
+				     &jso->o.c_int64);
+	else
+		json_parse_double_len(jso->o.c_number.text, jso->o.c_number.len,
+				      &jso->o.c_double);
+	jso->_delete = &json_object_generic_delete;
+}
+
+/* A number set to a new value serializes as that value */
+static void json_object_number_drop_text(struct json_object *jso)
+{
+	jso->_delete = &json_object_generic_delete;
+	if (jso->_to_json_string == &json_object_number_text_to_json_string)
+		jso->_to_json_string = (jso->o_type == json_type_int) ?
+			&json_object_int_to_json_string :
+			&json_object_double_to_json_string_default;
+}
+
 /* json_object_string */
 
 static int json_object_string_to_json_string(struct json_object* jso,
@@ -861,13 +1025,39 @@ static int json_object_string_to_json_string(struct json_object* jso,
 static void json_object_string_delete(struct json_object* jso)
 {
 	if(jso->o.c_string.len >= LEN_DIRECT_STRING_DATA)
-		free(jso->o.c_string.str.ptr);
+		json_c_allocator_free(jso->_allocator, jso->o.c_string.str.ptr);
 	json_object_generic_delete(jso);
 }
 
+static void json_object_borrowed_string_delete(struct json_object* jso)
+{
+	json_object_generic_delete(jso);
+}
+
+static void json_object_insitu_string_delete(struct json_object* jso)
+{
+	json_object_generic_delete(jso);
+}
+
+/* Give a borrowed string its own NUL terminated copy */
+static int json_object_string_own(struct json_object *jso)
+{
+	char *copy = (char*)json_c_allocator_malloc(jso->_allocator, jso->o.c_string.len + 1);
+	if (!copy)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	memcpy(copy, jso->o.c_string.str.ptr, jso->o.c_string.len);
+	copy[jso->o.c_string.len] = '\0';
+	jso->o.c_string.str.ptr = copy;
+	jso->_delete = &json_object_string_delete;
+	return 0;
+}
+
 struct json_object* json_object_new_string(const char *s)
 {
-	struct json_object *jso = json_object_new(json_type_string);
+	struct json_object *jso = json_object_new(json_c_get_allocator(), json_type_string);
 	if (!jso)
 		return NULL;
 	jso->_delete = &json_object_string_delete;
@@ -876,7 +1066,7 @@ struct json_object* json_object_new_string(const char *s)
 	if(jso->o.c_string.len < LEN_DIRECT_STRING_DATA) {
 		memcpy(jso->o.c_string.str.data, s, jso->o.c_string.len);
 	} else {
-		jso->o.c_string.str.ptr = strdup(s);
+		jso->o.c_string.str.ptr = json_c_allocator_strdup(jso->_allocator, s);
 		if (!jso->o.c_string.str.ptr)
 		{
 			json_object_generic_delete(jso);
@@ -888,9 +1078,15 @@ struct json_object* json_object_new_string(const char *s)
 }
 
 struct json_object* json_object_new_string_len(const char *s, int len)
+{
+	return json_object_new_string_len_with(json_c_get_allocator(), s, len);
+}
+
+struct json_object* json_object_new_string_len_with(const struct json_c_allocator *allocator,
+						    const char *s, int len)
 {
 	char *dstbuf;
-	struct json_object *jso = json_object_new(json_type_string);
+	struct json_object *jso = json_object_new(allocator, json_type_string);
 	if (!jso)
 		return NULL;
 	jso->_delete = &json_object_string_delete;
@@ -898,7 +1094,7 @@ struct json_object* json_object_new_string_len(const char *s, int len)
 	if(len < LEN_DIRECT_STRING_DATA) {
 		dstbuf = jso->o.c_string.str.data;
 	} else {
-		jso->o.c_string.str.ptr = (char*)malloc(len + 1);
+		jso->o.c_string.str.ptr = (char*)json_c_allocator_malloc(jso->_allocator, len + 1);
 		if (!jso->o.c_string.str.ptr)
 		{
 			json_object_generic_delete(jso);
@@ -913,6 +1109,38 @@ struct json_object* json_object_new_string_len(const char *s, int len)
 	return jso;
 }
 
+struct json_object* json_object_new_string_borrowed(const struct json_c_allocator *allocator,
+						    const char *s, int len)
+{
+	struct json_object *jso;
+	if (len < LEN_DIRECT_STRING_DATA)
+		return json_object_new_string_len_with(allocator, s, len);
+	jso = json_object_new(allocator, json_type_string);
+	if (!jso)
+		return NULL;
+	jso->_delete = &json_object_borrowed_string_delete;
+	jso->_to_json_string = &json_object_string_to_json_string;
+	jso->o.c_string.str.ptr = (char*)s;
+	jso->o.c_string.len = len;
+	return jso;
+}
+
+struct json_object* json_object_new_string_insitu(const struct json_c_allocator *allocator,
+						  char *s, int len)
+{
+	struct json_object *jso;
+	if (len < LEN_DIRECT_STRING_DATA)
+		return json_object_new_string_len_with(allocator, s, len);
+	jso = json_object_new(allocator, json_type_string);
+	if (!jso)
+		return NULL;
+	jso->_delete = &json_object_insitu_string_delete;
+	jso->_to_json_string = &json_object_string_to_json_string;
+	jso->o.c_string.str.ptr = s;
+	jso->o.c_string.len = len;
+	return jso;
+}
+
 const char* json_object_get_string(struct json_object *jso)
 {
 	if (!jso)
@@ -920,6 +1148,8 @@ const char* json_object_get_string(struct json_object *jso)
 	switch(jso->o_type)
 	{
 	case json_type_string:
+		if (json_object_string_is_borrowed(jso) && json_object_string_own(jso) != 0)
+			return NULL;
 		return get_string_component(jso);
 	default:
 		return json_object_to_json_string(jso);
@@ -946,15 +1176,17 @@ int json_object_set_string(json_object* jso, const char* s) {
 int json_object_set_string_len(json_object* jso, const char* s, int len){
 	if (jso==NULL || jso->o_type!=json_type_string) return 0; 	
 	char *dstbuf; 
+	int owned = (jso->o.c_string.len >= LEN_DIRECT_STRING_DATA && jso->_delete == &json_object_string_delete);
 	if (len<LEN_DIRECT_STRING_DATA) {
 		dstbuf=jso->o.c_string.str.data;
-		if (jso->o.c_string.len>=LEN_DIRECT_STRING_DATA) free(jso->o.c_string.str.ptr); 
+		if (owned) json_c_allocator_free(jso->_allocator, jso->o.c_string.str.ptr); 
 	} else {
-		dstbuf=(char *)malloc(len+1);
+		dstbuf=(char *)json_c_allocator_malloc(jso->_allocator, len+1);
 		if (dstbuf==NULL) return 0;
-		if (jso->o.c_string.len>=LEN_DIRECT_STRING_DATA) free(jso->o.c_string.str.ptr);
+		if (owned) json_c_allocator_free(jso->_allocator, jso->o.c_string.str.ptr);
 		jso->o.c_string.str.ptr=dstbuf;
 	}
+	jso->_delete = &json_object_string_delete;
 	jso->o.c_string.len=len;
 	memcpy(dstbuf, (const void *)s, len);
 	dstbuf[len] = '\0';
@@ -1019,15 +1251,20 @@ static void json_object_array_delete(struct json_object* jso)
 
 struct json_object* json_object_new_array(void)
 {
-	struct json_object *jso = json_object_new(json_type_array);
+	return json_object_new_array_with(json_c_get_allocator());
+}
+
+struct json_object* json_object_new_array_with(const struct json_c_allocator *allocator)
+{
+	struct json_object *jso = json_object_new(allocator, json_type_array);
 	if (!jso)
 		return NULL;
 	jso->_delete = &json_object_array_delete;
 	jso->_to_json_string = &json_object_array_to_json_string;
-	jso->o.c_array = array_list_new(&json_object_array_entry_free);
+	jso->o.c_array = array_list_new_with(allocator, &json_object_array_entry_free);
         if(jso->o.c_array == NULL)
 	{
-	    free(jso);
+	    json_c_slab_free(jso->_allocator, jso);
 	    return NULL;
 	}
 	return jso;
@@ -1040,6 +1277,8 @@ struct array_list* json_object_get_array(const struct json_object *jso)
 	switch(jso->o_type)
 	{
 	case json_type_array:
+		if (json_object_build(jso) != 0)
+			return NULL;
 		return jso->o.c_array;
 	default:
 		return NULL;
@@ -1050,6 +1289,8 @@ void json_object_array_sort(struct json_object *jso,
 			    int(*sort_fn)(const void *, const void *))
 {
 	assert(json_object_get_type(jso) == json_type_array);
+	if (json_object_build(jso) != 0)
+		return;
 	array_list_sort(jso->o.c_array, sort_fn);
 }
 
@@ -1061,6 +1302,8 @@ struct json_object* json_object_array_bsearch(
 	struct json_object **result;
 
 	assert(json_object_get_type(jso) == json_type_array);
+	if (json_object_build(jso) != 0)
+		return NULL;
 	result = (struct json_object **)array_list_bsearch(
 			(const void **)&key, jso->o.c_array, sort_fn);
 
@@ -1072,12 +1315,16 @@ struct json_object* json_object_array_bsearch(
 size_t json_object_array_length(const struct json_object *jso)
 {
 	assert(json_object_get_type(jso) == json_type_array);
+	if (json_object_build(jso) != 0)
+		return 0;
 	return array_list_length(jso->o.c_array);
 }
 
 int json_object_array_add(struct json_object *jso,struct json_object *val)
 {
 	assert(json_object_get_type(jso) == json_type_array);
+	if (json_object_build(jso) != 0)
+		return -1;
 	return array_list_add(jso->o.c_array, val);
 }
 
@@ -1085,12 +1332,16 @@ int json_object_array_put_idx(struct json_object *jso, size_t idx,
 			      struct json_object *val)
 {
 	assert(json_object_get_type(jso) == json_type_array);
+	if (json_object_build(jso) != 0)
+		return -1;
 	return array_list_put_idx(jso->o.c_array, idx, val);
 }
 
 int json_object_array_del_idx(struct json_object *jso, size_t idx, size_t count)
 {
 	assert(json_object_get_type(jso) == json_type_array);
+	if (json_object_build(jso) != 0)
+		return -1;
 	return array_list_del_idx(jso->o.c_array, idx, count);
 }
 
@@ -1098,9 +1349,64 @@ struct json_object* json_object_array_get_idx(const struct json_object *jso,
 					      size_t idx)
 {
 	assert(json_object_get_type(jso) == json_type_array);
+	if (json_object_build(jso) != 0)
+		return NULL;
 	return (struct json_object*)array_list_get_idx(jso->o.c_array, idx);
 }
 
+/* json_object lazy containers */
+
+static void json_object_lazy_delete(struct json_object* jso)
+{
+	json_object_generic_delete(jso);
+}
+
+static int json_object_lazy_to_json_string(struct json_object* jso,
+					   struct printbuf *pb,
+					   int level,
+					   int flags)
+{
+	return printbuf_memappend(pb, jso->o.c_lazy.text, jso->o.c_lazy.len);
+}
+
+struct json_object* json_object_new_lazy(const struct json_c_allocator *allocator,
+					 enum json_type o_type, const char *s,
+					 int len, int flags)
+{
+	struct json_object *jso = json_object_new(allocator, o_type);
+	if (!jso)
+		return NULL;
+	jso->_delete = &json_object_lazy_delete;
+	jso->_to_json_string = &json_object_lazy_to_json_string;
+	jso->o.c_lazy.text = s;
+	jso->o.c_lazy.len = len;
+	jso->o.c_lazy.flags = flags;
+	return jso;
+}
+
+static int json_object_lazy_build(struct json_object *jso)
+{
+	struct json_object *built;
+
+	/* The members come from the allocator the container came from */
+	built = json_tokener_build_lazy(jso->_allocator, jso->o.c_lazy.text,
+					jso->o.c_lazy.len, jso->o.c_lazy.flags);
+	/* The text was validated when it was parsed, only memory can fail */
+	if (!built)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+
+	/* Take over the members and let go of the rest of built */
+	jso->o = built->o;
+	jso->_delete = built->_delete;
+	if (jso->_to_json_string == &json_object_lazy_to_json_string)
+		jso->_to_json_string = built->_to_json_string;
+	json_object_generic_delete(built);
+	return 0;
+}
+
 static int json_array_equal(struct json_object* jso1,
 			    struct json_object* jso2)
 {
@@ -1126,6 +1432,8 @@ static int json_object_all_values_equal(struct json_object* jso1,
 
 	assert(json_object_get_type(jso1) == json_type_object);
 	assert(json_object_get_type(jso2) == json_type_object);
+	if (json_object_build(jso1) != 0 || json_object_build(jso2) != 0)
+		return 0;
 	/* Iterate over jso1 keys and see if they exist and are equal in jso2 */
         json_object_object_foreachC(jso1, iter) {
 		if (!lh_table_lookup_ex(jso2->o.c_object, (void*)iter.key,
@@ -1161,9 +1469,13 @@ int json_object_equal(struct json_object* jso1, struct json_object* jso2)
 			return (jso1->o.c_boolean == jso2->o.c_boolean);
 
 		case json_type_double:
+			json_object_convert(jso1);
+			json_object_convert(jso2);
 			return (jso1->o.c_double == jso2->o.c_double);
 
 		case json_type_int:
+			json_object_convert(jso1);
+			json_object_convert(jso2);
 			return (jso1->o.c_int64 == jso2->o.c_int64);
 
 		case json_type_string:
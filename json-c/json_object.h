@@ -158,6 +158,10 @@ typedef enum json_type {
  * Increment the reference count of json_object, thereby grabbing shared
  * ownership of obj.
  *
+ * Objects allocated from an arena are not reference counted, they live
+ * until the arena is reset or freed: json_object_get() and
+ * json_object_put() have no effect on them.
+ *
  * @param obj the json_object instance
  */
 extern struct json_object* json_object_get(struct json_object *obj);
@@ -167,6 +171,10 @@ extern struct json_object* json_object_get(struct json_object *obj);
  * You must have ownership of obj prior to doing this or you will cause an
  * imbalance in the reference count.
  *
+ * Objects allocated from an arena are never freed here, nor are their
+ * delete callbacks run.  Objects from other allocators that were added to
+ * them are never released either, so keep a tree in one arena.
+ *
  * @param obj the json_object instance
  * @returns 1 if the object was freed.
  */
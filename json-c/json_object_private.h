@@ -43,11 +43,84 @@ struct json_object
 	} str;
         int len;
     } c_string;
+    struct {
+	const char *text; /* from the opening to past the closing bracket */
+	int len;
+	int flags; /* of the tokener that found it */
+    } c_lazy;
+    struct {
+	int64_t value; /* c_int64 or c_double once converted */
+	const char *text;
+	int len;
+    } c_number;
   } o;
   json_object_delete_fn *_user_delete;
   void *_userdata;
+  const struct json_c_allocator *_allocator; /* current at creation, owns the object's memory */
 };
 
+/*
+ * The public constructors with the allocator to take the object from
+ * passed in instead of the current one, for the tokener to build its tree
+ * without changing the current allocator.
+ */
+struct json_object* json_object_new_object_with(const struct json_c_allocator *allocator);
+struct json_object* json_object_new_array_with(const struct json_c_allocator *allocator);
+struct json_object* json_object_new_boolean_with(const struct json_c_allocator *allocator,
+						 json_bool b);
+struct json_object* json_object_new_int64_with(const struct json_c_allocator *allocator,
+					       int64_t i);
+struct json_object* json_object_new_double_with(const struct json_c_allocator *allocator,
+						double d);
+struct json_object* json_object_new_double_s_with(const struct json_c_allocator *allocator,
+						  double d, const char *ds);
+struct json_object* json_object_new_string_len_with(const struct json_c_allocator *allocator,
+						    const char *s, int len);
+
+/*
+ * A string object that points at len bytes of s instead of copying them;
+ * s has to outlive the object. Strings short enough to be stored in the
+ * object itself are copied anyway. The first json_object_get_string()
+ * makes a NUL terminated copy.
+ */
+struct json_object* json_object_new_string_borrowed(const struct json_c_allocator *allocator,
+						    const char *s, int len);
+
+/*
+ * Like json_object_new_string_borrowed(), for a string already NUL
+ * terminated at s[len], as json_tokener_parse_insitu() leaves them.
+ * Accessors use it directly, without a copy.
+ */
+struct json_object* json_object_new_string_insitu(const struct json_c_allocator *allocator,
+						  char *s, int len);
+
+/*
+ * An int or double object that is the len bytes of s until it is first
+ * read, see JSON_TOKENER_LAZY_NUMBERS. s has to outlive the object and
+ * must be a number as JSON writes it, so converting it cannot fail.
+ */
+struct json_object* json_object_new_number_text(const struct json_c_allocator *allocator,
+						enum json_type o_type,
+						const char *s, int len);
+
+/*
+ * An object or array that is only the len bytes of its text at s, see
+ * JSON_TOKENER_LAZY; s has to outlive the object. The first accessor
+ * that needs its members builds them with json_tokener_build_lazy().
+ * Until then it serializes as its text.
+ */
+struct json_object* json_object_new_lazy(const struct json_c_allocator *allocator,
+					 enum json_type o_type, const char *s,
+					 int len, int flags);
+
+/*
+ * Parses the len bytes at s, which hold an object or array, with flags
+ * into allocator and returns it with its members built and their
+ * containers lazy. NULL if s is not valid.
+ */
+struct json_object* json_tokener_build_lazy(const struct json_c_allocator *allocator,
+					    const char *s, int len, int flags);
+
 #ifdef __cplusplus
 }
 #endif
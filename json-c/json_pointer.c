@@ -16,8 +16,8 @@
 #include <ctype.h>
 
 #include "json_pointer.h"
-#include "strdup_compat.h"
-#include "vasprintf_compat.h"
+#include "json_pointer_private.h"
+#include "json_allocator.h"
 
 /**
  * JavaScript Object Notation (JSON) Pointer
@@ -185,12 +185,12 @@ int json_pointer_get(struct json_object *obj, const char *path, struct json_obje
 	}
 
 	/* pass a working copy to the recursive call */
-	if (!(path_copy = strdup(path))) {
+	if (!(path_copy = json_c_strdup(path))) {
 		errno = ENOMEM;
 		return -1;
 	}
 	rc = json_pointer_get_recursive(obj, path_copy, res);
-	free(path_copy);
+	json_c_free(path_copy);
 
 	return rc;
 }
@@ -207,11 +207,20 @@ int json_pointer_getf(struct json_object *obj, struct json_object **res, const c
 	}
 
 	va_start(args, path_fmt);
-	rc = vasprintf(&path_copy, path_fmt, args);
+	rc = vsnprintf(NULL, 0, path_fmt, args);
 	va_end(args);
-
 	if (rc < 0)
 		return rc;
+	if (!(path_copy = (char *)json_c_malloc(rc + 1))) {
+		errno = ENOMEM;
+		return -1;
+	}
+	va_start(args, path_fmt);
+	rc = vsnprintf(path_copy, rc + 1, path_fmt, args);
+	va_end(args);
+
+	if (rc < 0)
+		goto out;
 
 	if (path_copy[0] == '\0') {
 		if (res)
@@ -221,7 +230,7 @@ int json_pointer_getf(struct json_object *obj, struct json_object **res, const c
 
 	rc = json_pointer_get_recursive(obj, path_copy, res);
 out:
-	free(path_copy);
+	json_c_free(path_copy);
 
 	return rc;
 }
@@ -256,13 +265,13 @@ int json_pointer_set(struct json_object **obj, const char *path, struct json_obj
 	}
 
 	/* pass a working copy to the recursive call */
-	if (!(path_copy = strdup(path))) {
+	if (!(path_copy = json_c_strdup(path))) {
 		errno = ENOMEM;
 		return -1;
 	}
 	path_copy[endp - path] = '\0';
 	rc = json_pointer_get_recursive(*obj, path_copy, &set);
-	free(path_copy);
+	json_c_free(path_copy);
 
 	if (rc)
 		return rc;
@@ -286,11 +295,20 @@ int json_pointer_setf(struct json_object **obj, struct json_object *value, const
 
 	/* pass a working copy to the recursive call */
 	va_start(args, path_fmt);
-	rc = vasprintf(&path_copy, path_fmt, args);
+	rc = vsnprintf(NULL, 0, path_fmt, args);
 	va_end(args);
-
 	if (rc < 0)
 		return rc;
+	if (!(path_copy = (char *)json_c_malloc(rc + 1))) {
+		errno = ENOMEM;
+		return -1;
+	}
+	va_start(args, path_fmt);
+	rc = vsnprintf(path_copy, rc + 1, path_fmt, args);
+	va_end(args);
+
+	if (rc < 0)
+		goto out;
 
 	if (path_copy[0] == '\0') {
 		json_object_put(*obj);
@@ -320,7 +338,118 @@ set_single_path:
 	endp++;
 	rc = json_pointer_set_single_path(set, endp, value);
 out:
-	free(path_copy);
+	json_c_free(path_copy);
 	return rc;
 }
 
+/* The token as an array index, or -1 if it is not a valid one */
+static int32_t json_pointer_token_index(const char *token, size_t len)
+{
+	int32_t idx = 0;
+	size_t i;
+
+	/* leading zeros not allowed per RFC */
+	if (len == 0 || (len > 1 && token[0] == '0'))
+		return -1;
+	for (i = 0; i < len; i++) {
+		if (!isdigit((int)token[i]) || idx > (INT32_MAX - (token[i] - '0')) / 10)
+			return -1;
+		idx = idx * 10 + (token[i] - '0');
+	}
+	return idx;
+}
+
+struct json_pointer_matcher *json_pointer_matcher_new(const char *const *paths, int count)
+{
+	struct json_pointer_matcher *matcher;
+	size_t key_bytes = 0;
+	char *keys;
+	int i, max_nodes = 1;
+
+	if (!paths || count < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	for (i = 0; i < count; i++) {
+		const char *p;
+		/* All paths are either "" or start with a '/' */
+		if (!paths[i] || (paths[i][0] != '\0' && paths[i][0] != '/')) {
+			errno = EINVAL;
+			return NULL;
+		}
+		for (p = paths[i]; *p; p++)
+			if (*p == '/')
+				max_nodes++;
+		key_bytes += p - paths[i] + 1;
+	}
+
+	matcher = (struct json_pointer_matcher *)json_c_calloc(1, sizeof(*matcher));
+	if (!matcher) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	matcher->nodes = (struct json_pointer_node *)json_c_calloc(max_nodes, sizeof(*matcher->nodes));
+	matcher->keys = keys = (char *)json_c_malloc(key_bytes);
+	if (!matcher->nodes || !matcher->keys) {
+		json_pointer_matcher_free(matcher);
+		errno = ENOMEM;
+		return NULL;
+	}
+	matcher->nodes[0].index = -1;
+	matcher->count = 1;
+
+	for (i = 0; i < count; i++) {
+		const char *p = paths[i];
+		int node = 0;
+
+		while (*p == '/') {
+			const char *key = keys;
+			size_t key_len;
+			int child, last = 0;
+
+			/* Decode ~1 and ~0 in one pass, so "~01" stays "~1" */
+			for (p++; *p && *p != '/'; p++) {
+				if (p[0] == '~' && p[1] == '1') {
+					*keys++ = '/';
+					p++;
+				} else if (p[0] == '~' && p[1] == '0') {
+					*keys++ = '~';
+					p++;
+				} else
+					*keys++ = *p;
+			}
+			key_len = keys - key;
+			*keys++ = '\0';
+
+			for (child = matcher->nodes[node].child; child; child = matcher->nodes[child].next) {
+				if (matcher->nodes[child].key_len == key_len &&
+				    memcmp(matcher->nodes[child].key, key, key_len) == 0)
+					break;
+				last = child;
+			}
+			if (!child) {
+				child = matcher->count++;
+				matcher->nodes[child].key = key;
+				matcher->nodes[child].key_len = key_len;
+				matcher->nodes[child].index = json_pointer_token_index(key, key_len);
+				if (last)
+					matcher->nodes[last].next = child;
+				else
+					matcher->nodes[node].child = child;
+			}
+			node = child;
+		}
+		matcher->nodes[node].selected = 1;
+	}
+
+	return matcher;
+}
+
+void json_pointer_matcher_free(struct json_pointer_matcher *matcher)
+{
+	if (!matcher)
+		return;
+	json_c_free(matcher->nodes);
+	json_c_free(matcher->keys);
+	json_c_free(matcher);
+}
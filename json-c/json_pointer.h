@@ -107,6 +107,30 @@ int json_pointer_set(struct json_object **obj, const char *path, struct json_obj
  */
 int json_pointer_setf(struct json_object **obj, struct json_object *value, const char *path_fmt, ...);
 
+/**
+ * A set of JSON pointers compiled for json_tokener_parse_selected(), which
+ * builds only the values they point to and the containers on the way.
+ */
+struct json_pointer_matcher;
+
+/**
+ * Compiles 'count' RFC 6901 paths into a matcher. The paths are not
+ * printf() formats and are copied. The "" path selects the whole document,
+ * and a path that is a prefix of another one selects everything below it.
+ *
+ * @param paths the JSON pointers to select
+ * @param count how many there are in 'paths'
+ *
+ * @return the matcher, or NULL with errno set if a path does not start with
+ *   a '/' (EINVAL) or memory runs out (ENOMEM)
+ */
+struct json_pointer_matcher *json_pointer_matcher_new(const char *const *paths, int count);
+
+/**
+ * Frees a matcher from 'json_pointer_matcher_new()'. NULL is ignored.
+ */
+void json_pointer_matcher_free(struct json_pointer_matcher *matcher);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2017 json-c contributors
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See COPYING for details.
+ *
+ */
+
+#ifndef _json_pointer_private_h_
+#define _json_pointer_private_h_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A compiled set of JSON pointers is the tree of their reference tokens.
+ * nodes[0] stands for the whole document and is nobody's child, so 0
+ * also means "none" in child and next.  The children of a node are
+ * chained through next in the order the paths were given.
+ */
+struct json_pointer_node
+{
+	const char *key;	/* the unescaped token, NUL terminated, in keys */
+	size_t key_len;
+	int32_t index;		/* the token as an array index, -1 if it is none */
+	int selected;		/* a path ends here: the whole value is wanted */
+	int child;
+	int next;
+};
+
+struct json_pointer_matcher
+{
+	struct json_pointer_node *nodes;
+	int count;
+	char *keys;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
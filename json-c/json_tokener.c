@@ -20,7 +20,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
-#include <ctype.h>
 #include <string.h>
 #include <limits.h>
 
@@ -29,15 +28,27 @@
 #include "arraylist.h"
 #include "json_inttypes.h"
 #include "json_object.h"
+#include "json_object_private.h"
+#include "json_pointer_private.h"
 #include "json_tokener.h"
+#include "json_allocator.h"
+#include "json_allocator_private.h"
 #include "json_util.h"
 #include "strdup_compat.h"
 
-#ifdef HAVE_LOCALE_H
-#include <locale.h>
-#endif /* HAVE_LOCALE_H */
-#ifdef HAVE_XLOCALE_H
-#include <xlocale.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define JSON_TOKENER_AVX2
+#define JSON_TOKENER_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define JSON_TOKENER_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define JSON_TOKENER_NEON
+#endif
+#if defined(_MSC_VER) && (defined(JSON_TOKENER_SSE2) || defined(JSON_TOKENER_NEON))
+#include <intrin.h>
 #endif
 
 #define jt_hexdigit(x) (((x) <= '9') ? (x) - '0' : ((x) & 7) + 9)
@@ -73,7 +84,9 @@ static const char* json_tokener_errors[] = {
   "object value separator ',' expected",
   "invalid string sequence",
   "expected comment",
-  "buffer size overflow"
+  "buffer size overflow",
+  "stopped by an event callback",
+  "invalid UTF-8 sequence"
 };
 
 const char *json_tokener_error_desc(enum json_tokener_error jerr)
@@ -97,24 +110,38 @@ enum json_tokener_error json_tokener_get_error(json_tokener *tok)
 #define DECODE_SURROGATE_PAIR(hi,lo) ((((hi) & 0x3FF) << 10) + ((lo) & 0x3FF) + 0x10000)
 static unsigned char utf8_replacement_char[3] = { 0xEF, 0xBF, 0xBD };
 
-struct json_tokener* json_tokener_new_ex(int depth)
+/* The tokener's own state comes from allocator */
+static struct json_tokener* json_tokener_new_with(const struct json_c_allocator *allocator,
+						 int depth)
 {
   struct json_tokener *tok;
 
-  tok = (struct json_tokener*)calloc(1, sizeof(struct json_tokener));
+  tok = (struct json_tokener*)json_c_allocator_calloc(allocator, 1, sizeof(struct json_tokener));
   if (!tok) return NULL;
-  tok->stack = (struct json_tokener_srec *) calloc(depth,
+  tok->stack = (struct json_tokener_srec *) json_c_allocator_calloc(allocator, depth,
 						   sizeof(struct json_tokener_srec));
   if (!tok->stack) {
-    free(tok);
+    json_c_allocator_free(allocator, tok);
     return NULL;
   }
-  tok->pb = printbuf_new();
+  tok->own_allocator = allocator;
+  tok->pb = printbuf_new_with(allocator);
   tok->max_depth = depth;
   json_tokener_reset(tok);
   return tok;
 }
 
+struct json_tokener* json_tokener_new_ex(int depth)
+{
+  return json_tokener_new_with(json_c_get_allocator(), depth);
+}
+
+/* Where the objects tok parses come from, passed to every constructor */
+static inline const struct json_c_allocator *json_tokener_object_allocator(struct json_tokener *tok)
+{
+  return tok->allocator ? tok->allocator : json_c_get_allocator();
+}
+
 struct json_tokener* json_tokener_new(void)
 {
   return json_tokener_new_ex(JSON_TOKENER_DEFAULT_DEPTH);
@@ -123,9 +150,11 @@ struct json_tokener* json_tokener_new(void)
 void json_tokener_free(struct json_tokener *tok)
 {
   json_tokener_reset(tok);
+  if (tok->checker) json_tokener_free(tok->checker);
   if (tok->pb) printbuf_free(tok->pb);
-  free(tok->stack);
-  free(tok);
+  json_c_allocator_free(tok->own_allocator, tok->structurals);
+  json_c_allocator_free(tok->own_allocator, tok->stack);
+  json_c_allocator_free(tok->own_allocator, tok);
 }
 
 static void json_tokener_reset_level(struct json_tokener *tok, int depth)
@@ -134,7 +163,8 @@ static void json_tokener_reset_level(struct json_tokener *tok, int depth)
   tok->stack[depth].saved_state = json_tokener_state_start;
   json_object_put(tok->stack[depth].current);
   tok->stack[depth].current = NULL;
-  free(tok->stack[depth].obj_field_name);
+  if (!tok->insitu_buf)
+    json_c_allocator_free(tok->own_allocator, tok->stack[depth].obj_field_name);
   tok->stack[depth].obj_field_name = NULL;
 }
 
@@ -148,6 +178,7 @@ void json_tokener_reset(struct json_tokener *tok)
     json_tokener_reset_level(tok, i);
   tok->depth = 0;
   tok->err = json_tokener_success;
+  tok->insitu_buf = tok->insitu_start = tok->insitu_out = NULL;
 }
 
 struct json_object* json_tokener_parse(const char *str)
@@ -179,10 +210,61 @@ struct json_object* json_tokener_parse_verbose(const char *str,
     return obj;
 }
 
-#define state  tok->stack[tok->depth].state
-#define saved_state  tok->stack[tok->depth].saved_state
-#define current tok->stack[tok->depth].current
-#define obj_field_name tok->stack[tok->depth].obj_field_name
+struct json_object* json_tokener_parse_arena(const char *str, struct json_c_arena *arena)
+{
+    const struct json_c_allocator *allocator = json_c_arena_allocator(arena);
+    struct json_tokener* tok;
+    struct json_object* obj = NULL;
+
+    /* The tokener's state dies with the tree, take it from the arena too */
+    tok = json_tokener_new_with(allocator, JSON_TOKENER_DEFAULT_DEPTH);
+    if (tok)
+    {
+      tok->allocator = allocator;
+      obj = json_tokener_parse_ex(tok, str, -1);
+      if (tok->err != json_tokener_success)
+        obj = NULL;
+      json_tokener_free(tok);
+    }
+    return obj;
+}
+
+struct json_object* json_tokener_parse_insitu(char *buf, size_t len)
+{
+    struct json_tokener* tok;
+    struct json_object* obj;
+
+    if (len > INT32_MAX)
+      return NULL;
+    tok = json_tokener_new();
+    if (!tok)
+      return NULL;
+    tok->insitu_buf = buf;
+    obj = json_tokener_parse_ex(tok, buf, (int)len);
+    /* A number or literal right at the end is only complete once it sees
+       the end.  Anything else still open is truncated input. */
+    if (tok->err == json_tokener_continue)
+    {
+      switch (tok->stack[tok->depth].state)
+      {
+      case json_tokener_state_number:
+      case json_tokener_state_boolean:
+      case json_tokener_state_null:
+      case json_tokener_state_inf:
+        obj = json_tokener_parse_ex(tok, "", 1);
+        break;
+      default:
+        break;
+      }
+    }
+    if (tok->err != json_tokener_success)
+    {
+      json_object_put(obj);
+      obj = NULL;
+    }
+    json_tokener_free(tok);
+    return obj;
+}
 
 /* Optimization:
  * json_tokener_parse_ex() consumed a lot of CPU in its main loop,
@@ -224,20 +306,1124 @@ struct json_object* json_tokener_parse_verbose(const char *str,
   ( ++(str), ((tok)->char_offset)++, c)
 
 
+#if defined(JSON_TOKENER_SSE2) || defined(JSON_TOKENER_NEON)
+/* Index of the lowest set bit, mask must not be 0 */
+static unsigned int json_tokener_ctz(unsigned long long mask)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  if ((unsigned long)mask) {
+    _BitScanForward(&index, (unsigned long)mask);
+    return index;
+  }
+  _BitScanForward(&index, (unsigned long)(mask >> 32));
+  return index + 32;
+#else
+  return __builtin_ctzll(mask);
+#endif
+}
+#endif
+
+/* json_tokener_string_run():
+ *   Returns how many of the n bytes at s can be copied into a string as they
+ *   are, i.e. the distance to the next quote, backslash or control character.
+ *   Whole blocks are checked with SSE2/AVX2/NEON where available, the rest
+ *   byte by byte.
+ */
+static size_t json_tokener_string_run(const char *s, size_t n, char quote)
+{
+  size_t i = 0;
+#if defined(JSON_TOKENER_AVX2)
+  const __m256i quote32 = _mm256_set1_epi8(quote);
+  const __m256i backslash32 = _mm256_set1_epi8('\\');
+  const __m256i control32 = _mm256_set1_epi8(0x1F);
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(s + i));
+    __m256i hit = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(x, quote32), _mm256_cmpeq_epi8(x, backslash32)),
+      _mm256_cmpeq_epi8(_mm256_min_epu8(x, control32), x));
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+    if (mask) return i + json_tokener_ctz(mask);
+  }
+#endif
+#if defined(JSON_TOKENER_SSE2)
+  {
+    const __m128i quote16 = _mm_set1_epi8(quote);
+    const __m128i backslash16 = _mm_set1_epi8('\\');
+    const __m128i control16 = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= n; i += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+      /* Unsigned x <= 0x1F exactly where min(x, 0x1F) == x */
+      __m128i hit = _mm_or_si128(
+	_mm_or_si128(_mm_cmpeq_epi8(x, quote16), _mm_cmpeq_epi8(x, backslash16)),
+	_mm_cmpeq_epi8(_mm_min_epu8(x, control16), x));
+      unsigned int mask = (unsigned int)_mm_movemask_epi8(hit);
+      if (mask) return i + json_tokener_ctz(mask);
+    }
+  }
+#elif defined(JSON_TOKENER_NEON)
+  {
+    const uint8x16_t quote16 = vdupq_n_u8((uint8_t)quote);
+    const uint8x16_t backslash16 = vdupq_n_u8('\\');
+    const uint8x16_t control16 = vdupq_n_u8(0x20);
+    for (; i + 16 <= n; i += 16) {
+      uint8x16_t x = vld1q_u8((const uint8_t *)(s + i));
+      uint8x16_t hit = vorrq_u8(vorrq_u8(vceqq_u8(x, quote16), vceqq_u8(x, backslash16)),
+				vcltq_u8(x, control16));
+      /* No movemask on NEON: narrow every byte to a nibble instead */
+      uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+	vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+      if (mask) return i + (json_tokener_ctz(mask) >> 2);
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    unsigned char ch = (unsigned char)s[i];
+    if (ch == (unsigned char)quote || ch == '\\' || ch < 0x20)
+      break;
+  }
+  return i;
+}
+
+/* Character classes, indexed by the unsigned byte. Whitespace is the same
+ * set isspace() has in the C locale, without the per-byte locale lookup;
+ * the number and hex classes are json_number_chars and json_hex_chars.
+ * Delimiters are what may follow a bare value in strict JSON: its four
+ * whitespace characters, a quote and the six structural characters.
+ */
+#define JT_CLASS_SPACE 0x01
+#define JT_CLASS_NUMBER 0x02
+#define JT_CLASS_HEX 0x04
+#define JT_CLASS_DELIM 0x08
+
+static const unsigned char json_tokener_char_class[256] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 9, 9, 1, 1, 9, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  9, 0, 8, 0, 0, 0, 0, 0, 0, 0, 0, 2, 8, 2, 2, 0,
+  6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 8, 0, 0, 0, 0, 0,
+  0, 4, 4, 4, 4, 6, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 8, 0, 8, 0, 0,
+  0, 4, 4, 4, 4, 6, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 8, 0, 8, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+#define jt_isspace(c) (json_tokener_char_class[(unsigned char)(c)] & JT_CLASS_SPACE)
+#define jt_isnumber(c) (json_tokener_char_class[(unsigned char)(c)] & JT_CLASS_NUMBER)
+#define jt_ishex(c) (json_tokener_char_class[(unsigned char)(c)] & JT_CLASS_HEX)
+#define jt_isdelim(c) (json_tokener_char_class[(unsigned char)(c)] & JT_CLASS_DELIM)
+
+/* json_tokener_space_run():
+ *   Returns how many of the n bytes at s are whitespace before the first
+ *   byte that is not. Runs in pretty-printed input are mostly a newline
+ *   and indentation, so blocks are only checked past the first two bytes.
+ */
+static size_t json_tokener_space_run(const char *s, size_t n)
+{
+  size_t i = 0;
+  while (i < n && i < 2) {
+    if (!jt_isspace(s[i])) return i;
+    i++;
+  }
+#if defined(JSON_TOKENER_AVX2)
+  {
+    const __m256i space32 = _mm256_set1_epi8(' ');
+    const __m256i tab32 = _mm256_set1_epi8('\t');
+    const __m256i range32 = _mm256_set1_epi8('\r' - '\t');
+    for (; i + 32 <= n; i += 32) {
+      __m256i x = _mm256_loadu_si256((const __m256i *)(s + i));
+      __m256i y = _mm256_sub_epi8(x, tab32);
+      __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(x, space32),
+				   _mm256_cmpeq_epi8(_mm256_min_epu8(y, range32), y));
+      unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(ws);
+      if (mask) return i + json_tokener_ctz(mask);
+    }
+  }
+#endif
+#if defined(JSON_TOKENER_SSE2)
+  {
+    const __m128i space16 = _mm_set1_epi8(' ');
+    const __m128i tab16 = _mm_set1_epi8('\t');
+    const __m128i range16 = _mm_set1_epi8('\r' - '\t');
+    for (; i + 16 <= n; i += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+      /* '\t'..'\r' is one range: x - '\t' <= 4 unsigned */
+      __m128i y = _mm_sub_epi8(x, tab16);
+      __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(x, space16),
+				_mm_cmpeq_epi8(_mm_min_epu8(y, range16), y));
+      unsigned int mask = ~(unsigned int)_mm_movemask_epi8(ws) & 0xFFFF;
+      if (mask) return i + json_tokener_ctz(mask);
+    }
+  }
+#elif defined(JSON_TOKENER_NEON)
+  {
+    const uint8x16_t space16 = vdupq_n_u8(' ');
+    const uint8x16_t tab16 = vdupq_n_u8('\t');
+    const uint8x16_t range16 = vdupq_n_u8('\r' - '\t');
+    for (; i + 16 <= n; i += 16) {
+      uint8x16_t x = vld1q_u8((const uint8_t *)(s + i));
+      uint8x16_t other = vmvnq_u8(vorrq_u8(vceqq_u8(x, space16),
+					   vcleq_u8(vsubq_u8(x, tab16), range16)));
+      uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+	vshrn_n_u16(vreinterpretq_u16_u8(other), 4)), 0);
+      if (mask) return i + (json_tokener_ctz(mask) >> 2);
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    if (!jt_isspace(s[i]))
+      break;
+  }
+  return i;
+}
+
+/* SKIP_STRING_RUN() macro:
+ *   Moves str and tok->char_offset over the bytes that need no attention
+ *   inside a string. The caller appends everything from case_start on in
+ *   one go, so nothing is copied here.
+ *   Implicit inputs:  end var
+ */
+#define SKIP_STRING_RUN(str, tok) \
+  do { \
+    size_t run = json_tokener_string_run((str), end - (str), (tok)->quote_char); \
+    (str) += run; \
+    (tok)->char_offset += (int)run; \
+  } while (0)
+
+/* STRING_APPEND() macro:
+ *   Adds decoded bytes to the string being parsed: to tok->pb, or when
+ *   parsing in place, at the write position in the input. Decoding never
+ *   makes a string longer, so that position never passes str.
+ */
+#define STRING_APPEND(tok, data, n) \
+  do { \
+    if ((tok)->insitu_buf) { \
+      if ((const char *)(tok)->insitu_out != (const char *)(data)) \
+	memmove((tok)->insitu_out, (data), (n)); \
+      (tok)->insitu_out += (n); \
+    } else \
+      printbuf_memappend_fast((tok)->pb, (data), (n)); \
+  } while (0)
+
+/* EMIT() macro:
+ *   Passes a value to the event callbacks instead of building an object.
+ *   Sets tok->err and leaves the parse if the callback returns non-zero.
+ *   Implicit inputs:  tok var
+ */
+#define EMIT(callback, args) \
+  do { \
+    if (tok->events->callback && tok->events->callback args != 0) { \
+      tok->err = json_tokener_error_aborted; \
+      goto out; \
+    } \
+  } while (0)
+
 /* End optimization macro defs */
 
 
+/* Decodes the escapes in [s, e) into pb the way the string states do,
+ * including their replacement of unpaired surrogates.
+ */
+static int json_tokener_unescape(struct printbuf *pb, const char *s, const char *e)
+{
+  while (s < e) {
+    const char *run = s;
+    unsigned int ucs_char, got_hi_surrogate = 0;
+    unsigned char unescaped_utf[4];
+    int i;
+
+    while (s < e && *s != '\\')
+      s++;
+    printbuf_memappend_fast(pb, run, s - run);
+    if (s == e)
+      break;
+    /* A backslash is never last, it would have escaped the closing quote */
+    s++;
+    switch (*s++) {
+    case '"':
+    case '\\':
+    case '/':
+      printbuf_memappend_fast(pb, s - 1, 1);
+      break;
+    case 'b': printbuf_memappend_fast(pb, "\b", 1); break;
+    case 'n': printbuf_memappend_fast(pb, "\n", 1); break;
+    case 'r': printbuf_memappend_fast(pb, "\r", 1); break;
+    case 't': printbuf_memappend_fast(pb, "\t", 1); break;
+    case 'f': printbuf_memappend_fast(pb, "\f", 1); break;
+    case 'u':
+      while (1) {
+	if (e - s < 4)
+	  return -1;
+	ucs_char = 0;
+	for (i = 0; i < 4; i++) {
+	  if (!jt_ishex(s[i]))
+	    return -1;
+	  ucs_char = (ucs_char << 4) | (unsigned int)jt_hexdigit(s[i]);
+	}
+	s += 4;
+	if (got_hi_surrogate) {
+	  if (IS_LOW_SURROGATE(ucs_char))
+	    ucs_char = DECODE_SURROGATE_PAIR(got_hi_surrogate, ucs_char);
+	  else
+	    printbuf_memappend_fast(pb, (char*)utf8_replacement_char, 3);
+	  got_hi_surrogate = 0;
+	}
+	if (ucs_char < 0x80) {
+	  unescaped_utf[0] = ucs_char;
+	  printbuf_memappend_fast(pb, (char*)unescaped_utf, 1);
+	} else if (ucs_char < 0x800) {
+	  unescaped_utf[0] = 0xc0 | (ucs_char >> 6);
+	  unescaped_utf[1] = 0x80 | (ucs_char & 0x3f);
+	  printbuf_memappend_fast(pb, (char*)unescaped_utf, 2);
+	} else if (IS_HIGH_SURROGATE(ucs_char)) {
+	  if (e - s >= 2 && s[0] == '\\' && s[1] == 'u') {
+	    got_hi_surrogate = ucs_char;
+	    s += 2;
+	    continue;
+	  }
+	  printbuf_memappend_fast(pb, (char*)utf8_replacement_char, 3);
+	} else if (IS_LOW_SURROGATE(ucs_char)) {
+	  printbuf_memappend_fast(pb, (char*)utf8_replacement_char, 3);
+	} else if (ucs_char < 0x10000) {
+	  unescaped_utf[0] = 0xe0 | (ucs_char >> 12);
+	  unescaped_utf[1] = 0x80 | ((ucs_char >> 6) & 0x3f);
+	  unescaped_utf[2] = 0x80 | (ucs_char & 0x3f);
+	  printbuf_memappend_fast(pb, (char*)unescaped_utf, 3);
+	} else {
+	  unescaped_utf[0] = 0xf0 | ((ucs_char >> 18) & 0x07);
+	  unescaped_utf[1] = 0x80 | ((ucs_char >> 12) & 0x3f);
+	  unescaped_utf[2] = 0x80 | ((ucs_char >> 6) & 0x3f);
+	  unescaped_utf[3] = 0x80 | (ucs_char & 0x3f);
+	  printbuf_memappend_fast(pb, (char*)unescaped_utf, 4);
+	}
+	break;
+      }
+      break;
+    default:
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Whether [s, s + n) is a number as JSON writes it.  The converters take
+ * all of those, so with JSON_TOKENER_LAZY_NUMBERS they are kept as text.
+ */
+static int json_tokener_number_plain(const char *s, size_t n)
+{
+  const char *p = s, *e = s + n;
+
+  if (p < e && *p == '-')
+    p++;
+  if (p == e || *p < '0' || *p > '9')
+    return 0;
+  if (*p++ != '0')
+    while (p < e && *p >= '0' && *p <= '9')
+      p++;
+  if (p < e && *p == '.') {
+    if (++p == e || *p < '0' || *p > '9')
+      return 0;
+    while (p < e && *p >= '0' && *p <= '9')
+      p++;
+  }
+  if (p < e && (*p == 'e' || *p == 'E')) {
+    if (++p < e && (*p == '+' || *p == '-'))
+      p++;
+    if (p == e || *p < '0' || *p > '9')
+      return 0;
+    while (p < e && *p >= '0' && *p <= '9')
+      p++;
+  }
+  return p == e;
+}
+
+/* Structural index engine, see JSON_TOKENER_STRUCTURAL_INDEX.
+ *
+ * Stage one classifies 64 bytes at a time into bit masks, one bit per
+ * byte: backslashes, quotes, whitespace and {}[]:, characters.  Quotes
+ * preceded by an odd number of backslashes are dropped, and a prefix XOR
+ * over the rest marks the bytes inside strings.  Every quote, and outside
+ * strings every structural character and the first byte of every other
+ * run (a number or literal) is recorded as an offset.
+ *
+ * Stage two walks those offsets and builds the objects.  It gives up on
+ * anything unusual and leaves the input to the state machine, so it only
+ * ever has to agree with it on valid strict JSON.
+ */
+#if defined(JSON_TOKENER_SSE2) || \
+    (defined(JSON_TOKENER_NEON) && (defined(__aarch64__) || defined(_M_ARM64)))
+#define JSON_TOKENER_HAVE_INDEX
+#endif
+
+#if defined(JSON_TOKENER_HAVE_INDEX)
+
+struct json_tokener_block
+{
+  unsigned long long backslash, quote, space, op;
+};
+
+#if defined(JSON_TOKENER_NEON)
+/* One bit per byte of four compare results, like a 64-bit movemask */
+static unsigned long long json_tokener_neon_mask(uint8x16_t a, uint8x16_t b,
+						uint8x16_t c, uint8x16_t d)
+{
+  static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128,
+				       1, 2, 4, 8, 16, 32, 64, 128 };
+  const uint8x16_t bits = vld1q_u8(weights);
+  uint8x16_t sum0 = vpaddq_u8(vandq_u8(a, bits), vandq_u8(b, bits));
+  uint8x16_t sum1 = vpaddq_u8(vandq_u8(c, bits), vandq_u8(d, bits));
+  sum0 = vpaddq_u8(sum0, sum1);
+  sum0 = vpaddq_u8(sum0, sum0);
+  return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+#endif
+
+static void json_tokener_classify(const char *s, struct json_tokener_block *b)
+{
+#if defined(JSON_TOKENER_AVX2)
+  const __m256i backslash32 = _mm256_set1_epi8('\\');
+  const __m256i quote32 = _mm256_set1_epi8('"');
+  const __m256i lower32 = _mm256_set1_epi8(0x20);
+  int k;
+  b->backslash = b->quote = b->space = b->op = 0;
+  for (k = 0; k < 2; k++) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(s + 32 * k));
+    /* '[' and ']' are '{' and '}' with bit 5 clear */
+    __m256i y = _mm256_or_si256(x, lower32);
+    __m256i space = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\r'))));
+    __m256i op = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(y, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(y, _mm256_set1_epi8('}'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8(','))));
+    int shift = 32 * k;
+    b->backslash |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, backslash32)) << shift;
+    b->quote |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, quote32)) << shift;
+    b->space |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(space) << shift;
+    b->op |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(op) << shift;
+  }
+#elif defined(JSON_TOKENER_SSE2)
+  const __m128i backslash16 = _mm_set1_epi8('\\');
+  const __m128i quote16 = _mm_set1_epi8('"');
+  const __m128i lower16 = _mm_set1_epi8(0x20);
+  int k;
+  b->backslash = b->quote = b->space = b->op = 0;
+  for (k = 0; k < 4; k++) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(s + 16 * k));
+    /* '[' and ']' are '{' and '}' with bit 5 clear */
+    __m128i y = _mm_or_si128(x, lower16);
+    __m128i space = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\t'))),
+      _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\r'))));
+    __m128i op = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(y, _mm_set1_epi8('{')), _mm_cmpeq_epi8(y, _mm_set1_epi8('}'))),
+      _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(':')), _mm_cmpeq_epi8(x, _mm_set1_epi8(','))));
+    int shift = 16 * k;
+    b->backslash |= (unsigned long long)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(x, backslash16)) << shift;
+    b->quote |= (unsigned long long)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(x, quote16)) << shift;
+    b->space |= (unsigned long long)(unsigned int)_mm_movemask_epi8(space) << shift;
+    b->op |= (unsigned long long)(unsigned int)_mm_movemask_epi8(op) << shift;
+  }
+#else
+  uint8x16_t backslash[4], quote[4], space[4], op[4];
+  int k;
+  for (k = 0; k < 4; k++) {
+    uint8x16_t x = vld1q_u8((const uint8_t *)(s + 16 * k));
+    uint8x16_t y = vorrq_u8(x, vdupq_n_u8(0x20));
+    backslash[k] = vceqq_u8(x, vdupq_n_u8('\\'));
+    quote[k] = vceqq_u8(x, vdupq_n_u8('"'));
+    space[k] = vorrq_u8(vorrq_u8(vceqq_u8(x, vdupq_n_u8(' ')), vceqq_u8(x, vdupq_n_u8('\t'))),
+			vorrq_u8(vceqq_u8(x, vdupq_n_u8('\n')), vceqq_u8(x, vdupq_n_u8('\r'))));
+    op[k] = vorrq_u8(vorrq_u8(vceqq_u8(y, vdupq_n_u8('{')), vceqq_u8(y, vdupq_n_u8('}'))),
+		     vorrq_u8(vceqq_u8(x, vdupq_n_u8(':')), vceqq_u8(x, vdupq_n_u8(','))));
+  }
+  b->backslash = json_tokener_neon_mask(backslash[0], backslash[1], backslash[2], backslash[3]);
+  b->quote = json_tokener_neon_mask(quote[0], quote[1], quote[2], quote[3]);
+  b->space = json_tokener_neon_mask(space[0], space[1], space[2], space[3]);
+  b->op = json_tokener_neon_mask(op[0], op[1], op[2], op[3]);
+#endif
+}
+
+/* Bytes preceded by an odd number of backslashes.  *carry is 1 when the
+ * previous block ended in such a backslash.  Subtracting the starts of
+ * the backslash runs from the odd bit positions carries through each run
+ * and leaves the parity of its length in the byte after it.
+ */
+static unsigned long long json_tokener_escaped(unsigned long long backslash,
+					       unsigned long long *carry)
+{
+  const unsigned long long odd_bits = 0xAAAAAAAAAAAAAAAAULL;
+  unsigned long long potential, codes, escaped;
+
+  if (!backslash) {
+    escaped = *carry;
+    *carry = 0;
+    return escaped;
+  }
+  potential = backslash & ~*carry;
+  codes = (((potential << 1) | odd_bits) - potential) ^ odd_bits;
+  escaped = codes ^ (backslash | *carry);
+  *carry = (codes & backslash) >> 63;
+  return escaped;
+}
+
+/* Bit i of the result is the XOR of bits 0..i */
+static unsigned long long json_tokener_prefix_xor(unsigned long long x)
+{
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
+
+/* json_tokener_index():
+ *   Stage one: fills tok->structurals with the offsets described above.
+ *   Returns their number, or -1 if a string is left open or memory for
+ *   the offsets runs out.
+ */
+static long json_tokener_index(struct json_tokener *tok, const char *str, size_t n)
+{
+  unsigned long long escape_carry = 0, string_carry = 0, value_carry = 0;
+  size_t count = 0, pos;
+  char tail[64];
+
+  for (pos = 0; pos < n; pos += 64) {
+    const char *block = str + pos;
+    struct json_tokener_block b;
+    unsigned long long quote, in_string, other, structural;
+
+    if (n - pos < 64) {
+      /* Pad the last block with whitespace */
+      memset(tail, ' ', sizeof(tail));
+      memcpy(tail, block, n - pos);
+      block = tail;
+    }
+    if (count + 64 > tok->structurals_size) {
+      size_t size = tok->structurals_size ? tok->structurals_size * 2 : 4096;
+      unsigned int *structurals = (unsigned int *)json_c_allocator_realloc(
+	tok->own_allocator, tok->structurals, size * sizeof(unsigned int));
+      if (!structurals)
+	return -1;
+      tok->structurals = structurals;
+      tok->structurals_size = size;
+    }
+
+    json_tokener_classify(block, &b);
+    quote = b.quote & ~json_tokener_escaped(b.backslash, &escape_carry);
+    /* From each opening quote up to, not including, its closing one */
+    in_string = json_tokener_prefix_xor(quote) ^ string_carry;
+    string_carry = 0ULL - (in_string >> 63);
+    other = ~(b.op | b.space | quote | in_string);
+    structural = (b.op & ~in_string) | quote |
+		 (other & ~((other << 1) | value_carry));
+    value_carry = other >> 63;
+
+    while (structural) {
+      tok->structurals[count++] = (unsigned int)pos + json_tokener_ctz(structural);
+      structural &= structural - 1;
+    }
+  }
+  return string_carry ? -1 : (long)count;
+}
+
+/* Whether every escape in [s, e) is one the string states accept */
+static int json_tokener_escapes_valid(const char *s, const char *e)
+{
+  while ((s = (const char *)memchr(s, '\\', e - s)) != NULL) {
+    switch (s[1]) {
+    case '"': case '\\': case '/':
+    case 'b': case 'n': case 'r': case 't': case 'f':
+      s += 2;
+      break;
+    case 'u':
+      if (e - s < 6 || !jt_ishex(s[2]) || !jt_ishex(s[3]) ||
+	  !jt_ishex(s[4]) || !jt_ishex(s[5]))
+	return 0;
+      s += 6;
+      break;
+    default:
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* A bare number or literal in [s, e), checked and converted like the
+ * number, boolean and null states do in strict mode.  Only checked when
+ * value is NULL.
+ */
+static int json_tokener_bare_value(struct json_tokener *tok, const char *s,
+				   const char *e, struct json_object **value)
+{
+  size_t n = e - s;
+  const char *p;
+  int is_double = 0, is_exponent = 0, minus_at = 0;
+  int64_t num64;
+  double numd;
+
+  switch (*s) {
+  case 't':
+    if (n != (size_t)json_true_str_len || memcmp(s, json_true_str, n) != 0)
+      return -1;
+    if (!value)
+      return 0;
+    *value = json_object_new_boolean_with(json_tokener_object_allocator(tok), 1);
+    return *value ? 0 : -1;
+  case 'f':
+    if (n != (size_t)json_false_str_len || memcmp(s, json_false_str, n) != 0)
+      return -1;
+    if (!value)
+      return 0;
+    *value = json_object_new_boolean_with(json_tokener_object_allocator(tok), 0);
+    return *value ? 0 : -1;
+  case 'n':
+    if (n != (size_t)json_null_str_len || memcmp(s, json_null_str, n) != 0)
+      return -1;
+    if (value)
+      *value = NULL;
+    return 0;
+  }
+  if (*s != '-' && (*s < '0' || *s > '9'))
+    return -1;
+  for (p = s; p < e; p++) {
+    if (!jt_isnumber(*p))
+      return -1;
+    if (*p == '.') {
+      if (is_double)
+	return -1;
+      is_double = 1;
+    } else if (*p == 'e' || *p == 'E') {
+      if (is_exponent)
+	return -1;
+      is_exponent = is_double = 1;
+      minus_at = (int)(p - s) + 1;
+    } else if (*p == '-' && p - s != minus_at) {
+      return -1;
+    }
+  }
+  if (value && (tok->flags & JSON_TOKENER_LAZY_NUMBERS) &&
+      json_tokener_number_plain(s, n)) {
+    *value = json_object_new_number_text(json_tokener_object_allocator(tok), is_double ? json_type_double :
+					 json_type_int, s, (int)n);
+    return *value ? 0 : -1;
+  }
+  if (!is_double && json_parse_int64_len(s, (int)n, &num64) == 0) {
+    if (num64 && *s == '0' && (tok->flags & JSON_TOKENER_STRICT))
+      return -1;
+    if (!value)
+      return 0;
+    *value = json_object_new_int64_with(json_tokener_object_allocator(tok), num64);
+  } else if (is_double && json_parse_double_len(s, (int)n, &numd) == 0) {
+    if (!value)
+      return 0;
+    /* Keeps the text for serializing, so it needs a terminated copy */
+    printbuf_reset(tok->pb);
+    printbuf_memappend_fast(tok->pb, s, (int)n);
+    *value = json_object_new_double_s_with(json_tokener_object_allocator(tok), numd, tok->pb->buf);
+  } else {
+    return -1;
+  }
+  return *value ? 0 : -1;
+}
+
+/* json_tokener_parse_indexed():
+ *   Stage two.  Returns 1 with the result in *result, or 0 to leave the
+ *   input to the state machine.  With result NULL the input is only
+ *   checked.  Containers are added to their parent as soon as they are
+ *   opened, so the only state kept per level is the container in
+ *   tok->stack[].obj and its kind in tok->stack[].state, and at most one
+ *   key is pending.  Level 0 goes back to the fresh state either way.
+ */
+static int json_tokener_parse_indexed(struct json_tokener *tok, const char *str,
+				      const char *end, int len,
+				      struct json_object **result)
+{
+  const unsigned int *idx;
+  const char *p, *key = NULL, *key_end = NULL;
+  int key_escapes = 0, depth = -1;
+  long count, i = 0;
+  struct json_object *root = NULL, *value, *parent;
+
+  count = json_tokener_index(tok, str, end - str);
+  if (count <= 0)
+    return 0;
+  idx = tok->structurals;
+
+ value:
+  /* Nested as deep as the state machine allows */
+  if (i == count || depth + 1 >= tok->max_depth)
+    goto fail;
+  p = str + idx[i++];
+  switch (*p) {
+  case '{':
+  case '[':
+    if (!result) {
+      value = NULL;
+      break;
+    }
+    value = (*p == '{') ? json_object_new_object_with(json_tokener_object_allocator(tok)) :
+			  json_object_new_array_with(json_tokener_object_allocator(tok));
+    if (!value)
+      goto fail;
+    break;
+  case '"':
+    {
+      /* Stage one pairs every opening quote with its closing one */
+      const char *close = str + idx[i++];
+      if (!result) {
+	if (!json_tokener_escapes_valid(p + 1, close))
+	  goto fail;
+	value = NULL;
+	break;
+      }
+      if (memchr(p + 1, '\\', close - p - 1)) {
+	printbuf_reset(tok->pb);
+	if (json_tokener_unescape(tok->pb, p + 1, close) != 0)
+	  goto fail;
+	value = json_object_new_string_len_with(json_tokener_object_allocator(tok), tok->pb->buf, tok->pb->bpos);
+      } else if (tok->flags & JSON_TOKENER_BORROW_STRINGS)
+	value = json_object_new_string_borrowed(json_tokener_object_allocator(tok), p + 1, close - p - 1);
+      else
+	value = json_object_new_string_len_with(json_tokener_object_allocator(tok), p + 1, close - p - 1);
+      if (!value)
+	goto fail;
+    }
+    break;
+  case '}':
+  case ']':
+  case ':':
+  case ',':
+    goto fail;
+  default:
+    {
+      const char *e = p;
+      while (e < end && !jt_isdelim(*e))
+	e++;
+      /* Without the terminator a top-level number may still go on */
+      if (depth < 0 && len != -1)
+	goto fail;
+      value = NULL;
+      if (json_tokener_bare_value(tok, p, e, result ? &value : NULL) != 0)
+	goto fail;
+    }
+    break;
+  }
+
+  /* Attach the value to its container, or make it the result */
+  if (depth < 0) {
+    root = value;
+  } else if (result) {
+    parent = tok->stack[depth].obj;
+    if (tok->stack[depth].state == json_tokener_state_array) {
+      if (json_object_array_add(parent, value) != 0) {
+	json_object_put(value);
+	goto fail;
+      }
+    } else {
+      printbuf_reset(tok->pb);
+      if (key_escapes) {
+	if (json_tokener_unescape(tok->pb, key, key_end) != 0) {
+	  json_object_put(value);
+	  goto fail;
+	}
+      } else
+	printbuf_memappend_fast(tok->pb, key, key_end - key);
+      if (json_object_object_add(parent, tok->pb->buf, value) != 0) {
+	json_object_put(value);
+	goto fail;
+      }
+    }
+  }
+  if (*p == '{' || *p == '[') {
+    tok->stack[++depth].obj = value;
+    tok->stack[depth].state = (*p == '[') ? json_tokener_state_array
+					   : json_tokener_state_object_field_start;
+    if (i < count && str[idx[i]] == *p + 2) {
+      /* '{' + 2 is '}' and '[' + 2 is ']' */
+      i++;
+      depth--;
+      goto after_value;
+    }
+    if (*p == '[')
+      goto value;
+    goto key;
+  }
+
+ after_value:
+  if (depth < 0)
+    goto done;
+  if (i == count)
+    goto fail;
+  p = str + idx[i++];
+  if (tok->stack[depth].state == json_tokener_state_array) {
+    if (*p == ',')
+      goto value;
+    if (*p != ']')
+      goto fail;
+  } else {
+    if (*p == ',')
+      goto key;
+    if (*p != '}')
+      goto fail;
+  }
+  depth--;
+  goto after_value;
+
+ key:
+  if (i + 2 >= count || str[idx[i]] != '"' || str[idx[i + 2]] != ':')
+    goto fail;
+  key = str + idx[i] + 1;
+  key_end = str + idx[i + 1];
+  key_escapes = memchr(key, '\\', key_end - key) != NULL;
+  if (key_escapes && !result && !json_tokener_escapes_valid(key, key_end))
+    goto fail;
+  i += 3;
+  goto value;
+
+ done:
+  /* Trailing data goes through the state machine */
+  if (i != count)
+    goto fail;
+  tok->stack[0].state = json_tokener_state_eatws;
+  if (result)
+    *result = root;
+  return 1;
+
+ fail:
+  tok->stack[0].state = json_tokener_state_eatws;
+  json_object_put(root);
+  return 0;
+}
+
+#endif /* JSON_TOKENER_HAVE_INDEX */
+
+/* json_tokener_utf8_valid():
+ *   Whether the n bytes at s are well-formed UTF-8: no stray or missing
+ *   continuation bytes, no overlong forms, no surrogates, nothing above
+ *   U+10FFFF.  With AVX2 every 32 byte block is checked with three nibble
+ *   table lookups over each pair of adjacent bytes (after Keiser and
+ *   Lemire); elsewhere ASCII blocks are skipped with SSE2/NEON and only
+ *   the multi-byte sequences are decoded one by one.
+ */
+#if defined(JSON_TOKENER_AVX2)
+
+/* What may be wrong with a pair of bytes, by the high nibble of the
+ * first, its low nibble and the high nibble of the second
+ */
+#define JT_UTF8_TOO_SHORT  (1 << 0)  /* lead byte not followed by a continuation */
+#define JT_UTF8_TOO_LONG   (1 << 1)  /* ASCII followed by a continuation */
+#define JT_UTF8_OVERLONG_3 (1 << 2)  /* E0 80..9F */
+#define JT_UTF8_TOO_LARGE  (1 << 3)  /* F4 90..BF, F5..FF */
+#define JT_UTF8_SURROGATE  (1 << 4)  /* ED A0..BF */
+#define JT_UTF8_OVERLONG_2 (1 << 5)  /* C0..C1 */
+#define JT_UTF8_TOO_LARGE_1000 (1 << 6)  /* F5..FF 80..8F */
+#define JT_UTF8_OVERLONG_4 (1 << 6)  /* F0 80..8F */
+#define JT_UTF8_TWO_CONTS  (1 << 7)  /* continuation after continuation */
+#define JT_UTF8_CARRY (JT_UTF8_TOO_SHORT | JT_UTF8_TOO_LONG | JT_UTF8_TWO_CONTS)
+
+static __m256i json_tokener_utf8_block(__m256i input, __m256i prev_input)
+{
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  const __m256i byte_1_high_table = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+    JT_UTF8_TOO_LONG, JT_UTF8_TOO_LONG, JT_UTF8_TOO_LONG, JT_UTF8_TOO_LONG,
+    JT_UTF8_TOO_LONG, JT_UTF8_TOO_LONG, JT_UTF8_TOO_LONG, JT_UTF8_TOO_LONG,
+    JT_UTF8_TWO_CONTS, JT_UTF8_TWO_CONTS, JT_UTF8_TWO_CONTS, JT_UTF8_TWO_CONTS,
+    JT_UTF8_TOO_SHORT | JT_UTF8_OVERLONG_2,
+    JT_UTF8_TOO_SHORT,
+    JT_UTF8_TOO_SHORT | JT_UTF8_OVERLONG_3 | JT_UTF8_SURROGATE,
+    JT_UTF8_TOO_SHORT | JT_UTF8_TOO_LARGE | JT_UTF8_TOO_LARGE_1000 | JT_UTF8_OVERLONG_4));
+  const __m256i byte_1_low_table = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+    JT_UTF8_CARRY | JT_UTF8_OVERLONG_3 | JT_UTF8_OVERLONG_2 | JT_UTF8_OVERLONG_4,
+    JT_UTF8_CARRY | JT_UTF8_OVERLONG_2,
+    JT_UTF8_CARRY,
+    JT_UTF8_CARRY,
+    JT_UTF8_CARRY | JT_UTF8_TOO_LARGE,
+    JT_UTF8_CARRY | JT_UTF8_TOO_LARGE | JT_UTF8_TOO_LARGE_1000,
+    JT_UTF8_CARRY | JT_UTF8_TOO_LARGE | JT_UTF8_TOO_LARGE_1000,
+    JT_UTF8_CARRY | JT_UTF8_TOO_LARGE | JT_UTF8_TOO_LARGE_1000,
+    JT_UTF8_CARRY | JT_UTF8_TOO_LARGE | JT_UTF8_TOO_LARGE_1000,
+    JT_UTF8_CARRY | JT_UTF8_TOO_LARGE | JT_UTF8_TOO_LARGE_1000,
+    JT_UTF8_CARRY | JT_UTF8_TOO_LARGE | JT_UTF8_TOO_LARGE_1000,
+    JT_UTF8_CARRY | JT_UTF8_TOO_LARGE | JT_UTF8_TOO_LARGE_1000,
+    JT_UTF8_CARRY | JT_UTF8_TOO_LARGE | JT_UTF8_TOO_LARGE_1000,
+    JT_UTF8_CARRY | JT_UTF8_TOO_LARGE | JT_UTF8_TOO_LARGE_1000 | JT_UTF8_SURROGATE,
+    JT_UTF8_CARRY | JT_UTF8_TOO_LARGE | JT_UTF8_TOO_LARGE_1000,
+    JT_UTF8_CARRY | JT_UTF8_TOO_LARGE | JT_UTF8_TOO_LARGE_1000));
+  const __m256i byte_2_high_table = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+    JT_UTF8_TOO_SHORT, JT_UTF8_TOO_SHORT, JT_UTF8_TOO_SHORT, JT_UTF8_TOO_SHORT,
+    JT_UTF8_TOO_SHORT, JT_UTF8_TOO_SHORT, JT_UTF8_TOO_SHORT, JT_UTF8_TOO_SHORT,
+    JT_UTF8_TOO_LONG | JT_UTF8_OVERLONG_2 | JT_UTF8_TWO_CONTS |
+      JT_UTF8_OVERLONG_3 | JT_UTF8_TOO_LARGE_1000 | JT_UTF8_OVERLONG_4,
+    JT_UTF8_TOO_LONG | JT_UTF8_OVERLONG_2 | JT_UTF8_TWO_CONTS |
+      JT_UTF8_OVERLONG_3 | JT_UTF8_TOO_LARGE,
+    JT_UTF8_TOO_LONG | JT_UTF8_OVERLONG_2 | JT_UTF8_TWO_CONTS |
+      JT_UTF8_SURROGATE | JT_UTF8_TOO_LARGE,
+    JT_UTF8_TOO_LONG | JT_UTF8_OVERLONG_2 | JT_UTF8_TWO_CONTS |
+      JT_UTF8_SURROGATE | JT_UTF8_TOO_LARGE,
+    JT_UTF8_TOO_SHORT, JT_UTF8_TOO_SHORT, JT_UTF8_TOO_SHORT, JT_UTF8_TOO_SHORT));
+  /* The bytes 1, 2 and 3 positions earlier, across the block boundary */
+  __m256i carried = _mm256_permute2x128_si256(prev_input, input, 0x21);
+  __m256i prev1 = _mm256_alignr_epi8(input, carried, 16 - 1);
+  __m256i prev2 = _mm256_alignr_epi8(input, carried, 16 - 2);
+  __m256i prev3 = _mm256_alignr_epi8(input, carried, 16 - 3);
+  __m256i special = _mm256_and_si256(
+    _mm256_and_si256(
+      _mm256_shuffle_epi8(byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+      _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, nibble))),
+    _mm256_shuffle_epi8(byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+  /* Third and fourth bytes of a sequence must be continuations, and are
+   * exactly where special has only JT_UTF8_TWO_CONTS set */
+  __m256i must23 = _mm256_or_si256(
+    _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80))),
+    _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80))));
+  __m256i must23_80 = _mm256_and_si256(must23, _mm256_set1_epi8((char)0x80));
+  return _mm256_xor_si256(must23_80, special);
+}
+
+static int json_tokener_utf8_valid(const char *s, size_t n)
+{
+  /* Lead bytes too close to the end of a block to be complete in it */
+  const __m256i max_value = _mm256_setr_epi8(
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+  __m256i error = _mm256_setzero_si256();
+  __m256i prev_input = _mm256_setzero_si256();
+  __m256i prev_incomplete = _mm256_setzero_si256();
+  char tail[32];
+  size_t i;
+
+  for (i = 0; i < n; i += 32) {
+    __m256i input;
+    if (n - i < 32) {
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, s + i, n - i);
+      input = _mm256_loadu_si256((const __m256i *)tail);
+    } else
+      input = _mm256_loadu_si256((const __m256i *)(s + i));
+    if (!_mm256_movemask_epi8(input)) {
+      /* All ASCII: only a sequence cut off by the last block can fail */
+      error = _mm256_or_si256(error, prev_incomplete);
+    } else {
+      error = _mm256_or_si256(error, json_tokener_utf8_block(input, prev_input));
+      prev_incomplete = _mm256_subs_epu8(input, max_value);
+    }
+    prev_input = input;
+  }
+  error = _mm256_or_si256(error, prev_incomplete);
+  return _mm256_testz_si256(error, error);
+}
+
+#else
+
+static int json_tokener_utf8_valid(const char *str, size_t n)
+{
+  const unsigned char *s = (const unsigned char *)str, *e = s + n;
+
+  while (s < e) {
+#if defined(JSON_TOKENER_SSE2)
+    while (e - s >= 16 &&
+	   !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)s)))
+      s += 16;
+#elif defined(JSON_TOKENER_NEON)
+    while (e - s >= 16 &&
+	   !vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(
+	     vcgeq_u8(vld1q_u8(s), vdupq_n_u8(0x80))), 4)), 0))
+      s += 16;
+#endif
+    if (s == e)
+      break;
+    if (*s < 0x80) {
+      s++;
+    } else if (*s < 0xC2) {
+      return 0;
+    } else if (*s < 0xE0) {
+      if (e - s < 2 || (s[1] & 0xC0) != 0x80)
+	return 0;
+      s += 2;
+    } else if (*s < 0xF0) {
+      if (e - s < 3 || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80 ||
+	  (*s == 0xE0 && s[1] < 0xA0) || (*s == 0xED && s[1] >= 0xA0))
+	return 0;
+      s += 3;
+    } else if (*s < 0xF5) {
+      if (e - s < 4 || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80 ||
+	  (s[3] & 0xC0) != 0x80 ||
+	  (*s == 0xF0 && s[1] < 0x90) || (*s == 0xF4 && s[1] >= 0x90))
+	return 0;
+      s += 4;
+    } else {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+#endif
+
+/* Skipping values without parsing them, for selective and lazy parsing */
+
+/* json_tokener_skip_string():
+ *   Returns the end of the string whose opening quote is before p, or
+ *   NULL if it is not closed before end.
+ */
+static const char *json_tokener_skip_string(const char *p, const char *end)
+{
+  while (1) {
+    p += json_tokener_string_run(p, end - p, '"');
+    if (p == end)
+      return NULL;
+    if (*p == '"')
+      return p + 1;
+    /* A backslash takes the next byte with it, a control byte is passed */
+    if (*p++ == '\\' && p++ == end)
+      return NULL;
+  }
+}
+
+/* json_tokener_skip_nested():
+ *   Returns the end of the bracket that closes depth levels of nesting
+ *   from p on, or NULL if there is none before end.
+ */
+static const char *json_tokener_skip_nested(const char *p, const char *end, int depth)
+{
+#if defined(JSON_TOKENER_HAVE_INDEX)
+  unsigned long long escape_carry = 0, string_carry = 0;
+  char tail[64];
+
+  for (; p < end; p += 64) {
+    const char *block = p;
+    struct json_tokener_block b;
+    unsigned long long quote, in_string, op;
+
+    if (end - p < 64) {
+      memset(tail, ' ', sizeof(tail));
+      memcpy(tail, p, end - p);
+      block = tail;
+    }
+    json_tokener_classify(block, &b);
+    quote = b.quote & ~json_tokener_escaped(b.backslash, &escape_carry);
+    in_string = json_tokener_prefix_xor(quote) ^ string_carry;
+    string_carry = 0ULL - (in_string >> 63);
+    for (op = b.op & ~in_string; op; op &= op - 1) {
+      unsigned int i = json_tokener_ctz(op);
+      if (block[i] == '[' || block[i] == '{')
+	depth++;
+      else if ((block[i] == ']' || block[i] == '}') && --depth == 0)
+	return p + i + 1;
+    }
+  }
+  return NULL;
+#else
+  while (p < end) {
+    switch (*p++) {
+    case '"':
+      if (!(p = json_tokener_skip_string(p, end)))
+	return NULL;
+      break;
+    case '[':
+    case '{':
+      depth++;
+      break;
+    case ']':
+    case '}':
+      if (--depth == 0)
+	return p;
+      break;
+    }
+  }
+  return NULL;
+#endif
+}
+
+/* json_tokener_check():
+ *   Runs tok over len bytes of buf without building objects and returns
+ *   the error the eager parser would have reported for them.
+ */
+static enum json_tokener_error json_tokener_check(struct json_tokener *tok,
+						  const char *buf, size_t len)
+{
+  /* The state machine without objects: events nobody listens to */
+  static const struct json_tokener_events no_events;
+  enum json_tokener_error err;
+  int consumed;
+
+  json_tokener_set_events(tok, &no_events, NULL);
+#if defined(JSON_TOKENER_HAVE_INDEX)
+  if (json_tokener_parse_indexed(tok, buf, buf + len, (int)len, NULL))
+    return json_tokener_success;
+#endif
+  json_tokener_parse_ex(tok, buf, (int)len);
+  /* char_offset counts within a call, the terminator call restarts it */
+  consumed = tok->char_offset;
+  /* A number or literal at the end is only complete with the terminator */
+  if (tok->err == json_tokener_continue)
+    json_tokener_parse_ex(tok, "", 1);
+  err = tok->err;
+  if (err == json_tokener_continue)
+    err = json_tokener_error_parse_eof;
+  else if (err == json_tokener_success && (size_t)consumed < len)
+    err = json_tokener_error_parse_unexpected; /* trailing data */
+  return err;
+}
+
+/* json_tokener_check_nested():
+ *   Whether the container from p to end, about to be parsed at tok's
+ *   depth, is valid as it stands.  tok keeps a tokener to check with.
+ */
+static int json_tokener_check_nested(struct json_tokener *tok,
+				     const char *p, const char *end)
+{
+  struct json_tokener *checker = tok->checker;
+
+  if (!checker) {
+    checker = json_tokener_new_with(tok->own_allocator, tok->max_depth);
+    if (!checker)
+      return 0;
+    tok->checker = checker;
+  }
+  json_tokener_reset(checker);
+  /* Its levels start at tok's, so the limit is what is left of tok's */
+  checker->max_depth = tok->max_depth - tok->depth;
+  checker->flags = tok->flags;
+  return json_tokener_check(checker, p, end - p) == json_tokener_success;
+}
+
+/* json_tokener_skip():
+ *   Returns the end of the value at p, or NULL if it runs past end.
+ */
+static const char *json_tokener_skip(const char *p, const char *end)
+{
+  if (*p == '"')
+    return json_tokener_skip_string(p + 1, end);
+  if (*p == '[' || *p == '{')
+    return json_tokener_skip_nested(p, end, 0);
+  while (p < end && !jt_isdelim(*p))
+    p++;
+  return p;
+}
+
+#define state  tok->stack[tok->depth].state
+#define saved_state  tok->stack[tok->depth].saved_state
+#define current tok->stack[tok->depth].current
+#define obj_field_name tok->stack[tok->depth].obj_field_name
+
 struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 					  const char *str, int len)
 {
   struct json_object *obj = NULL;
+  const char *end;
   char c = '\1';
-#ifdef HAVE_USELOCALE
-  locale_t oldlocale = uselocale(NULL);
-  locale_t newloc;
-#elif defined(HAVE_SETLOCALE)
-  char *oldlocale = NULL;
-#endif
 
   tok->char_offset = 0;
   tok->err = json_tokener_success;
@@ -247,35 +1433,26 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
      so the function limits the maximum string size to INT32_MAX (2GB).
      If the function is called with len == -1 then strlen is called to check
      the string length is less than INT32_MAX (2GB) */
-  if ((len < -1) || (len == -1 && strlen(str) > INT32_MAX)) {
+  if (len < -1) {
     tok->err = json_tokener_error_size;
     return NULL;
   }
-
-#ifdef HAVE_USELOCALE
-  {
-    locale_t duploc = duplocale(oldlocale);
-    newloc = newlocale(LC_NUMERIC, "C", duploc);
-    // XXX at least Debian 8.4 has a bug in newlocale where it doesn't
-    //  change the decimal separator unless you set LC_TIME!
-    if (newloc)
-    {
-      duploc = newloc; // original duploc has been freed by newlocale()
-      newloc = newlocale(LC_TIME, "C", duploc);
-    }
-    if (newloc == NULL)
-    {
-      freelocale(duploc);
-      return NULL;
-    }
-    uselocale(newloc);
+  end = str + (len == -1 ? strlen(str) : (size_t)len);
+  if ((size_t)(end - str) > INT32_MAX) {
+    tok->err = json_tokener_error_size;
+    return NULL;
   }
-#elif defined(HAVE_SETLOCALE)
+
+#if defined(JSON_TOKENER_HAVE_INDEX)
+  /* Only a fresh tokener: the engine needs the whole text in this call */
+  if ((tok->flags & JSON_TOKENER_STRUCTURAL_INDEX) && !tok->insitu_buf &&
+      !tok->events && !(tok->flags & JSON_TOKENER_LAZY) &&
+      tok->depth == 0 && state == json_tokener_state_eatws &&
+      saved_state == json_tokener_state_start &&
+      json_tokener_parse_indexed(tok, str, end, len, &obj))
   {
-    char *tmplocale;
-    tmplocale = setlocale(LC_NUMERIC, NULL);
-    if (tmplocale) oldlocale = strdup(tmplocale);
-    setlocale(LC_NUMERIC, "C");
+    tok->char_offset = (int)(end - str);
+    return obj;
   }
 #endif
 
@@ -286,8 +1463,11 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 
     case json_tokener_state_eatws:
       /* Advance until we change state */
-      while (isspace((int)c)) {
-	if ((!ADVANCE_CHAR(str, tok)) || (!PEEK_CHAR(c, tok)))
+      if (jt_isspace(c)) {
+	size_t run = json_tokener_space_run(str, end - str);
+	str += run;
+	tok->char_offset += (int)run;
+	if (!PEEK_CHAR(c, tok))
 	  goto out;
       }
       if(c == '/' && !(tok->flags & JSON_TOKENER_STRICT)) {
@@ -301,18 +1481,50 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       break;
 
     case json_tokener_state_start:
+      /* A nested container is kept as its text, see JSON_TOKENER_LAZY.
+	 The scan only knows double quotes: comments are left to strict
+	 mode to reject and one with a single quote anywhere is parsed as
+	 usual, as is an invalid one, so it fails where it would have
+	 without the flag */
+      if ((c == '{' || c == '[') && (tok->flags & JSON_TOKENER_LAZY) &&
+	  (tok->flags & JSON_TOKENER_STRICT) &&
+	  tok->depth > 0 && !tok->events && !tok->insitu_buf) {
+	const char *close = json_tokener_skip_nested(str, end, 0);
+	if (close && !memchr(str, '\'', close - str) &&
+	    (tok->lazy_checked || json_tokener_check_nested(tok, str, close))) {
+	  current = json_object_new_lazy(json_tokener_object_allocator(tok),
+					 c == '{' ? json_type_object : json_type_array,
+					 str, (int)(close - str), tok->flags);
+	  if(current == NULL)
+	    goto out;
+	  /* Onto the closing bracket, the loop steps past it */
+	  tok->char_offset += (int)(close - 1 - str);
+	  str = close - 1;
+	  saved_state = json_tokener_state_finish;
+	  state = json_tokener_state_eatws;
+	  break;
+	}
+      }
       switch(c) {
       case '{':
 	state = json_tokener_state_eatws;
 	saved_state = json_tokener_state_object_field_start;
-	current = json_object_new_object();
+	if (tok->events) {
+	  EMIT(on_object_start, (tok->events_userdata));
+	  break;
+	}
+	current = json_object_new_object_with(json_tokener_object_allocator(tok));
 	if(current == NULL)
 		goto out;
 	break;
       case '[':
 	state = json_tokener_state_eatws;
 	saved_state = json_tokener_state_array;
-	current = json_object_new_array();
+	if (tok->events) {
+	  EMIT(on_array_start, (tok->events_userdata));
+	  break;
+	}
+	current = json_object_new_array_with(json_tokener_object_allocator(tok));
 	if(current == NULL)
 		goto out;
 	break;
@@ -338,6 +1550,8 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	state = json_tokener_state_string;
 	printbuf_reset(tok->pb);
 	tok->quote_char = c;
+	if (tok->insitu_buf)
+	  tok->insitu_start = tok->insitu_out = (char *)str + 1;
 	break;
       case 'T':
       case 't':
@@ -395,9 +1609,12 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	{
 		if (tok->st_pos == json_inf_str_len)
 		{
-			current = json_object_new_double(is_negative
-							 ? -INFINITY : INFINITY);
-			if(current == NULL)
+			if (tok->events)
+				EMIT(on_double, (tok->events_userdata,
+						 is_negative ? -INFINITY : INFINITY,
+						 tok->pb->buf, tok->pb->bpos));
+			else if ((current = json_object_new_double_with(json_tokener_object_allocator(tok), is_negative
+								  ? -INFINITY : INFINITY)) == NULL)
 			    goto out;
 			saved_state = json_tokener_state_finish;
 			state = json_tokener_state_eatws;
@@ -422,6 +1639,8 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	  || (strncmp(json_null_str, tok->pb->buf, size) == 0)
 	  ) {
 	  if (tok->st_pos == json_null_str_len) {
+	    if (tok->events)
+	      EMIT(on_null, (tok->events_userdata));
 	    current = NULL;
 	    saved_state = json_tokener_state_finish;
 	    state = json_tokener_state_eatws;
@@ -435,8 +1654,10 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	{
 		if (tok->st_pos == json_nan_str_len)
 		{
-			current = json_object_new_double(NAN);
-			if (current == NULL)
+			if (tok->events)
+				EMIT(on_double, (tok->events_userdata, NAN,
+						 tok->pb->buf, tok->pb->bpos));
+			else if ((current = json_object_new_double_with(json_tokener_object_allocator(tok), NAN)) == NULL)
 			    goto out;
 			saved_state = json_tokener_state_finish;
 			state = json_tokener_state_eatws;
@@ -508,22 +1729,51 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	/* Advance until we change state */
 	const char *case_start = str;
 	while(1) {
+	  SKIP_STRING_RUN(str, tok);
+	  if (!PEEK_CHAR(c, tok)) {
+	    STRING_APPEND(tok, case_start, str-case_start);
+	    goto out;
+	  }
 	  if(c == tok->quote_char) {
-	    printbuf_memappend_fast(tok->pb, case_start, str-case_start);
-	    current = json_object_new_string_len(tok->pb->buf, tok->pb->bpos);
+	    if (tok->events) {
+	      /* Straight from the input unless it had escapes or several chunks */
+	      if (tok->pb->bpos == 0) {
+		EMIT(on_string, (tok->events_userdata, case_start, str-case_start));
+	      } else {
+		STRING_APPEND(tok, case_start, str-case_start);
+		EMIT(on_string, (tok->events_userdata, tok->pb->buf, tok->pb->bpos));
+	      }
+	      saved_state = json_tokener_state_finish;
+	      state = json_tokener_state_eatws;
+	      break;
+	    } else if (tok->insitu_buf) {
+	      STRING_APPEND(tok, case_start, str-case_start);
+	      *tok->insitu_out = '\0';
+	      current = json_object_new_string_insitu(json_tokener_object_allocator(tok), tok->insitu_start,
+						      tok->insitu_out - tok->insitu_start);
+	    } else if (tok->pb->bpos == 0) {
+	      /* No escapes and all in this chunk: take it from the input */
+	      if (tok->flags & JSON_TOKENER_BORROW_STRINGS)
+		current = json_object_new_string_borrowed(json_tokener_object_allocator(tok), case_start, str-case_start);
+	      else
+		current = json_object_new_string_len_with(json_tokener_object_allocator(tok), case_start, str-case_start);
+	    } else {
+	      STRING_APPEND(tok, case_start, str-case_start);
+	      current = json_object_new_string_len_with(json_tokener_object_allocator(tok), tok->pb->buf, tok->pb->bpos);
+	    }
 	    if(current == NULL)
 		goto out;
 	    saved_state = json_tokener_state_finish;
 	    state = json_tokener_state_eatws;
 	    break;
 	  } else if(c == '\\') {
-	    printbuf_memappend_fast(tok->pb, case_start, str-case_start);
+	    STRING_APPEND(tok, case_start, str-case_start);
 	    saved_state = json_tokener_state_string;
 	    state = json_tokener_state_string_escape;
 	    break;
 	  }
 	  if (!ADVANCE_CHAR(str, tok) || !PEEK_CHAR(c, tok)) {
-	    printbuf_memappend_fast(tok->pb, case_start, str-case_start);
+	    STRING_APPEND(tok, case_start, str-case_start);
 	    goto out;
 	  }
 	}
@@ -535,7 +1785,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       case '"':
       case '\\':
       case '/':
-	printbuf_memappend_fast(tok->pb, &c, 1);
+	STRING_APPEND(tok, &c, 1);
 	state = saved_state;
 	break;
       case 'b':
@@ -543,11 +1793,11 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       case 'r':
       case 't':
       case 'f':
-	if(c == 'b') printbuf_memappend_fast(tok->pb, "\b", 1);
-	else if(c == 'n') printbuf_memappend_fast(tok->pb, "\n", 1);
-	else if(c == 'r') printbuf_memappend_fast(tok->pb, "\r", 1);
-	else if(c == 't') printbuf_memappend_fast(tok->pb, "\t", 1);
-	else if(c == 'f') printbuf_memappend_fast(tok->pb, "\f", 1);
+	if(c == 'b') STRING_APPEND(tok, "\b", 1);
+	else if(c == 'n') STRING_APPEND(tok, "\n", 1);
+	else if(c == 'r') STRING_APPEND(tok, "\r", 1);
+	else if(c == 't') STRING_APPEND(tok, "\t", 1);
+	else if(c == 'f') STRING_APPEND(tok, "\f", 1);
 	state = saved_state;
 	break;
       case 'u':
@@ -567,7 +1817,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 
 	  /* Handle a 4-byte sequence, or two sequences if a surrogate pair */
 	  while(1) {
-	    if (c && strchr(json_hex_chars, c)) {
+	    if (jt_ishex(c)) {
 	      tok->ucs_char += ((unsigned int)jt_hexdigit(c) << ((3-tok->st_pos++)*4));
 	      if(tok->st_pos == 4) {
 		unsigned char unescaped_utf[4];
@@ -579,18 +1829,18 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
                   } else {
                     /* Hi surrogate was not followed by a low surrogate */
                     /* Replace the hi and process the rest normally */
-		    printbuf_memappend_fast(tok->pb, (char*)utf8_replacement_char, 3);
+		    STRING_APPEND(tok, (char*)utf8_replacement_char, 3);
                   }
                   got_hi_surrogate = 0;
                 }
 
 		if (tok->ucs_char < 0x80) {
 		  unescaped_utf[0] = tok->ucs_char;
-		  printbuf_memappend_fast(tok->pb, (char*)unescaped_utf, 1);
+		  STRING_APPEND(tok, (char*)unescaped_utf, 1);
 		} else if (tok->ucs_char < 0x800) {
 		  unescaped_utf[0] = 0xc0 | (tok->ucs_char >> 6);
 		  unescaped_utf[1] = 0x80 | (tok->ucs_char & 0x3f);
-		  printbuf_memappend_fast(tok->pb, (char*)unescaped_utf, 2);
+		  STRING_APPEND(tok, (char*)unescaped_utf, 2);
 		} else if (IS_HIGH_SURROGATE(tok->ucs_char)) {
                   /* Got a high surrogate.  Remember it and look for the
                    * the beginning of another sequence, which should be the
@@ -608,14 +1858,14 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
                  * characters.
                  */
 	            if( !ADVANCE_CHAR(str, tok) || !ADVANCE_CHAR(str, tok) ) {
-                    printbuf_memappend_fast(tok->pb,
+                    STRING_APPEND(tok,
 					    (char*) utf8_replacement_char, 3);
 		    }
                     /* Advance to the first char of the next sequence and
                      * continue processing with the next sequence.
                      */
 	            if (!ADVANCE_CHAR(str, tok) || !PEEK_CHAR(c, tok)) {
-	              printbuf_memappend_fast(tok->pb,
+	              STRING_APPEND(tok,
 					      (char*) utf8_replacement_char, 3);
 	              goto out;
                     }
@@ -627,26 +1877,26 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
                      * it.  Put a replacement char in for the hi surrogate
                      * and pretend we finished.
                      */
-		    printbuf_memappend_fast(tok->pb,
+		    STRING_APPEND(tok,
 					    (char*) utf8_replacement_char, 3);
                   }
 		} else if (IS_LOW_SURROGATE(tok->ucs_char)) {
                   /* Got a low surrogate not preceded by a high */
-		  printbuf_memappend_fast(tok->pb, (char*)utf8_replacement_char, 3);
+		  STRING_APPEND(tok, (char*)utf8_replacement_char, 3);
                 } else if (tok->ucs_char < 0x10000) {
 		  unescaped_utf[0] = 0xe0 | (tok->ucs_char >> 12);
 		  unescaped_utf[1] = 0x80 | ((tok->ucs_char >> 6) & 0x3f);
 		  unescaped_utf[2] = 0x80 | (tok->ucs_char & 0x3f);
-		  printbuf_memappend_fast(tok->pb, (char*)unescaped_utf, 3);
+		  STRING_APPEND(tok, (char*)unescaped_utf, 3);
 		} else if (tok->ucs_char < 0x110000) {
 		  unescaped_utf[0] = 0xf0 | ((tok->ucs_char >> 18) & 0x07);
 		  unescaped_utf[1] = 0x80 | ((tok->ucs_char >> 12) & 0x3f);
 		  unescaped_utf[2] = 0x80 | ((tok->ucs_char >> 6) & 0x3f);
 		  unescaped_utf[3] = 0x80 | (tok->ucs_char & 0x3f);
-		  printbuf_memappend_fast(tok->pb, (char*)unescaped_utf, 4);
+		  STRING_APPEND(tok, (char*)unescaped_utf, 4);
 		} else {
                   /* Don't know what we got--insert the replacement char */
-		  printbuf_memappend_fast(tok->pb, (char*)utf8_replacement_char, 3);
+		  STRING_APPEND(tok, (char*)utf8_replacement_char, 3);
                 }
 		state = saved_state;
 		break;
@@ -657,7 +1907,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	    }
 	  if (!ADVANCE_CHAR(str, tok) || !PEEK_CHAR(c, tok)) {
             if (got_hi_surrogate) /* Clean up any pending chars */
-	      printbuf_memappend_fast(tok->pb, (char*)utf8_replacement_char, 3);
+	      STRING_APPEND(tok, (char*)utf8_replacement_char, 3);
 	    goto out;
 	  }
 	}
@@ -675,8 +1925,9 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	  || (strncmp(json_true_str, tok->pb->buf, size1) == 0)
 	  ) {
 	  if(tok->st_pos == json_true_str_len) {
-	    current = json_object_new_boolean(1);
-	    if(current == NULL)
+	    if (tok->events)
+	      EMIT(on_boolean, (tok->events_userdata, 1));
+	    else if ((current = json_object_new_boolean_with(json_tokener_object_allocator(tok), 1)) == NULL)
 		goto out;
 	    saved_state = json_tokener_state_finish;
 	    state = json_tokener_state_eatws;
@@ -686,8 +1937,9 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	  strncasecmp(json_false_str, tok->pb->buf, size2) == 0)
 	  || (strncmp(json_false_str, tok->pb->buf, size2) == 0)) {
 	  if(tok->st_pos == json_false_str_len) {
-	    current = json_object_new_boolean(0);
-	    if(current == NULL)
+	    if (tok->events)
+	      EMIT(on_boolean, (tok->events_userdata, 0));
+	    else if ((current = json_object_new_boolean_with(json_tokener_object_allocator(tok), 0)) == NULL)
 		goto out;
 	    saved_state = json_tokener_state_finish;
 	    state = json_tokener_state_eatws;
@@ -708,7 +1960,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	int case_len=0;
 	int is_exponent=0;
 	int negativesign_next_possible_location=1;
-	while(c && strchr(json_number_chars, c)) {
+	while(jt_isnumber(c)) {
 	  ++case_len;
 
 	  /* non-digit characters checks */
@@ -760,25 +2012,43 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 		state = json_tokener_state_inf;
 		goto redo_char;
 	}
+
+	/* Keep a number that is all in this chunk as its text, see
+	   JSON_TOKENER_LAZY_NUMBERS */
+	if ((tok->flags & JSON_TOKENER_LAZY_NUMBERS) && !tok->events &&
+	    tok->pb->bpos == case_len &&
+	    json_tokener_number_plain(case_start, case_len))
+	{
+		current = json_object_new_number_text(json_tokener_object_allocator(tok),
+			tok->is_double ? json_type_double : json_type_int,
+			case_start, case_len);
+		if (current == NULL)
+			goto out;
+		saved_state = json_tokener_state_finish;
+		state = json_tokener_state_eatws;
+		goto redo_char;
+	}
       }
       {
 	int64_t num64;
 	double  numd;
-	if (!tok->is_double && json_parse_int64(tok->pb->buf, &num64) == 0) {
+	if (!tok->is_double && json_parse_int64_len(tok->pb->buf, tok->pb->bpos, &num64) == 0) {
 		if (num64 && tok->pb->buf[0]=='0' &&
 		    (tok->flags & JSON_TOKENER_STRICT)) {
 			/* in strict mode, number must not start with 0 */
 			tok->err = json_tokener_error_parse_number;
 			goto out;
 		}
-		current = json_object_new_int64(num64);
-		if(current == NULL)
+		if (tok->events)
+			EMIT(on_int64, (tok->events_userdata, num64));
+		else if ((current = json_object_new_int64_with(json_tokener_object_allocator(tok), num64)) == NULL)
 		    goto out;
 	}
-	else if(tok->is_double && json_parse_double(tok->pb->buf, &numd) == 0)
+	else if(tok->is_double && json_parse_double_len(tok->pb->buf, tok->pb->bpos, &numd) == 0)
 	{
-          current = json_object_new_double_s(numd, tok->pb->buf);
-	  if(current == NULL)
+	  if (tok->events)
+		EMIT(on_double, (tok->events_userdata, numd, tok->pb->buf, tok->pb->bpos));
+	  else if ((current = json_object_new_double_s_with(json_tokener_object_allocator(tok), numd, tok->pb->buf)) == NULL)
 		goto out;
         } else {
           tok->err = json_tokener_error_parse_number;
@@ -799,6 +2069,8 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	    tok->err = json_tokener_error_parse_unexpected;
 	    goto out;
 	  }
+	if (tok->events)
+	  EMIT(on_array_end, (tok->events_userdata));
 	saved_state = json_tokener_state_finish;
 	state = json_tokener_state_eatws;
       } else {
@@ -814,7 +2086,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       break;
 
     case json_tokener_state_array_add:
-      if( json_object_array_add(current, obj) != 0 )
+      if( !tok->events && json_object_array_add(current, obj) != 0 )
         goto out;
       saved_state = json_tokener_state_array_sep;
       state = json_tokener_state_eatws;
@@ -822,6 +2094,8 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 
     case json_tokener_state_array_sep:
       if(c == ']') {
+	if (tok->events)
+	  EMIT(on_array_end, (tok->events_userdata));
 	saved_state = json_tokener_state_finish;
 	state = json_tokener_state_eatws;
       } else if(c == ',') {
@@ -842,11 +2116,15 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 			tok->err = json_tokener_error_parse_unexpected;
 			goto out;
 		}
+	if (tok->events)
+	  EMIT(on_object_end, (tok->events_userdata));
 	saved_state = json_tokener_state_finish;
 	state = json_tokener_state_eatws;
       } else if (c == '"' || c == '\'') {
 	tok->quote_char = c;
 	printbuf_reset(tok->pb);
+	if (tok->insitu_buf)
+	  tok->insitu_start = tok->insitu_out = (char *)str + 1;
 	state = json_tokener_state_object_field;
       } else {
 	tok->err = json_tokener_error_parse_object_key_name;
@@ -859,20 +2137,31 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	/* Advance until we change state */
 	const char *case_start = str;
 	while(1) {
+	  SKIP_STRING_RUN(str, tok);
+	  if (!PEEK_CHAR(c, tok)) {
+	    STRING_APPEND(tok, case_start, str-case_start);
+	    goto out;
+	  }
 	  if(c == tok->quote_char) {
-	    printbuf_memappend_fast(tok->pb, case_start, str-case_start);
-	    obj_field_name = strdup(tok->pb->buf);
+	    STRING_APPEND(tok, case_start, str-case_start);
+	    if (tok->events) {
+	      EMIT(on_key, (tok->events_userdata, tok->pb->buf, tok->pb->bpos));
+	    } else if (tok->insitu_buf) {
+	      *tok->insitu_out = '\0';
+	      obj_field_name = tok->insitu_start;
+	    } else
+	      obj_field_name = json_c_allocator_strdup(tok->own_allocator, tok->pb->buf);
 	    saved_state = json_tokener_state_object_field_end;
 	    state = json_tokener_state_eatws;
 	    break;
 	  } else if(c == '\\') {
-	    printbuf_memappend_fast(tok->pb, case_start, str-case_start);
+	    STRING_APPEND(tok, case_start, str-case_start);
 	    saved_state = json_tokener_state_object_field;
 	    state = json_tokener_state_string_escape;
 	    break;
 	  }
 	  if (!ADVANCE_CHAR(str, tok) || !PEEK_CHAR(c, tok)) {
-	    printbuf_memappend_fast(tok->pb, case_start, str-case_start);
+	    STRING_APPEND(tok, case_start, str-case_start);
 	    goto out;
 	  }
 	}
@@ -900,8 +2189,15 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       goto redo_char;
 
     case json_tokener_state_object_value_add:
-      json_object_object_add(current, obj_field_name, obj);
-      free(obj_field_name);
+      if (tok->events) {
+	/* Nothing to add to, the key was passed on when it was parsed */
+      } else if (tok->insitu_buf) {
+	/* The key lives in the input, the table only points at it */
+	json_object_object_add_ex(current, obj_field_name, obj, JSON_C_OBJECT_KEY_IS_CONSTANT);
+      } else {
+	json_object_object_add(current, obj_field_name, obj);
+	json_c_allocator_free(tok->own_allocator, obj_field_name);
+      }
       obj_field_name = NULL;
       saved_state = json_tokener_state_object_sep;
       state = json_tokener_state_eatws;
@@ -910,6 +2206,8 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
     case json_tokener_state_object_sep:
       /* { */
       if(c == '}') {
+	if (tok->events)
+	  EMIT(on_object_end, (tok->events_userdata));
 	saved_state = json_tokener_state_finish;
 	state = json_tokener_state_eatws;
       } else if(c == ',') {
@@ -940,14 +2238,6 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       tok->err = json_tokener_error_parse_eof;
   }
 
-#ifdef HAVE_USELOCALE
-  uselocale(oldlocale);
-  freelocale(newloc); 
-#elif defined(HAVE_SETLOCALE)
-  setlocale(LC_NUMERIC, oldlocale);
-  free(oldlocale);
-#endif
-
   if (tok->err == json_tokener_success)
   {
     json_object *ret = json_object_get(current);
@@ -968,3 +2258,271 @@ void json_tokener_set_flags(struct json_tokener *tok, int flags)
 {
 	tok->flags = flags;
 }
+
+void json_tokener_set_events(struct json_tokener *tok,
+			     const struct json_tokener_events *events,
+			     void *userdata)
+{
+	tok->events = events;
+	tok->events_userdata = userdata;
+}
+
+void json_tokener_set_allocator(struct json_tokener *tok,
+				const struct json_c_allocator *allocator)
+{
+	tok->allocator = allocator;
+}
+
+enum json_tokener_error json_validate(const char *buf, size_t len, int flags)
+{
+  struct json_tokener *tok;
+  enum json_tokener_error err;
+
+  if (len > INT32_MAX)
+    return json_tokener_error_size;
+  if (!json_tokener_utf8_valid(buf, len))
+    return json_tokener_error_parse_utf8;
+  tok = json_tokener_new();
+  if (!tok)
+    return json_tokener_error_size;
+  json_tokener_set_flags(tok, flags);
+  err = json_tokener_check(tok, buf, len);
+  json_tokener_free(tok);
+  return err;
+}
+
+struct json_object* json_tokener_build_lazy(const struct json_c_allocator *allocator,
+					    const char *s, int len, int flags)
+{
+  /* The members' containers are lazy, so two levels are all it takes */
+  struct json_tokener *tok = json_tokener_new_ex(2);
+  struct json_object *obj;
+
+  if (!tok)
+    return NULL;
+  json_tokener_set_flags(tok, flags);
+  json_tokener_set_allocator(tok, allocator);
+  /* s and its containers were validated when s was skipped */
+  tok->lazy_checked = 1;
+  obj = json_tokener_parse_ex(tok, s, len);
+  if (tok->err != json_tokener_success || tok->char_offset != len) {
+    json_object_put(obj);
+    obj = NULL;
+  }
+  json_tokener_free(tok);
+  return obj;
+}
+
+/* Selective parsing, see json_tokener_parse_selected().
+ *
+ * The containers on the paths are walked here; every value off them is
+ * skipped by matching its strings and brackets only, and every value a
+ * path ends at is parsed by the state machine.
+ */
+
+/* json_tokener_select_value():
+ *   Parses the whole value at p into *value with the state machine.
+ */
+static const char *json_tokener_select_value(struct json_tokener *tok, const char *p,
+					     const char *end, struct json_object **value)
+{
+  const char *e = (p < end) ? json_tokener_skip(p, end) : end;
+  int flags = tok->flags;
+
+  if (!e) {
+    tok->err = json_tokener_error_parse_eof;
+    return NULL;
+  }
+  /* Exactly the value: strict mode takes what follows as trailing data,
+     and the index engine would take it all for the value */
+  tok->flags &= ~JSON_TOKENER_STRUCTURAL_INDEX;
+  *value = json_tokener_parse_ex(tok, p, (int)(e - p));
+  if (tok->err == json_tokener_continue) {
+    /* A number is only complete with the terminator */
+    *value = json_tokener_parse_ex(tok, "", 1);
+    tok->char_offset = (int)(e - p);
+  }
+  tok->flags = flags;
+  if (tok->err == json_tokener_continue)
+    tok->err = json_tokener_error_parse_eof;
+  else if (tok->err == json_tokener_success && tok->char_offset != (int)(e - p)) {
+    json_object_put(*value);
+    tok->err = json_tokener_error_parse_unexpected;
+  }
+  return tok->err == json_tokener_success ? e : NULL;
+}
+
+/* json_tokener_select_container():
+ *   Builds the object or array at p with only the members the children
+ *   of node lead to.  Array elements keep their index, with nulls in
+ *   between.  Below the top, *result is NULL when nothing was selected.
+ */
+static const char *json_tokener_select_container(struct json_tokener *tok,
+						 const char *p, const char *end,
+						 const struct json_pointer_matcher *matcher,
+						 int node, int depth,
+						 struct json_object **result)
+{
+  const struct json_pointer_node *nodes = matcher->nodes;
+  char close = (*p == '{') ? '}' : ']';
+  struct json_object *container, *value;
+  int32_t index = 0, last_index = -1;
+  int child, selected = 0;
+
+  if (depth + 1 >= tok->max_depth) {
+    tok->err = json_tokener_error_depth;
+    return NULL;
+  }
+  container = (close == '}') ? json_object_new_object_with(json_tokener_object_allocator(tok)) :
+			       json_object_new_array_with(json_tokener_object_allocator(tok));
+  if (!container) {
+    tok->err = json_tokener_error_size;
+    return NULL;
+  }
+  for (child = nodes[node].child; child; child = nodes[child].next)
+    if (nodes[child].index > last_index)
+      last_index = nodes[child].index;
+
+  p++;
+  p += json_tokener_space_run(p, end - p);
+  if (p < end && *p == close) {
+    p++;
+    goto done;
+  }
+  while (1) {
+    if (close == ']' && index > last_index) {
+      /* Nothing further on in this array is wanted */
+      if (!(p = json_tokener_skip_nested(p, end, 1)))
+	goto eof;
+      goto done;
+    }
+    if (p == end)
+      goto eof;
+
+    if (close == '}') {
+      const char *key = p + 1, *key_end;
+      if (*p != '"') {
+	tok->err = json_tokener_error_parse_object_key_name;
+	goto fail;
+      }
+      if (!(p = json_tokener_skip_string(key, end)))
+	goto eof;
+      key_end = p - 1;
+      if (memchr(key, '\\', key_end - key)) {
+	printbuf_reset(tok->pb);
+	if (json_tokener_unescape(tok->pb, key, key_end) != 0) {
+	  tok->err = json_tokener_error_parse_string;
+	  goto fail;
+	}
+	key = tok->pb->buf;
+	key_end = key + tok->pb->bpos;
+      }
+      for (child = nodes[node].child; child; child = nodes[child].next)
+	if (nodes[child].key_len == (size_t)(key_end - key) &&
+	    memcmp(nodes[child].key, key, key_end - key) == 0)
+	  break;
+      p += json_tokener_space_run(p, end - p);
+      if (p == end)
+	goto eof;
+      if (*p != ':') {
+	tok->err = json_tokener_error_parse_object_key_sep;
+	goto fail;
+      }
+      p++;
+      p += json_tokener_space_run(p, end - p);
+      if (p == end)
+	goto eof;
+    } else {
+      for (child = nodes[node].child; child; child = nodes[child].next)
+	if (nodes[child].index == index)
+	  break;
+    }
+
+    if (child && (nodes[child].selected || *p == '{' || *p == '[')) {
+      if (nodes[child].selected)
+	p = json_tokener_select_value(tok, p, end, &value);
+      else
+	p = json_tokener_select_container(tok, p, end, matcher, child, depth + 1, &value);
+      if (!p)
+	goto fail;
+      /* A container that had nothing selected is on no path */
+      if (nodes[child].selected || value) {
+	if ((close == '}' ? json_object_object_add(container, nodes[child].key, value)
+			  : json_object_array_put_idx(container, index, value)) != 0) {
+	  json_object_put(value);
+	  tok->err = json_tokener_error_size;
+	  goto fail;
+	}
+	selected = 1;
+      }
+    } else if (!(p = json_tokener_skip(p, end)))
+      goto eof;
+    index++;
+
+    p += json_tokener_space_run(p, end - p);
+    if (p == end)
+      goto eof;
+    if (*p == close) {
+      p++;
+      goto done;
+    }
+    if (*p != ',') {
+      tok->err = (close == '}') ? json_tokener_error_parse_object_value_sep
+				: json_tokener_error_parse_array;
+      goto fail;
+    }
+    p++;
+    p += json_tokener_space_run(p, end - p);
+  }
+
+ done:
+  /* The top is kept, so the result still has the document's shape */
+  if (!selected && depth > 0) {
+    json_object_put(container);
+    container = NULL;
+  }
+  *result = container;
+  return p;
+
+ eof:
+  tok->err = json_tokener_error_parse_eof;
+ fail:
+  json_object_put(container);
+  return NULL;
+}
+
+struct json_object* json_tokener_parse_selected(struct json_tokener *tok,
+						const char *str, int len,
+						const struct json_pointer_matcher *matcher)
+{
+  const struct json_tokener_events *events = tok->events;
+  struct json_object *obj = NULL;
+  const char *p, *end;
+
+  tok->char_offset = 0;
+  if (len < -1) {
+    tok->err = json_tokener_error_size;
+    return NULL;
+  }
+  end = str + (len == -1 ? strlen(str) : (size_t)len);
+  if ((size_t)(end - str) > INT32_MAX) {
+    tok->err = json_tokener_error_size;
+    return NULL;
+  }
+
+  tok->events = NULL;
+  tok->err = json_tokener_success;
+  p = str + json_tokener_space_run(str, end - str);
+  /* Nothing below a bare value can match, so it is taken as it is */
+  if (p == end || matcher->nodes[0].selected || (*p != '{' && *p != '['))
+    p = json_tokener_select_value(tok, p, end, &obj);
+  else
+    p = json_tokener_select_container(tok, p, end, matcher, 0, 0, &obj);
+  tok->events = events;
+
+  if (!p)
+    return NULL;
+  p += json_tokener_space_run(p, end - p);
+  tok->char_offset = (int)(p - str);
+  return obj;
+}
@@ -34,7 +34,9 @@ enum json_tokener_error {
   json_tokener_error_parse_object_value_sep,
   json_tokener_error_parse_string,
   json_tokener_error_parse_comment,
-  json_tokener_error_size
+  json_tokener_error_size,
+  json_tokener_error_aborted,
+  json_tokener_error_parse_utf8
 };
 
 enum json_tokener_state {
@@ -75,6 +77,11 @@ struct json_tokener_srec
 
 #define JSON_TOKENER_DEFAULT_DEPTH 32
 
+struct json_c_allocator;
+struct json_c_arena;
+struct json_tokener_events;
+struct json_pointer_matcher;
+
 struct json_tokener
 {
   char *str;
@@ -85,6 +92,16 @@ struct json_tokener
   char quote_char;
   struct json_tokener_srec *stack;
   int flags;
+  const struct json_c_allocator *own_allocator; /* current at creation, for the tokener's own state */
+  const struct json_c_allocator *allocator; /* for parsed objects, NULL to use the current one */
+  char *insitu_buf; /* set by json_tokener_parse_insitu(), strings are decoded into the input */
+  char *insitu_start, *insitu_out; /* the string being decoded and its write position */
+  unsigned int *structurals; /* offsets found by the structural index engine */
+  size_t structurals_size;
+  const struct json_tokener_events *events; /* NULL to build objects */
+  void *events_userdata;
+  struct json_tokener *checker; /* validates the containers JSON_TOKENER_LAZY skips */
+  int lazy_checked; /* the text was validated when it was skipped, see json_tokener_build_lazy() */
 };
 
 /**
@@ -99,6 +116,93 @@ struct json_tokener
  */
 #define JSON_TOKENER_STRICT  0x01
 
+/**
+ * Let string values without escapes point into the input instead of
+ * copying them. Use this only when the buffer passed to
+ * json_tokener_parse_ex() stays valid and unchanged for as long as the
+ * parsed objects live, and is not split across several calls for the
+ * strings that matter (a string spread over two calls is copied).
+ *
+ * Strings with escapes, short strings and object keys are still copied.
+ * json_object_get_string_len() and serializing read a borrowed string
+ * in place; the first json_object_get_string() on it makes a NUL
+ * terminated copy, so do not call it on one tree from several threads
+ * at once.
+ *
+ * This flag is not set by default.
+ *
+ * @see json_tokener_set_flags()
+ */
+#define JSON_TOKENER_BORROW_STRINGS  0x02
+
+/**
+ * Parse a whole JSON text in two passes where the CPU allows it (SSE2,
+ * AVX2 or 64-bit ARM NEON). The first pass records the offsets of every
+ * bracket, colon, comma, string and bare value 64 bytes at a time with
+ * vector compares and bit masks, the second builds the objects from
+ * those offsets without looking at the bytes in between.
+ *
+ * The result is the same as without the flag. Input the second pass does
+ * not handle goes through the regular tokener instead, as does everything
+ * on other CPUs: a text split across several json_tokener_parse_ex()
+ * calls, comments and other non-strict syntax, trailing data, invalid
+ * input (so errors are reported as usual), and a top-level number or
+ * literal unless len is -1.
+ *
+ * This flag is not set by default.
+ *
+ * @see json_tokener_set_flags()
+ */
+#define JSON_TOKENER_STRUCTURAL_INDEX  0x04
+
+/**
+ * Build the objects and arrays inside the parsed value only when they are
+ * first used.  Each one is found by matching its strings and brackets,
+ * validated without building any objects and kept as a reference to its
+ * text; json_object_object_get_ex(), json_object_array_get_idx(),
+ * iterating and every other accessor that needs its members build them,
+ * with the containers among them lazy in turn.  One that is never used
+ * costs the scan and the validation, and serializes as its original text
+ * whatever the serialization flags.
+ *
+ * Only takes effect together with JSON_TOKENER_STRICT, as comments
+ * would hide brackets from the scan; without it everything is built at
+ * once, and so is a container with a single quote in it.  The same
+ * input is accepted, with the same errors, as without this flag.  As
+ * with JSON_TOKENER_BORROW_STRINGS the input must stay valid and
+ * unchanged for as long as the parsed objects live.  A container split
+ * across several json_tokener_parse_ex() calls is built at once.  An
+ * accessor that cannot build a container, for lack of memory, fails as
+ * for a NULL object and sets errno to ENOMEM.  Building changes the
+ * object, so do not use one lazy tree from several threads at once.
+ *
+ * This flag is not set by default.
+ *
+ * @see json_tokener_set_flags()
+ */
+#define JSON_TOKENER_LAZY  0x08
+
+/**
+ * Keep numbers as references to their text, converting each one to an
+ * int64 or a double when it is first read with json_object_get_int64(),
+ * json_object_get_double() or the like; the result is kept.  Parsing then
+ * neither converts numbers nor copies the text of doubles, and serializing
+ * one that was not set since writes its original digits, as
+ * json_object_new_double_s() does, for ints as well.
+ *
+ * As with JSON_TOKENER_BORROW_STRINGS the input must stay valid and
+ * unchanged for as long as the parsed objects live.  Only numbers that
+ * follow the JSON grammar and are not split across several
+ * json_tokener_parse_ex() calls are kept as text, the others are converted
+ * as usual.  Converting changes the object, so do not read one tree from
+ * several threads at once.
+ *
+ * This flag is not set by default.
+ *
+ * @see json_tokener_set_flags()
+ */
+#define JSON_TOKENER_LAZY_NUMBERS  0x10
+
 /**
  * Given an error previously returned by json_tokener_get_error(),
  * return a human readable description of the error.
@@ -125,11 +229,128 @@ extern void json_tokener_reset(struct json_tokener *tok);
 extern struct json_object* json_tokener_parse(const char *str);
 extern struct json_object* json_tokener_parse_verbose(const char *str, enum json_tokener_error *error);
 
+/**
+ * Parse str with every object, hash table, array, string and key of the
+ * result, and the tokener itself, placed in arena.  Reference counting has
+ * no effect on the result; the whole tree is released at once by
+ * json_c_arena_reset() or json_c_arena_free().
+ *
+ * @returns the parsed object, NULL on error
+ */
+extern struct json_object* json_tokener_parse_arena(const char *str, struct json_c_arena *arena);
+
+/**
+ * Parse the len bytes at buf, decoding strings and object keys in place:
+ * escapes are resolved within buf and every string is NUL terminated
+ * where its closing quote was.  The result points into buf for strings
+ * and keys, so buf must stay valid and unchanged for as long as the
+ * result lives.  buf is left unusable as JSON text.
+ *
+ * @returns the parsed object, NULL on error
+ */
+extern struct json_object* json_tokener_parse_insitu(char *buf, size_t len);
+
+/**
+ * Check that the len bytes at buf are one JSON value, optionally
+ * surrounded by whitespace, without building any objects.  flags are
+ * those of json_tokener_set_flags(), and the grammar is the tokener's,
+ * including its default nesting depth of JSON_TOKENER_DEFAULT_DEPTH.
+ * In addition buf must be valid UTF-8, which the tokener does not check.
+ *
+ * Valid input takes the structural index engine where the CPU has it
+ * (see JSON_TOKENER_STRUCTURAL_INDEX); anything it does not accept is
+ * decided by the state machine.
+ *
+ * @returns json_tokener_success, or the error json_tokener_parse_ex()
+ *   reports, json_tokener_error_parse_utf8 for bad UTF-8 and
+ *   json_tokener_error_parse_unexpected for trailing data.  Running out
+ *   of memory is reported as json_tokener_error_size.
+ */
+extern enum json_tokener_error json_validate(const char *buf, size_t len, int flags);
+
+/**
+ * Parse only the parts of the document in str that matcher selects, see
+ * json_pointer_matcher_new().  The result has the shape of the whole
+ * document cut down to the selected values and the objects and arrays
+ * on their paths, so json_pointer_get() finds the same values in it.
+ * Array elements keep their index, with null in the places of the ones
+ * that were left out.  Paths that do not exist are left out too.
+ *
+ * Every value off the paths is skipped by matching its strings and
+ * brackets without allocating, and is not checked any further.  The
+ * selected values are parsed by the state machine with the flags,
+ * depth and allocator of tok; its events are not used.  Comments and
+ * single quoted strings are not understood anywhere in the document.
+ * A document that is not an object or array is parsed whole.
+ *
+ * str must hold the whole document, len being as for
+ * json_tokener_parse_ex().  Trailing data is left as there, with
+ * tok->char_offset at its start.  After an error tok must be reset.
+ *
+ * @returns the cut down document, NULL on error with the reason in tok
+ */
+extern struct json_object* json_tokener_parse_selected(struct json_tokener *tok,
+						       const char *str, int len,
+						       const struct json_pointer_matcher *matcher);
+
 /**
  * Set flags that control how parsing will be done.
  */
 extern void json_tokener_set_flags(struct json_tokener *tok, int flags);
 
+/**
+ * Callbacks for json_tokener_set_events().  Each gets the userdata passed
+ * there and returns 0 to go on; anything else stops the parse with
+ * json_tokener_error_aborted.  Callbacks left NULL skip their events.
+ *
+ * Strings and keys are passed with their escapes decoded, not NUL
+ * terminated, and only valid during the call.  on_double also gets the
+ * number as written.
+ */
+struct json_tokener_events
+{
+  int (*on_object_start)(void *userdata);
+  int (*on_object_end)(void *userdata);
+  int (*on_array_start)(void *userdata);
+  int (*on_array_end)(void *userdata);
+  int (*on_key)(void *userdata, const char *key, size_t len);
+  int (*on_string)(void *userdata, const char *str, size_t len);
+  int (*on_int64)(void *userdata, int64_t value);
+  int (*on_double)(void *userdata, double value, const char *text, size_t len);
+  int (*on_boolean)(void *userdata, int value);
+  int (*on_null)(void *userdata);
+};
+
+/**
+ * Report what tok parses through events instead of building objects.
+ * json_tokener_parse_ex() then always returns NULL: tok->err tells
+ * whether a whole value was seen (json_tokener_success), more input is
+ * needed (json_tokener_continue), or the input is invalid, in which case
+ * events up to the error have already been delivered.  Input may be fed
+ * in chunks of any size as usual.  No json_object is created; the
+ * tokener only buffers strings and numbers that are split across chunks
+ * or contain escapes.
+ *
+ * events is not copied.  NULL goes back to building objects.
+ */
+extern void json_tokener_set_events(struct json_tokener *tok,
+				    const struct json_tokener_events *events,
+				    void *userdata);
+
+/**
+ * Allocate the objects parsed by tok from allocator instead of the
+ * allocator current when json_tokener_parse_ex() is called.  allocator is
+ * handed to each object as it is created, nothing process-wide is
+ * switched, so this is safe on targets without thread-local storage.
+ * allocator is not copied and must outlive every object parsed with it.
+ * NULL removes the override.
+ *
+ * @see json_c_arena_allocator()
+ * @see json_c_pool_allocator()
+ */
+extern void json_tokener_set_allocator(struct json_tokener *tok,
+				       const struct json_c_allocator *allocator);
+
 /**
  * Parse a string and return a non-NULL json_object if a valid JSON value
  * is found.  The string does not need to be a JSON object or array;
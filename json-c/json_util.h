@@ -76,6 +76,20 @@ const char *json_util_get_last_err(void);
 extern int json_parse_int64(const char *buf, int64_t *retval);
 extern int json_parse_double(const char *buf, double *retval);
 
+/**
+ * Like json_parse_int64(), but reads at most len bytes of buf, which
+ * does not have to be NUL terminated.
+ * Values out of range saturate to INT64_MIN or INT64_MAX.
+ */
+extern int json_parse_int64_len(const char *buf, size_t len, int64_t *retval);
+
+/**
+ * Like json_parse_double(), but reads at most len bytes of buf, which
+ * does not have to be NUL terminated.
+ * The result is correctly rounded and does not depend on the locale.
+ */
+extern int json_parse_double_len(const char *buf, size_t len, double *retval);
+
 /**
  * Return a string describing the type of the object.
  * e.g. "int", or "object", etc...
@@ -30,6 +30,8 @@
 
 #include "random_seed.h"
 #include "linkhash.h"
+#include "json_allocator.h"
+#include "json_allocator_private.h"
 
 /* hash functions */
 static unsigned long lh_char_hash(const void *k);
@@ -490,39 +492,60 @@ int lh_char_equal(const void *k1, const void *k2)
 	return (strcmp((const char*)k1, (const char*)k2) == 0);
 }
 
-struct lh_table* lh_table_new(int size,
-			      lh_entry_free_fn *free_fn,
-			      lh_hash_fn *hash_fn,
-			      lh_equal_fn *equal_fn)
+static struct lh_table* lh_table_new_with(const struct json_c_allocator *allocator,
+					  int size,
+					  lh_entry_free_fn *free_fn,
+					  lh_hash_fn *hash_fn,
+					  lh_equal_fn *equal_fn)
 {
 	int i;
 	struct lh_table *t;
 
-	t = (struct lh_table*)calloc(1, sizeof(struct lh_table));
+	t = (struct lh_table*)json_c_slab_calloc(allocator, json_c_slab_table);
 	if (!t)
 		return NULL;
 
 	t->count = 0;
 	t->size = size;
-	t->table = (struct lh_entry*)calloc(size, sizeof(struct lh_entry));
+	t->table = (struct lh_entry*)json_c_allocator_calloc(allocator, size, sizeof(struct lh_entry));
 	if (!t->table)
 	{
-		free(t);
+		json_c_slab_free(allocator, t);
 		return NULL;
 	}
 	t->free_fn = free_fn;
 	t->hash_fn = hash_fn;
 	t->equal_fn = equal_fn;
+	t->allocator = allocator;
+	t->free_with_fn = NULL;
 	for(i = 0; i < size; i++) t->table[i].k = LH_EMPTY;
 	return t;
 }
 
+struct lh_table* lh_table_new(int size,
+			      lh_entry_free_fn *free_fn,
+			      lh_hash_fn *hash_fn,
+			      lh_equal_fn *equal_fn)
+{
+	return lh_table_new_with(json_c_get_allocator(), size, free_fn, hash_fn, equal_fn);
+}
+
 struct lh_table* lh_kchar_table_new(int size,
 				    lh_entry_free_fn *free_fn)
 {
 	return lh_table_new(size, free_fn, char_hash_fn, lh_char_equal);
 }
 
+struct lh_table* lh_kchar_table_new_with(const struct json_c_allocator *allocator, int size,
+				    lh_entry_free_with_fn *free_with_fn)
+{
+	struct lh_table *t = lh_table_new_with(allocator, size, NULL, char_hash_fn, lh_char_equal);
+
+	if (t)
+		t->free_with_fn = free_with_fn;
+	return t;
+}
+
 struct lh_table* lh_kptr_table_new(int size,
 				   lh_entry_free_fn *free_fn)
 {
@@ -534,7 +557,7 @@ int lh_table_resize(struct lh_table *t, int new_size)
 	struct lh_table *new_t;
 	struct lh_entry *ent;
 
-	new_t = lh_table_new(new_size, NULL, t->hash_fn, t->equal_fn);
+	new_t = lh_table_new_with(t->allocator, new_size, NULL, t->hash_fn, t->equal_fn);
 	if (new_t == NULL)
 		return -1;
 
@@ -550,12 +573,12 @@ int lh_table_resize(struct lh_table *t, int new_size)
 			return -1;
 		}
 	}
-	free(t->table);
+	json_c_allocator_free(t->allocator, t->table);
 	t->table = new_t->table;
 	t->size = new_size;
 	t->head = new_t->head;
 	t->tail = new_t->tail;
-	free(new_t);
+	json_c_slab_free(t->allocator, new_t);
 
 	return 0;
 }
@@ -563,12 +586,21 @@ int lh_table_resize(struct lh_table *t, int new_size)
 void lh_table_free(struct lh_table *t)
 {
 	struct lh_entry *c;
-	if(t->free_fn) {
+	if(t->free_with_fn) {
+		for(c = t->head; c != NULL; c = c->next)
+			t->free_with_fn(t->allocator, c);
+	} else if(t->free_fn) {
+#ifdef JSON_C_HAVE_THREAD_LOCAL
+		const struct json_c_allocator *previous = json_c_use_allocator(t->allocator);
+#endif
 		for(c = t->head; c != NULL; c = c->next)
 			t->free_fn(c);
+#ifdef JSON_C_HAVE_THREAD_LOCAL
+		json_c_use_allocator(previous);
+#endif
 	}
-	free(t->table);
-	free(t);
+	json_c_allocator_free(t->allocator, t->table);
+	json_c_slab_free(t->allocator, t);
 }
 
 
@@ -657,7 +689,17 @@ int lh_table_delete_entry(struct lh_table *t, struct lh_entry *e)
 
 	if(t->table[n].k == LH_EMPTY || t->table[n].k == LH_FREED) return -1;
 	t->count--;
-	if(t->free_fn) t->free_fn(e);
+	if(t->free_with_fn) {
+		t->free_with_fn(t->allocator, e);
+	} else if(t->free_fn) {
+#ifdef JSON_C_HAVE_THREAD_LOCAL
+		const struct json_c_allocator *previous = json_c_use_allocator(t->allocator);
+#endif
+		t->free_fn(e);
+#ifdef JSON_C_HAVE_THREAD_LOCAL
+		json_c_use_allocator(previous);
+#endif
+	}
 	t->table[n].v = NULL;
 	t->table[n].k = LH_FREED;
 	if(t->tail == &t->table[n] && t->head == &t->table[n]) {
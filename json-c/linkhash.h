@@ -59,11 +59,16 @@ extern "C" {
 int json_global_set_string_hash(const int h);
 
 struct lh_entry;
+struct json_c_allocator;
 
 /**
  * callback function prototypes
  */
 typedef void (lh_entry_free_fn) (struct lh_entry *e);
+/**
+ * callback function prototypes, given the allocator of the table
+ */
+typedef void (lh_entry_free_with_fn) (const struct json_c_allocator *allocator, struct lh_entry *e);
 /**
  * callback function prototypes
  */
@@ -132,6 +137,21 @@ struct lh_table {
 	lh_entry_free_fn *free_fn;
 	lh_hash_fn *hash_fn;
 	lh_equal_fn *equal_fn;
+
+	/**
+	 * The allocator current when the table was created.  The table is
+	 * allocated from it.  Where json_c_use_allocator() is available
+	 * free_fn runs with it current, so keys allocated with
+	 * json_c_malloc() can be freed with json_c_free().
+	 */
+	const struct json_c_allocator *allocator;
+
+	/**
+	 * Called instead of free_fn when set, with the table's allocator.
+	 * The tables of json-c objects use it to free their keys and put
+	 * their values.
+	 */
+	lh_entry_free_with_fn *free_with_fn;
 };
 
 
@@ -340,7 +360,7 @@ static inline unsigned long lh_get_hash(const struct lh_table *t, const void *k)
 /* Don't use this outside of linkhash.h: */
 #ifdef __UNCONST
 #define _LH_UNCONST(a) __UNCONST(a)
-#else
+#else
 #define _LH_UNCONST(a) ((void *)(uintptr_t)(const void *)(a))
 #endif
 
@@ -15,6 +15,7 @@
 
 #include "config.h"
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,20 +23,27 @@
 
 #include "debug.h"
 #include "printbuf.h"
-#include "vasprintf_compat.h"
+#include "json_allocator.h"
+#include "json_allocator_private.h"
 
 static int printbuf_extend(struct printbuf *p, int min_size);
 
 struct printbuf* printbuf_new(void)
+{
+  return printbuf_new_with(json_c_get_allocator());
+}
+
+struct printbuf* printbuf_new_with(const struct json_c_allocator *allocator)
 {
   struct printbuf *p;
 
-  p = (struct printbuf*)calloc(1, sizeof(struct printbuf));
+  p = (struct printbuf*)json_c_allocator_calloc(allocator, 1, sizeof(struct printbuf));
   if(!p) return NULL;
   p->size = 32;
   p->bpos = 0;
-  if(!(p->buf = (char*)malloc(p->size))) {
-    free(p);
+  p->allocator = allocator;
+  if(!(p->buf = (char*)json_c_allocator_malloc(allocator, p->size))) {
+    json_c_allocator_free(allocator, p);
     return NULL;
   }
   p->buf[0]= '\0';
@@ -67,7 +75,7 @@ static int printbuf_extend(struct printbuf *p, int min_size)
 	  "bpos=%d min_size=%d old_size=%d new_size=%d\n",
 	  p->bpos, min_size, p->size, new_size);
 #endif /* PRINTBUF_DEBUG */
-	if(!(t = (char*)realloc(p->buf, new_size)))
+	if(!(t = (char*)json_c_allocator_realloc(p->allocator, p->buf, new_size)))
 		return -1;
 	p->size = new_size;
 	p->buf = t;
@@ -109,24 +117,30 @@ int printbuf_memset(struct printbuf *pb, int offset, int charvalue, int len)
 int sprintbuf(struct printbuf *p, const char *msg, ...)
 {
   va_list ap;
-  char *t;
-  int size;
+  int size, room;
   char buf[128];
 
   /* user stack buffer first */
   va_start(ap, msg);
   size = vsnprintf(buf, 128, msg, ap);
   va_end(ap);
-  /* if string is greater than stack buffer, then use dynamic string
-     with vasprintf.  Note: some implementation of vsnprintf return -1
-     if output is truncated whereas some return the number of bytes that
-     would have been written - this code handles both cases. */
+  /* if string is greater than stack buffer, then format it straight into
+     the printbuf, so all memory comes from its allocator.  Note: some
+     implementation of vsnprintf return -1 if output is truncated whereas
+     some return the number of bytes that would have been written - this
+     code handles both cases by growing the buffer until the output fits. */
   if(size == -1 || size > 127) {
-    va_start(ap, msg);
-    if((size = vasprintf(&t, msg, ap)) < 0) { va_end(ap); return -1; }
-    va_end(ap);
-    printbuf_memappend(p, t, size);
-    free(t);
+    room = (size == -1) ? 256 : size + 1;
+    for(;;) {
+      if(printbuf_extend(p, p->bpos + room) < 0) return -1;
+      va_start(ap, msg);
+      size = vsnprintf(p->buf + p->bpos, room, msg, ap);
+      va_end(ap);
+      if(size >= 0 && size < room) break;
+      if(room > INT_MAX / 2) return -1;
+      room = (size >= room) ? size + 1 : room * 2;
+    }
+    p->bpos += size;
     return size;
   } else {
     printbuf_memappend(p, buf, size);
@@ -143,7 +157,7 @@ void printbuf_reset(struct printbuf *p)
 void printbuf_free(struct printbuf *p)
 {
   if(p) {
-    free(p->buf);
-    free(p);
+    json_c_allocator_free(p->allocator, p->buf);
+    json_c_allocator_free(p->allocator, p);
   }
 }
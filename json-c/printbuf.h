@@ -20,10 +20,13 @@
 extern "C" {
 #endif
 
+struct json_c_allocator;
+
 struct printbuf {
   char *buf;
   int bpos;
   int size;
+  const struct json_c_allocator *allocator; /* current at creation */
 };
 
 extern struct printbuf*